@@ -0,0 +1,69 @@
+/* bigram.c
+ * Final Project - Compact English letter pair (bigram) table, used to pick
+ *                 between two neighbouring keys when a capture lands right on
+ *                 the edge of a lookup table bucket. Shared with the host tools,
+ *                 so nothing in here may touch the MCU's registers.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include "bigram.h"
+
+/* Bytes per row of the table (26 two-bit scores, 4 to a byte) */
+#define BIGRAM_ROW_SIZE (7)
+
+/* Two-bit score for every pair of lowercase letters, in code space (182 bytes).
+ * Row is the first letter, and the second letter's score is in bits
+ * [2*(n%4)+1 : 2*(n%4)] of byte n/4 of the row. Scores come from letter pair
+ * counts over a few hundred thousand words of English prose, bucketed by
+ * frequency: 3 = more than 0.5% of all pairs, 2 = more than 0.1%,
+ * 1 = more than 0.01%, 0 = anything rarer */
+const uint8_t bigramTable[26 * BIGRAM_ROW_SIZE] =
+{
+    0xA9, 0x25, 0xE2, 0x8E, 0xFD, 0x1A, 0x02,   /* a */
+    0x52, 0x16, 0x86, 0x61, 0x58, 0x43, 0x02,   /* b */
+    0x62, 0x83, 0xA2, 0x71, 0x98, 0x46, 0x01,   /* c */
+    0x96, 0x17, 0x43, 0x61, 0x14, 0x02, 0x01,   /* d */
+    0xFA, 0x5A, 0x81, 0x9E, 0xBD, 0x99, 0x01,   /* e */
+    0x12, 0x0A, 0x43, 0x30, 0x58, 0x02, 0x01,   /* f */
+    0x61, 0x92, 0x42, 0x59, 0x68, 0x02, 0x04,   /* g */
+    0x03, 0x03, 0x02, 0x61, 0x94, 0x11, 0x00,   /* h */
+    0xBE, 0x2A, 0xD0, 0xBE, 0xF8, 0x48, 0x04,   /* i */
+    0x01, 0x01, 0x00, 0x50, 0x10, 0x01, 0x00,   /* j */
+    0x02, 0x16, 0x01, 0x14, 0x10, 0x00, 0x00,   /* k */
+    0x96, 0x17, 0xD3, 0x60, 0xA4, 0x16, 0x02,   /* l */
+    0x57, 0x03, 0x42, 0xE2, 0x20, 0x02, 0x01,   /* m */
+    0xE6, 0x3B, 0x52, 0x65, 0xF0, 0x06, 0x02,   /* n */
+    0xA5, 0x2D, 0x95, 0xAF, 0xAC, 0x6B, 0x00,   /* o */
+    0x52, 0x53, 0x92, 0xA5, 0xA8, 0x02, 0x02,   /* p */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00,   /* q */
+    0xA7, 0x27, 0x63, 0x76, 0xA8, 0x16, 0x02,   /* r */
+    0x62, 0x87, 0x53, 0xA5, 0xE4, 0x16, 0x02,   /* s */
+    0x63, 0xC7, 0x93, 0xB5, 0xA8, 0x52, 0x02,   /* t */
+    0xA9, 0x26, 0x82, 0x8A, 0xB8, 0x40, 0x00,   /* u */
+    0x02, 0x03, 0x02, 0x10, 0x00, 0x00, 0x00,   /* v */
+    0x02, 0x82, 0x42, 0x24, 0x14, 0x10, 0x00,   /* w */
+    0x11, 0x01, 0x01, 0x41, 0x80, 0x40, 0x00,   /* x */
+    0x01, 0x01, 0x41, 0x65, 0x64, 0x00, 0x00,   /* y */
+    0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00    /* z */
+};
+
+/* Returns how common it is in English for c to follow prev, from 0 (rare or
+ * never) to 3 (very common). Case is ignored */
+uint8_t bigramScore(uint8_t prev, uint8_t c)
+{
+    /* Fold to lowercase */
+    if (prev >= 'A' && prev <= 'Z')
+        prev += 'a' - 'A';
+    if (c >= 'A' && c <= 'Z')
+        c += 'a' - 'A';
+
+    if (prev < 'a' || prev > 'z' || c < 'a' || c > 'z')
+        return BIGRAM_NEUTRAL;
+
+    prev -= 'a';
+    c -= 'a';
+
+    return (bigramTable[(prev * BIGRAM_ROW_SIZE) + (c >> 2)] >> ((c & 0x03) << 1)) & 0x03;
+}
@@ -0,0 +1,24 @@
+/* bigram.h
+ * Final Project - Compact English letter pair (bigram) table, used to pick
+ *                 between two neighbouring keys when a capture lands right on
+ *                 the edge of a lookup table bucket. Shared with the host tools,
+ *                 so nothing in here may touch the MCU's registers.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef BIGRAM_H
+#define BIGRAM_H
+
+#include <stdint.h>
+
+/* Score given when either character isn't a letter. Sits between "rare" and
+ * "common" so that a letter pair has to be fairly likely to win over a digit */
+#define BIGRAM_NEUTRAL (1)
+
+/* Returns how common it is in English for c to follow prev, from 0 (rare or
+ * never) to 3 (very common). Case is ignored */
+uint8_t bigramScore(uint8_t prev, uint8_t c);
+
+#endif // BIGRAM_H
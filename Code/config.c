@@ -0,0 +1,329 @@
+/* config.c
+ * Final Project - Persistent configuration store in the on-chip data EEPROM.
+ *                 Settings are kept as a log of small CRC-checked records that
+ *                 is written round-robin over the whole EEPROM, so no one cell
+ *                 wears out before the rest. Everything is loaded into RAM once
+ *                 at startup, and changes are written back a record at a time
+ *                 from the main loop so that capture is never held up.
+ *
+ *                 Each record is 4 bytes: [epoch:2 | key:6] [value H] [value L] [CRC8]
+ *                 Records are appended one after another. When the end of the
+ *                 EEPROM is reached, writing wraps back to the start with the
+ *                 epoch bumped and every key queued to be written again, so the
+ *                 start of the log always ends up with a full copy of the settings
+ *                 before the older records past it are overwritten. On load, the
+ *                 older epoch's records are applied first and the current epoch's
+ *                 after them, so the newest value of each key wins even if a wrap
+ *                 was interrupted by a reset.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "serial.h"
+#include "pca.h"
+#include "keystrokes.h"
+
+/* Size of the data EEPROM, and the number of records that fit in it */
+#define EEPROM_SIZE         (2048)
+#define RECORD_SIZE         (4)
+#define LOG_SLOTS           (EEPROM_SIZE / RECORD_SIZE)
+
+/* Splitting of the first byte of a record */
+#define RECORD_KEY_MASK     (0x3F)
+#define RECORD_EPOCH_SHIFT  (6)
+#define RECORD_EPOCH_MASK   (0x03)
+
+/* EECON bits. EEE maps the EEPROM over the XRAM space for MOVX, and EEBUSY is
+ * set while a programming cycle is running. Programming of whatever's in the
+ * column latches is launched by writing the two LAUNCH values in a row */
+#define EECON_EEBUSY        (0x01)
+#define EECON_EEE           (0x02)
+#define EECON_LAUNCH_1      (0x50)
+#define EECON_LAUNCH_2      (0xA0)
+
+/* CRC-8, polynomial x^8 + x^2 + x + 1 */
+#define CRC8_POLY           (0x07)
+
+/* Internal function declarations */
+uint16_t configDefault(uint8_t key);
+uint8_t configValid(uint8_t key, uint16_t value);
+uint8_t crc8(uint8_t *buf, uint8_t len);
+uint8_t readRecord(uint16_t slot, uint8_t *key, uint8_t *epoch, uint16_t *value);
+void eepromRead(uint16_t addr, uint8_t *buf, uint8_t len);
+void eepromWrite(uint16_t addr, uint8_t *buf, uint8_t len);
+
+/* RAM copy of every key's value. Index is the key */
+static __xdata uint16_t config_values[CONFIG_NUM_KEYS];
+
+/* Bit per key that has changed since it was last written out */
+static uint16_t config_dirty;
+
+/* Next slot of the log to write, and the epoch it's being written in */
+static uint16_t log_head;
+static uint8_t log_epoch;
+
+/* Loads the latest value of every key from the EEPROM log into RAM, falling back
+ * on defaults for any that have never been saved */
+void init_config()
+{
+    uint8_t key;
+#ifdef CONFIG_USE_EEPROM
+    uint8_t epoch;
+    uint16_t slot, first, value;
+#endif
+
+    for (key = 1; key < CONFIG_NUM_KEYS; key++)
+        config_values[key] = configDefault(key);
+
+    config_dirty = 0;
+    log_head = 0;
+    log_epoch = 0;
+
+#ifdef CONFIG_USE_EEPROM
+    /* Whatever epoch the first good record is in is the current one. Normally
+     * that's slot 0, but a reset partway through writing it (or a worn cell)
+     * leaves it bad with the rest of the log still intact. Blank EEPROM just
+     * leaves everything at defaults and the log starting from the top */
+    for (first = 0; first < LOG_SLOTS; first++)
+    {
+        if (readRecord(first, &key, &log_epoch, &value))
+            break;
+    }
+
+    if (first >= LOG_SLOTS)
+    {
+        log_epoch = 0;
+        return;
+    }
+
+    /* Current epoch runs from there up to the first slot that isn't in it */
+    for (log_head = first + 1; log_head < LOG_SLOTS; log_head++)
+    {
+        if (!readRecord(log_head, &key, &epoch, &value) || epoch != log_epoch)
+            break;
+    }
+
+    /* Older epoch's leftovers first, so the current epoch overrides them */
+    for (slot = log_head; slot < LOG_SLOTS; slot++)
+    {
+        if (readRecord(slot, &key, &epoch, &value) &&
+            epoch == ((log_epoch - 1) & RECORD_EPOCH_MASK) &&
+            configValid(key, value))
+        {
+            config_values[key] = value;
+        }
+    }
+
+    /* A value that passes its CRC can still be out of range for this build (a
+     * keymap that's since been removed, say), so those keep their default */
+    for (slot = first; slot < log_head; slot++)
+    {
+        readRecord(slot, &key, &epoch, &value);
+        if (configValid(key, value))
+            config_values[key] = value;
+    }
+
+    /* Filled up right to the end; the next write starts the new epoch */
+    if (log_head >= LOG_SLOTS)
+    {
+        log_head = 0;
+        log_epoch = (log_epoch + 1) & RECORD_EPOCH_MASK;
+        config_dirty = ((uint16_t)1 << CONFIG_NUM_KEYS) - 2;    /* All keys but 0 */
+    }
+#endif // CONFIG_USE_EEPROM
+}
+
+/* Returns the current value of a key. Just a RAM read */
+uint16_t configGet(uint8_t key)
+{
+    return config_values[key];
+}
+
+/* Changes the value of a key in RAM and queues it to be saved. Returns false
+ * (and changes nothing) if the value isn't valid for the key */
+uint8_t configSet(uint8_t key, uint16_t value)
+{
+    if (!configValid(key, value))
+        return 0;
+
+    config_values[key] = value;
+    config_dirty |= ((uint16_t)1 << key);
+
+    return 1;
+}
+
+/* Does a little of the pending EEPROM work, if there is any and the EEPROM
+ * isn't busy. Never waits, so it's meant to be called every pass of the main loop */
+void configService()
+{
+#ifdef CONFIG_USE_EEPROM
+    uint8_t key;
+    uint8_t record[RECORD_SIZE];
+
+    /* Nothing to do, or last record still being programmed */
+    if (!config_dirty || (EECON & EECON_EEBUSY))
+        return;
+
+    /* One key per call, lowest first */
+    for (key = 1; !(config_dirty & ((uint16_t)1 << key)); key++)
+    {
+        ; /* intentional */
+    }
+
+    config_dirty &= ~((uint16_t)1 << key);
+
+    record[0] = (log_epoch << RECORD_EPOCH_SHIFT) | key;
+    record[1] = config_values[key] >> 8;
+    record[2] = config_values[key] & 0xFF;
+    record[3] = crc8(record, RECORD_SIZE - 1);
+
+    /* Records never straddle an EEPROM page, so the whole thing goes in one
+     * programming cycle */
+    eepromWrite(log_head * RECORD_SIZE, record, RECORD_SIZE);
+
+    /* Wrap around into a new epoch, rewriting every key before anything older
+     * gets overwritten */
+    if (++log_head >= LOG_SLOTS)
+    {
+        log_head = 0;
+        log_epoch = (log_epoch + 1) & RECORD_EPOCH_MASK;
+        config_dirty = ((uint16_t)1 << CONFIG_NUM_KEYS) - 2;    /* All keys but 0 */
+    }
+#else
+    config_dirty = 0;
+#endif // CONFIG_USE_EEPROM
+}
+
+/* Returns the value a key has before it's ever been saved */
+uint16_t configDefault(uint8_t key)
+{
+    switch (key)
+    {
+    case CONFIG_BAUD:
+        return DEFAULT_BAUD;
+
+    case CONFIG_TIMEOUT:
+        return PULSE_TRAIN_TIMEOUT;
+
+    case CONFIG_BOOT_MODE:
+        return BOOT_MODE_NORMAL;
+
+    case CONFIG_ENTER_CR:
+    case CONFIG_BIGRAM:
+    case CONFIG_MACROS:
+    case CONFIG_DRIFT:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+/* Returns true if the value is one the key can take */
+uint8_t configValid(uint8_t key, uint16_t value)
+{
+    switch (key)
+    {
+    case CONFIG_BAUD:
+        return baudIsValid(value);
+
+    case CONFIG_TIMEOUT:
+        return 1;
+
+    case CONFIG_BOOT_MODE:
+        return (value <= BOOT_MODE_MAX);
+
+    case CONFIG_ENTER_CR:
+    case CONFIG_BIGRAM:
+    case CONFIG_MACROS:
+    case CONFIG_PULSE_WIDTHS:
+    case CONFIG_DRIFT:
+        return (value <= 1);
+
+    case CONFIG_KEYMAP:
+        return (value < num_keymaps);
+
+    default:
+        return 0;
+    }
+}
+
+/* Bitwise CRC-8 of the passed buffer. Only ever run over 3 bytes */
+uint8_t crc8(uint8_t *buf, uint8_t len)
+{
+    uint8_t crc = 0;
+    uint8_t i;
+
+    while (len--)
+    {
+        crc ^= *buf++;
+
+        for (i = 0; i < 8; i++)
+        {
+            if (crc & 0x80)
+                crc = (crc << 1) ^ CRC8_POLY;
+            else
+                crc <<= 1;
+        }
+    }
+
+    return crc;
+}
+
+/* Reads the record in the passed slot of the log. Returns false if it doesn't
+ * hold a valid record (blank, half written, or an unknown key) */
+uint8_t readRecord(uint16_t slot, uint8_t *key, uint8_t *epoch, uint16_t *value)
+{
+    uint8_t record[RECORD_SIZE];
+
+    eepromRead(slot * RECORD_SIZE, record, RECORD_SIZE);
+
+    *key = record[0] & RECORD_KEY_MASK;
+    *epoch = (record[0] >> RECORD_EPOCH_SHIFT) & RECORD_EPOCH_MASK;
+    *value = (record[1] << 8) | record[2];
+
+    return (*key != 0 && *key < CONFIG_NUM_KEYS &&
+            crc8(record, RECORD_SIZE - 1) == record[3]);
+}
+
+/* While EEE is set, every MOVX goes to the EEPROM instead of XRAM, so interrupts
+ * (whose ISRs use XRAM buffers) are held off for the few instructions it's set */
+void eepromRead(uint16_t addr, uint8_t *buf, uint8_t len)
+{
+    volatile __xdata uint8_t *eeprom = (volatile __xdata uint8_t *)addr;
+    uint8_t ea_save = EA;
+
+    EA = 0;
+    EECON |= EECON_EEE;
+
+    while (len--)
+        *buf++ = *eeprom++;
+
+    EECON &= ~EECON_EEE;
+    EA = ea_save;
+}
+
+/* Loads the column latches and launches programming. Returns right away; the
+ * EEPROM is busy for a few milliseconds after (see EECON_EEBUSY). All the bytes
+ * must be within one 64 byte EEPROM page */
+void eepromWrite(uint16_t addr, uint8_t *buf, uint8_t len)
+{
+    volatile __xdata uint8_t *eeprom = (volatile __xdata uint8_t *)addr;
+    uint8_t ea_save = EA;
+
+    EA = 0;
+    EECON |= EECON_EEE;
+
+    while (len--)
+        *eeprom++ = *buf++;
+
+    EECON = EECON_LAUNCH_1;
+    EECON = EECON_LAUNCH_2;
+    EA = ea_save;
+}
@@ -0,0 +1,69 @@
+/* config.h
+ * Final Project - Persistent configuration store in the on-chip data EEPROM.
+ *                 Settings are kept as a log of small CRC-checked records that
+ *                 is written round-robin over the whole EEPROM, so no one cell
+ *                 wears out before the rest. Everything is loaded into RAM once
+ *                 at startup, and changes are written back a record at a time
+ *                 from the main loop so that capture is never held up.
+ *
+ *                 NOTE: Settings only persist on an AT89C51ED2 or ID2 (the
+ *                 header this project builds against) with CONFIG_USE_EEPROM
+ *                 defined below. The AT89C51RC2 the board ships with has no
+ *                 data EEPROM, so as built, settings are RAM only: every one
+ *                 starts at its default on each reset, and the ones that take
+ *                 effect on the next reset (baud, bootmode) never do. Keeping
+ *                 them on the RC2 would mean writing its code flash through
+ *                 IAP instead, which this store doesn't do.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+/* Uncomment on parts with the 2 KB on-chip data EEPROM (AT89C51ED2, AT89C51ID2).
+ * The AT89C51RC2 this board ships with has none, and EECON isn't there to drive,
+ * so by default settings only last until the next reset */
+//#define CONFIG_USE_EEPROM
+
+/* Configuration keys. 0 is reserved, as is anything 0x3F and up, so that blank
+ * (0xFF) and zeroed EEPROM never look like records */
+#define CONFIG_BAUD         (1)     /* UART baud rate. Takes effect on next reset */
+#define CONFIG_TIMEOUT      (2)     /* Latch reset timeout, in PCA ticks */
+#define CONFIG_BOOT_MODE    (3)     /* BOOT_MODE_* to start in. Takes effect on next reset */
+#define CONFIG_ENTER_CR     (4)     /* Host "enter" sends only '\r', so echo a '\n' after it */
+#define CONFIG_BIGRAM       (5)     /* Bucket edge captures are resolved by context (keystrokes.h) */
+#define CONFIG_KEYMAP       (6)     /* Typewriter model to decode with, index into keymaps[] */
+#define CONFIG_MACROS       (7)     /* Abbreviations typed are expanded (macro.h) */
+#define CONFIG_PULSE_WIDTHS (8)     /* Captures carry their pulse widths (pca.h) */
+#define CONFIG_DRIFT        (9)     /* Bucket edges follow timing drift (keystrokes.h) */
+#define CONFIG_NUM_KEYS     (10)    /* One past the last key */
+
+/* Modes that can be started in on reset (CONFIG_BOOT_MODE) */
+#define BOOT_MODE_NORMAL        (0)
+#define BOOT_MODE_DIAGNOSTIC    (1)
+#define BOOT_MODE_TYPIST        (2)
+#define BOOT_MODE_RAW_CAPTURE   (3)
+#define BOOT_MODE_KEY_EVENT     (4)
+#define BOOT_MODE_EDITOR        (5)
+#define BOOT_MODE_MAX           (BOOT_MODE_EDITOR)
+
+/* Loads the latest value of every key from the EEPROM log into RAM, falling back
+ * on defaults for any that have never been saved */
+void init_config();
+
+/* Returns the current value of a key. Just a RAM read */
+uint16_t configGet(uint8_t key);
+
+/* Changes the value of a key in RAM and queues it to be saved. Returns false
+ * (and changes nothing) if the value isn't valid for the key */
+uint8_t configSet(uint8_t key, uint16_t value);
+
+/* Does a little of the pending EEPROM work, if there is any and the EEPROM
+ * isn't busy. Never waits, so it's meant to be called every pass of the main loop */
+void configService();
+
+#endif // CONFIG_H
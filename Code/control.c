@@ -0,0 +1,309 @@
+/* control.c
+ * Final Project - Binary control and telemetry protocol (see control.h).
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+#include <stdint.h>
+
+#include "control.h"
+#include "serial.h"
+#include "pca.h"
+#include "config.h"
+#include "shell.h"
+#include "timer.h"
+#include "macro.h"
+#include "xmodem.h"
+
+/* States of the frame parser */
+#define CTL_IDLE        (0)     /* Waiting on an escape byte */
+#define CTL_TYPE        (1)
+#define CTL_LENGTH      (2)
+#define CTL_PAYLOAD     (3)
+#define CTL_CRC         (4)
+
+/* See control.h */
+uint8_t control_streaming;
+uint8_t control_mode_request;
+uint16_t control_bad_frames;
+
+/* Frame being received */
+static uint8_t ctl_state;
+static uint8_t ctl_type;
+static uint8_t ctl_length;
+static uint8_t ctl_received;
+static uint8_t ctl_crc;
+static uint16_t ctl_started;
+static __xdata uint8_t ctl_payload[CONTROL_MAX_PAYLOAD];
+
+/* Payload of the frame being sent. Separate, since a capture can be streamed
+ * while a frame from the host is still coming in */
+static __xdata uint8_t ctl_out[CONTROL_MAX_PAYLOAD];
+
+/* Internal function declarations */
+uint8_t controlCrc(uint8_t crc, uint8_t c);
+void controlExecute();
+void controlSend(uint8_t type, __xdata uint8_t *payload, uint8_t length);
+void controlAck();
+void controlNak(uint8_t reason);
+void controlCounters();
+void controlConfig(uint8_t key);
+
+/* Resets the frame parser and stops streaming */
+void init_control()
+{
+    ctl_state = CTL_IDLE;
+    control_streaming = 0;
+    control_mode_request = CONTROL_NO_MODE;
+    control_bad_frames = 0;
+}
+
+/* Feeds the next byte received from the host to the frame parser. Returns false
+ * if it isn't part of a control frame */
+uint8_t controlInput(uint8_t c)
+{
+    /* A frame that stalls part way through is dropped, and this byte is taken
+     * as the start of whatever comes next */
+    if (ctl_state != CTL_IDLE && (uint16_t)(getTicks() - ctl_started) > CONTROL_TIMEOUT_MS)
+    {
+        ctl_state = CTL_IDLE;
+        control_bad_frames++;
+    }
+
+    switch (ctl_state)
+    {
+    case CTL_IDLE:
+        if (c != CONTROL_ESCAPE)
+            return 0;
+
+        ctl_state = CTL_TYPE;
+        ctl_crc = 0;
+        ctl_started = getTicks();
+        break;
+
+    case CTL_TYPE:
+        ctl_type = c;
+        ctl_crc = controlCrc(ctl_crc, c);
+        ctl_state = CTL_LENGTH;
+        break;
+
+    case CTL_LENGTH:
+        if (c > CONTROL_MAX_PAYLOAD)
+        {
+            ctl_state = CTL_IDLE;
+            control_bad_frames++;
+            break;
+        }
+
+        ctl_length = c;
+        ctl_received = 0;
+        ctl_crc = controlCrc(ctl_crc, c);
+        ctl_state = c ? CTL_PAYLOAD : CTL_CRC;
+        break;
+
+    case CTL_PAYLOAD:
+        ctl_payload[ctl_received++] = c;
+        ctl_crc = controlCrc(ctl_crc, c);
+
+        if (ctl_received == ctl_length)
+            ctl_state = CTL_CRC;
+        break;
+
+    default: /* CTL_CRC */
+        ctl_state = CTL_IDLE;
+
+        if (c == ctl_crc)
+            controlExecute();
+        else
+            control_bad_frames++;
+        break;
+    }
+
+    return 1;
+}
+
+/* Sends the current capture as a CONTROL_CAPTURE frame, if streaming. An export
+ * owns the serial port, so nothing goes out during one */
+void controlCapture()
+{
+    __xdata uint8_t *p = ctl_out;
+
+    if (!control_streaming || xmodem_active)
+        return;
+
+    p[0] = capture.flags;
+    p[1] = capture.deltaTOA >> 8;
+    p[2] = capture.deltaTOA & 0xFF;
+    p[3] = capture.time >> 8;
+    p[4] = capture.time & 0xFF;
+    p[5] = capture.seq;
+
+    controlSend(CONTROL_CAPTURE, p, 6);
+}
+
+/* Folds the next byte into a CRC-8 */
+uint8_t controlCrc(uint8_t crc, uint8_t c)
+{
+    uint8_t i;
+
+    crc ^= c;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (crc & 0x80)
+            crc = (crc << 1) ^ CONTROL_CRC_POLY;
+        else
+            crc <<= 1;
+    }
+
+    return crc;
+}
+
+/* Carries out the frame just received */
+void controlExecute()
+{
+    __xdata uint8_t *p = ctl_payload;
+
+    switch (ctl_type)
+    {
+    case CONTROL_PING:
+        controlAck();
+        break;
+
+    case CONTROL_GET_COUNTERS:
+        controlCounters();
+        break;
+
+    case CONTROL_GET_CONFIG:
+        if (ctl_length != 1)
+            controlNak(CONTROL_ERR_LENGTH);
+        else if (p[0] == 0 || p[0] >= CONFIG_NUM_KEYS)
+            controlNak(CONTROL_ERR_VALUE);
+        else
+            controlConfig(p[0]);
+        break;
+
+    case CONTROL_SET_CONFIG:
+        if (ctl_length != 3)
+        {
+            controlNak(CONTROL_ERR_LENGTH);
+        }
+        else if (!configSet(p[0], ((uint16_t)p[1] << 8) | p[2]))
+        {
+            controlNak(CONTROL_ERR_VALUE);
+        }
+        else
+        {
+            settingApply(p[0], ((uint16_t)p[1] << 8) | p[2]);
+            controlConfig(p[0]);
+        }
+        break;
+
+    case CONTROL_SET_MODE:
+        if (ctl_length != 1)
+        {
+            controlNak(CONTROL_ERR_LENGTH);
+        }
+        else if (p[0] > BOOT_MODE_MAX)
+        {
+            controlNak(CONTROL_ERR_VALUE);
+        }
+        else
+        {
+            /* Acknowledged now, and carried out by the main loop */
+            control_mode_request = p[0];
+            controlAck();
+        }
+        break;
+
+    case CONTROL_STREAM:
+        if (ctl_length != 1)
+        {
+            controlNak(CONTROL_ERR_LENGTH);
+        }
+        else
+        {
+            control_streaming = (p[0] != 0);
+            controlAck();
+        }
+        break;
+
+    default:
+        controlNak(CONTROL_ERR_UNKNOWN);
+        break;
+    }
+}
+
+/* Sends a frame. Goes out through the transmit buffer like any other output */
+void controlSend(uint8_t type, __xdata uint8_t *payload, uint8_t length)
+{
+    uint8_t crc = controlCrc(controlCrc(0, type), length);
+
+    putchar(CONTROL_ESCAPE);
+    putchar(type);
+    putchar(length);
+
+    while (length--)
+    {
+        crc = controlCrc(crc, *payload);
+        putchar(*payload++);
+    }
+
+    putchar(crc);
+}
+
+/* Acknowledges the frame just received */
+void controlAck()
+{
+    ctl_out[0] = ctl_type;
+    controlSend(CONTROL_ACK, ctl_out, 1);
+}
+
+/* Refuses the frame just received */
+void controlNak(uint8_t reason)
+{
+    ctl_out[0] = ctl_type;
+    ctl_out[1] = reason;
+    controlSend(CONTROL_NAK, ctl_out, 2);
+}
+
+/* Sends every counter, in CONTROL_CTR_* order */
+void controlCounters()
+{
+    static __xdata uint16_t counters[CONTROL_NUM_COUNTERS];
+    uint8_t i;
+
+    /* Two byte counters can't be updated halfway through being read */
+    EC = 0;
+    counters[CONTROL_CTR_CAPTURES] = capture_count;
+    counters[CONTROL_CTR_ERRORS] = keystroke_errors;
+    counters[CONTROL_CTR_STUCK] = stuck_captures;
+    counters[CONTROL_CTR_CAP_OVERRUN] = capture_overruns;
+    EC = 1;
+
+    counters[CONTROL_CTR_RX_OVERRUN] = rx_overruns;
+    counters[CONTROL_CTR_MACRO_OVERRUN] = macro_overruns;
+    counters[CONTROL_CTR_BAD_FRAMES] = control_bad_frames;
+
+    for (i = 0; i < CONTROL_NUM_COUNTERS; i++)
+    {
+        ctl_out[i * 2] = counters[i] >> 8;
+        ctl_out[i * 2 + 1] = counters[i] & 0xFF;
+    }
+
+    controlSend(CONTROL_COUNTERS, ctl_out, CONTROL_NUM_COUNTERS * 2);
+}
+
+/* Sends a setting's current value */
+void controlConfig(uint8_t key)
+{
+    uint16_t value = configGet(key);
+
+    ctl_out[0] = key;
+    ctl_out[1] = value >> 8;
+    ctl_out[2] = value & 0xFF;
+    controlSend(CONTROL_CONFIG, ctl_out, 3);
+}
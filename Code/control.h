@@ -0,0 +1,54 @@
+/* control.h
+ * Final Project - Binary control and telemetry protocol. A host program can switch
+ *                 modes, read the counters, read and change settings, and have
+ *                 every keystroke's capture streamed to it, all in small framed
+ *                 binary messages that share the serial port with the text (see
+ *                 the control frames in frames.h, and Host/ctl.c).
+ *
+ *                 Frames are told apart from the text by an escape byte, so the
+ *                 text shell and menus keep working alongside. The host's bytes
+ *                 are fed in one at a time from the main loop, the same as the
+ *                 shell's, and answers go out through the transmit buffer.
+ *
+ *                 The telemetry is far smaller than the text reports it stands in
+ *                 for, which matters at 19200 baud: a CONTROL_COUNTERS frame is 20
+ *                 bytes against about 190 for "stats", and a CONTROL_CAPTURE frame
+ *                 10 bytes against about 150 for a diagnostic mode report.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+
+#include "frames.h"
+
+/* control_mode_request when no mode change is waiting */
+#define CONTROL_NO_MODE     (0xFF)
+
+/* Set while every keystroke's capture is being sent as a CONTROL_CAPTURE frame */
+extern uint8_t control_streaming;
+
+/* BOOT_MODE_* the host has asked to switch to, for the main loop to carry out,
+ * or CONTROL_NO_MODE */
+extern uint8_t control_mode_request;
+
+/* Control frames from the host dropped for a bad crc or length, or for stalling */
+extern uint16_t control_bad_frames;
+
+/* Resets the frame parser and stops streaming */
+void init_control();
+
+/* Feeds the next byte received from the host to the frame parser. Returns false
+ * if it isn't part of a control frame, in which case it's text and the caller
+ * should pass it on */
+uint8_t controlInput(uint8_t c);
+
+/* Sends the current capture (see pca.h) as a CONTROL_CAPTURE frame, if streaming.
+ * Called for every keystroke, once it's been pulled off of the capture queue */
+void controlCapture();
+
+#endif // CONTROL_H
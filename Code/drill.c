@@ -0,0 +1,368 @@
+/* drill.c
+ * Final Project - Adaptive Drill Generator For Typist Mode. Keeps a miss count
+ *                 and a latency average for each key as the typist works through
+ *                 the coach strings, and builds drill strings out of a weighted
+ *                 word list that lean on the keys they miss most and are slowest on.
+ *
+ *                 Drills are built in the background, one bounded step per
+ *                 main loop pass, into whichever of two buffers isn't being typed.
+ *                 Each word placed is the weakest of DRILL_CANDIDATES random picks
+ *                 from the list, scored as the sum of its keys' weaknesses plus
+ *                 its weight. A word's first letter is capitalized when the
+ *                 shifted key is the weaker of the two.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "drill.h"
+#include "serial.h"
+
+/* One entry in the drill word list. weight is how common the word (or n-gram)
+ * is, 1 to 15, so that with no weak keys among the candidates the everyday ones
+ * win */
+typedef struct
+{
+    char word[DRILL_WORD_LEN + 1];
+    uint8_t weight;
+} drill_word_t;
+
+/* Common words, plus short n-grams to get at the digits and punctuation */
+static const drill_word_t drill_words[] =
+{
+    { "the", 15 },      { "of", 14 },       { "and", 14 },      { "to", 14 },
+    { "in", 13 },       { "is", 13 },       { "you", 13 },      { "that", 13 },
+    { "it", 12 },       { "he", 12 },       { "was", 12 },      { "for", 12 },
+    { "on", 12 },       { "are", 11 },      { "as", 11 },       { "with", 11 },
+    { "his", 11 },      { "they", 11 },     { "at", 11 },       { "be", 11 },
+    { "this", 10 },     { "have", 10 },     { "from", 10 },     { "or", 10 },
+    { "one", 10 },      { "had", 10 },      { "by", 10 },       { "word", 9 },
+    { "but", 9 },       { "not", 9 },       { "what", 9 },      { "all", 9 },
+    { "were", 9 },      { "we", 9 },        { "when", 9 },      { "your", 9 },
+    { "can", 8 },       { "said", 8 },      { "there", 8 },     { "use", 8 },
+    { "each", 8 },      { "which", 8 },     { "she", 8 },       { "do", 8 },
+    { "how", 8 },       { "their", 8 },     { "if", 8 },        { "will", 8 },
+    { "way", 7 },       { "about", 7 },     { "many", 7 },      { "then", 7 },
+    { "them", 7 },      { "write", 7 },     { "would", 7 },     { "like", 7 },
+    { "so", 7 },        { "these", 7 },     { "her", 7 },       { "long", 7 },
+    { "make", 6 },      { "thing", 6 },     { "see", 6 },       { "him", 6 },
+    { "two", 6 },       { "look", 6 },      { "more", 6 },      { "day", 6 },
+    { "could", 6 },     { "go", 6 },        { "come", 6 },      { "did", 6 },
+    { "my", 6 },        { "sound", 5 },     { "no", 5 },        { "most", 5 },
+    { "people", 5 },    { "over", 5 },      { "know", 5 },      { "water", 5 },
+    { "than", 5 },      { "call", 5 },      { "first", 5 },     { "who", 5 },
+    { "may", 5 },       { "down", 5 },      { "side", 5 },      { "been", 5 },
+    { "now", 5 },       { "find", 5 },      { "work", 4 },      { "part", 4 },
+    { "back", 4 },      { "give", 4 },      { "just", 4 },      { "very", 4 },
+    { "quick", 4 },     { "brown", 4 },     { "fox", 4 },       { "jumps", 4 },
+    { "lazy", 4 },      { "dog", 4 },       { "box", 3 },       { "quiet", 3 },
+    { "zero", 3 },      { "zone", 3 },      { "size", 3 },      { "jazz", 2 },
+    { "quiz", 2 },      { "fix", 3 },       { "next", 3 },      { "extra", 3 },
+    { "joke", 3 },      { "major", 3 },     { "judge", 2 },     { "keep", 4 },
+    { "kind", 4 },      { "king", 3 },      { "vivid", 2 },     { "valve", 2 },
+    { "wave", 3 },      { "yes", 4 },       { "young", 3 },     { "query", 2 },
+    { "it\'s", 6 },     { "don\'t", 6 },    { "I\'m", 5 },      { "can\'t", 5 },
+    { "yes,", 4 },      { "no.", 4 },       { "well;", 2 },     { "so:", 2 },
+    { "why?", 3 },      { "stop!", 2 },     { "\"hi\"", 2 },    { "(see)", 2 },
+    { "and/or", 2 },    { "e-mail", 2 },    { "x_y", 1 },       { "1st", 3 },
+    { "2nd", 3 },       { "3rd", 3 },       { "4th", 2 },       { "10", 4 },
+    { "24", 3 },        { "365", 2 },       { "1776", 2 },      { "2048", 2 },
+    { "90210", 1 },     { "57", 2 },        { "68", 2 },        { "$5", 3 },
+    { "100%", 3 },      { "A&P", 2 },       { "#9", 2 },        { "@home", 2 },
+    { "2+2=4", 1 },     { "3*3", 1 },       { "a<b>c", 1 },     { "[x]", 1 },
+    { "2^8", 1 },
+};
+
+#define NUM_DRILL_WORDS (sizeof(drill_words) / sizeof(drill_words[0]))
+
+/* Steps of building a drill in drillService() */
+#define DRILL_STATE_PICK    (0)     /* Scoring candidate words */
+#define DRILL_STATE_COPY    (1)     /* Copying the chosen word into the drill */
+
+/* Most weakness a word is scored with, so that its score (weakness << 4 plus an
+ * 8-bit weight) still fits in 16 bits */
+#define WORD_WEAKNESS_MAX   ((0xFFFF - 0xFF) >> 4)
+
+/* Per key counters, indexed by character - DRILL_FIRST_KEY. Latencies are a
+ * running average in ms, 0 until the key has been timed */
+static __xdata uint8_t key_misses[DRILL_NUM_KEYS];
+static __xdata uint16_t key_latency[DRILL_NUM_KEYS];
+
+/* Running average of every key's latency, in ms */
+static uint16_t mean_latency;
+
+/* One drill buffer is being typed while the other is built */
+static __xdata uint8_t drill_buf[2][DRILL_LEN + 1];
+static uint8_t build_buf;
+static uint8_t build_len;
+static uint8_t build_ready;
+
+/* Total weakness of the words placed in the drill being built, to tell whether
+ * it's worth showing */
+static uint16_t build_weakness;
+
+/* Word choice in progress */
+static uint8_t drill_state = DRILL_STATE_PICK;
+static uint8_t candidates_left = DRILL_CANDIDATES;
+static uint8_t best_word;
+static uint8_t best_len;
+static uint8_t best_caps;
+static uint16_t best_score;
+static uint16_t best_weakness;
+static uint8_t last_word = 0xFF;
+static uint8_t copy_pos;
+
+static uint16_t drill_rand;
+
+/* Internal Function Declarations */
+uint16_t keyWeakness(uint8_t key);
+uint16_t drillRandom();
+void scoreCandidate(uint8_t ndx);
+void copyStep();
+
+/* Records a keystroke the typist was meant to make. See drill.h */
+void drillRecordKey(uint8_t expected, uint8_t hit, uint16_t latency_ms)
+{
+    uint8_t i;
+
+    if (expected < DRILL_FIRST_KEY || expected >= DRILL_FIRST_KEY + DRILL_NUM_KEYS)
+        return;
+
+    i = expected - DRILL_FIRST_KEY;
+
+    if (!hit)
+    {
+        key_misses[i] = (key_misses[i] > 255 - DRILL_MISS_STEP) ? 255 : key_misses[i] + DRILL_MISS_STEP;
+        return;
+    }
+
+    if (key_misses[i])
+        key_misses[i]--;
+
+    if (latency_ms && latency_ms <= DRILL_MAX_LATENCY)
+    {
+        /* Averages over roughly the last 8 samples, without any multiplies */
+        if (key_latency[i])
+            key_latency[i] = key_latency[i] - (key_latency[i] >> 3) + (latency_ms >> 3);
+        else
+            key_latency[i] = latency_ms;
+
+        if (mean_latency)
+            mean_latency = mean_latency - (mean_latency >> 3) + (latency_ms >> 3);
+        else
+            mean_latency = latency_ms;
+    }
+}
+
+/* Returns how weak the typist is on a key: its miss count, plus how much slower
+ * than their average it is */
+uint16_t keyWeakness(uint8_t key)
+{
+    uint8_t i;
+    uint16_t weakness;
+
+    if (key < DRILL_FIRST_KEY || key >= DRILL_FIRST_KEY + DRILL_NUM_KEYS)
+        return 0;
+
+    i = key - DRILL_FIRST_KEY;
+    weakness = key_misses[i];
+
+    if (key_latency[i] > mean_latency)
+        weakness += (key_latency[i] - mean_latency) >> DRILL_LATENCY_SHIFT;
+
+    return weakness;
+}
+
+/* 16 bit xorshift. Seeded from the free running PCA counter on first use */
+uint16_t drillRandom()
+{
+    if (!drill_rand)
+        drill_rand = ((uint16_t)CH << 8) | CL | 1;
+
+    drill_rand ^= drill_rand << 7;
+    drill_rand ^= drill_rand >> 9;
+    drill_rand ^= drill_rand << 8;
+
+    return drill_rand;
+}
+
+/* Scores one word from the list, keeping it if it beats the best so far. At most
+ * DRILL_WORD_LEN + 1 weakness lookups */
+void scoreCandidate(uint8_t ndx)
+{
+    const char *word = drill_words[ndx].word;
+    uint16_t weakness = 0, lower, upper;
+    uint16_t score;
+    uint8_t caps = 0, len;
+
+    if (ndx == last_word)
+        return;
+
+    /* Capitalize if the shifted first letter is the weaker key */
+    lower = keyWeakness(word[0]);
+    if (word[0] >= 'a' && word[0] <= 'z')
+    {
+        upper = keyWeakness(word[0] - 'a' + 'A');
+        if (upper > lower)
+        {
+            lower = upper;
+            caps = 1;
+        }
+    }
+    weakness = (lower < WORD_WEAKNESS_MAX) ? lower : WORD_WEAKNESS_MAX;
+
+    /* Saturating, as a word of very weak keys would overflow the score */
+    for (len = 1; len < DRILL_WORD_LEN && word[len]; len++)
+    {
+        lower = keyWeakness(word[len]);
+        if (lower < WORD_WEAKNESS_MAX - weakness)
+            weakness += lower;
+        else
+            weakness = WORD_WEAKNESS_MAX;
+    }
+
+    /* Weakness dominates, the weight only settles it among strong keys */
+    score = (weakness << 4) + drill_words[ndx].weight;
+
+    if (score > best_score)
+    {
+        best_score = score;
+        best_weakness = weakness;
+        best_word = ndx;
+        best_len = len;
+        best_caps = caps;
+    }
+}
+
+/* Copies one character of the chosen word into the drill, with a space in
+ * front of every word but the first */
+void copyStep()
+{
+    uint8_t *drill = drill_buf[build_buf];
+    uint8_t c;
+
+    if (copy_pos == 0)
+    {
+        /* Drill is full, so it's finished */
+        if (build_len + (build_len ? 1 : 0) + best_len > DRILL_LEN)
+        {
+            drill[build_len] = 0;
+            build_ready = 1;
+            return;
+        }
+
+        if (build_len)
+            drill[build_len++] = ' ';
+    }
+
+    c = drill_words[best_word].word[copy_pos];
+    if (copy_pos == 0 && best_caps)
+        c = c - 'a' + 'A';
+
+    drill[build_len++] = c;
+
+    if (++copy_pos >= best_len)
+    {
+        /* Word is in, go pick the next */
+        build_weakness += best_weakness;
+        last_word = best_word;
+        best_score = 0;
+        candidates_left = DRILL_CANDIDATES;
+        drill_state = DRILL_STATE_PICK;
+    }
+}
+
+void drillService()
+{
+    if (build_ready)
+        return;
+
+    if (drill_state == DRILL_STATE_PICK)
+    {
+        scoreCandidate(drillRandom() % NUM_DRILL_WORDS);
+
+        if (--candidates_left == 0)
+        {
+            copy_pos = 0;
+            drill_state = DRILL_STATE_COPY;
+        }
+    }
+    else
+    {
+        copyStep();
+    }
+}
+
+uint8_t * drillTake()
+{
+    uint8_t *drill = 0;
+
+    if (!build_ready)
+        return 0;
+
+    /* Hand over the finished drill and build the next one in the other buffer.
+     * With nothing to drill, build over the same buffer instead */
+    if (build_weakness)
+    {
+        drill = drill_buf[build_buf];
+        build_buf ^= 1;
+    }
+
+    build_len = 0;
+    build_weakness = 0;
+    build_ready = 0;
+
+    return drill;
+}
+
+void reportWeakKeys()
+{
+    uint8_t keys[DRILL_REPORT_KEYS];
+    uint16_t scores[DRILL_REPORT_KEYS];
+    uint16_t weakness;
+    uint8_t i, j, n = 0;
+
+    /* Insertion into a short sorted list, skipping the keys with no weakness */
+    for (i = 0; i < DRILL_NUM_KEYS; i++)
+    {
+        weakness = keyWeakness(DRILL_FIRST_KEY + i);
+        if (!weakness)
+            continue;
+
+        for (j = n; j > 0 && scores[j - 1] < weakness; j--)
+        {
+            if (j < DRILL_REPORT_KEYS)
+            {
+                keys[j] = keys[j - 1];
+                scores[j] = scores[j - 1];
+            }
+        }
+
+        if (j < DRILL_REPORT_KEYS)
+        {
+            keys[j] = i;
+            scores[j] = weakness;
+            if (n < DRILL_REPORT_KEYS)
+                n++;
+        }
+    }
+
+    if (!n)
+    {
+        putstr("No weak keys yet\r\n");
+        return;
+    }
+
+    printf_small("Weakest keys (average %u ms):\r\n", mean_latency);
+    for (j = 0; j < n; j++)
+    {
+        printf_small(" '%c' - weakness %u, %u ms\r\n", keys[j] + DRILL_FIRST_KEY,
+                     scores[j], key_latency[keys[j]]);
+    }
+}
@@ -0,0 +1,65 @@
+/* drill.h
+ * Final Project - Adaptive Drill Generator For Typist Mode. Keeps a miss count
+ *                 and a latency average for each key as the typist works through
+ *                 the coach strings, and builds drill strings out of a weighted
+ *                 word list that lean on the keys they miss most and are slowest on.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef DRILL_H
+#define DRILL_H
+
+#include <stdint.h>
+
+/* Keys that are tracked: printable ASCII, space through '~' */
+#define DRILL_FIRST_KEY     (' ')
+#define DRILL_NUM_KEYS      (95)
+
+/* Longest drill string, not counting the terminator */
+#define DRILL_LEN           (64)
+
+/* Longest word in the drill word list, not counting the terminator */
+#define DRILL_WORD_LEN      (7)
+
+/* Random words scored for each word placed in a drill. The weakest scoring one
+ * goes in, which is what over-samples the weak keys */
+#define DRILL_CANDIDATES    (16)
+
+/* A miss adds this to the key's miss count, and each hit takes 1 back off, so
+ * keys that are missed often stay weak until they've been typed right a while.
+ * Saturates at 255 */
+#define DRILL_MISS_STEP     (8)
+
+/* Gaps between keystrokes longer than this (ms) are the typist pausing, so they
+ * aren't counted as latency */
+#define DRILL_MAX_LATENCY   (2000)
+
+/* A key's latency counts this many ms over the typist's average latency as one
+ * miss worth of weakness (as a shift) */
+#define DRILL_LATENCY_SHIFT (2)
+
+/* Number of keys listed by reportWeakKeys() */
+#define DRILL_REPORT_KEYS   (5)
+
+/* Records a keystroke the typist was meant to make. expected is the character
+ * they should have typed, hit whether they typed it, and latency_ms the time
+ * since their previous correct keystroke (0 if there isn't one to go by) */
+void drillRecordKey(uint8_t expected, uint8_t hit, uint16_t latency_ms);
+
+/* Does one bounded step of building the next drill: scoring one candidate word,
+ * or copying one character of the chosen one into the drill. Meant to be called
+ * every pass of the main loop in typist mode, so the drill is built a little at
+ * a time between keystrokes instead of all at once */
+void drillService();
+
+/* Returns the finished drill string, or 0 if it isn't finished yet or there are
+ * no weak keys worth drilling. Starts building the next one. The returned string
+ * stays valid until the drill after it is taken */
+uint8_t * drillTake();
+
+/* Prints the DRILL_REPORT_KEYS weakest keys with their weakness and latencies */
+void reportWeakKeys();
+
+#endif // DRILL_H
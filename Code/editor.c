@@ -0,0 +1,419 @@
+/* editor.c
+ * Final Project - Document Editor Mode. Edits a plain text document held in a
+ *                 gap buffer in the external SRAM, with the typewriter's own tab
+ *                 stops, margins and correction keys.
+ *
+ *                 The text before the cursor is at the bottom of the buffer and
+ *                 the text after it is at the top, with the free space (the gap)
+ *                 in between. Typing and correcting at the cursor just move the
+ *                 edge of the gap, and moving the cursor moves one character
+ *                 across it, so nothing is ever shuffled around no matter how big
+ *                 the document gets. The terminal only ever shows the line being
+ *                 edited: changes reprint from the cursor to the end of the line
+ *                 and backspace back, and moving to another line prints that
+ *                 line fresh below.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "editor.h"
+#include "keystrokes.h"
+#include "serial.h"
+
+/* Terminal bell, for keys that can't do anything where the cursor is */
+#define EDITOR_BELL (7)
+
+/* The document. Text before the cursor is doc[0, gap_start), text after it is
+ * doc[gap_end, EDITOR_BUF_SIZE) */
+static __xdata __at(EDITOR_BUF_ADDR) uint8_t doc[EDITOR_BUF_SIZE];
+static uint16_t gap_start;
+static uint16_t gap_end;
+
+/* Column of the cursor in its line */
+static uint8_t cursor_col;
+
+static uint8_t left_margin;
+static uint8_t right_margin;
+static uint8_t margin_released;
+
+/* One bit per column */
+static uint8_t tab_stops[EDITOR_MAX_COLS / 8];
+
+/* Internal Function Declarations */
+uint8_t insertRun(uint8_t c, uint8_t count);
+void newLine();
+void correctChar();
+uint8_t moveLeft();
+uint8_t moveRight();
+void indexLine(uint8_t up);
+void tabOut();
+uint8_t printRestOfLine();
+uint8_t restOfLineLength();
+void backUp(uint8_t count);
+void showLine();
+uint16_t lineStart();
+
+void init_editor()
+{
+    uint8_t i;
+
+    gap_start = 0;
+    gap_end = EDITOR_BUF_SIZE;
+    cursor_col = 0;
+
+    left_margin = EDITOR_DEFAULT_LEFT;
+    right_margin = EDITOR_DEFAULT_RIGHT;
+    margin_released = 0;
+
+    for (i = 0; i < EDITOR_MAX_COLS; i++)
+    {
+        if (i && !(i % EDITOR_DEFAULT_TAB))
+            tab_stops[i >> 3] |= (1 << (i & 7));
+        else
+            tab_stops[i >> 3] &= ~(1 << (i & 7));
+    }
+}
+
+void editorEnter()
+{
+    putstr("\r\nEntering Document Editor (<TAB CLEAR> off a tab stop to exit)\r\n");
+    printf_small("Margins %u-%u, %u characters\r\n", left_margin, right_margin, editorLength());
+    showLine();
+}
+
+uint16_t editorLength()
+{
+    return gap_start + (EDITOR_BUF_SIZE - gap_end);
+}
+
+uint8_t editorRead(uint16_t pos)
+{
+    if (pos < gap_start)
+        return doc[pos];
+
+    return doc[pos + (gap_end - gap_start)];
+}
+
+uint8_t editorKeystroke(uint8_t key)
+{
+    uint8_t released = margin_released;
+
+    switch (key)
+    {
+    case '\r':                  /* Also LEFT_MARGIN_CODE */
+        if (released && cursor_col < right_margin)
+        {
+            left_margin = cursor_col;
+            margin_released = 0;
+        }
+        else
+        {
+            newLine();
+        }
+        break;
+
+    case TAB_CODE:
+        tabOut();
+        break;
+
+    case TAB_SET_CODE:
+        tab_stops[cursor_col >> 3] |= (1 << (cursor_col & 7));
+        break;
+
+    case TAB_CLEAR_CODE:
+        if (!(tab_stops[cursor_col >> 3] & (1 << (cursor_col & 7))))
+            return 1;
+        tab_stops[cursor_col >> 3] &= ~(1 << (cursor_col & 7));
+        break;
+
+    case RIGHT_MARGIN_CODE:
+        if (cursor_col > left_margin)
+            right_margin = cursor_col;
+        else
+            putchar(EDITOR_BELL);
+        break;
+
+    case MARGIN_RELEASE_CODE:
+        margin_released = 1;
+        break;
+
+    case CORRECT_CODE:
+        correctChar();
+        break;
+
+    case BACKSPACE_CODE:
+        if (moveLeft())
+            putchar(BACKSPACE_CODE);
+        else
+            putchar(EDITOR_BELL);
+        break;
+
+    case HALF_SPACE_CODE:
+        if (moveRight())
+            putchar(doc[gap_start - 1]);    /* Reprinting it moves the terminal's cursor on */
+        else
+            putchar(EDITOR_BELL);
+        break;
+
+    case INDEX_CODE:
+        indexLine(released);
+        margin_released = 0;
+        break;
+
+    default:
+        /* Everything else that isn't printable (SHIFT, etc.) is ignored */
+        if (key >= ' ' && key < 0x7F)
+        {
+            /* Run onto a new line at the right margin, as if return was hit */
+            if (!margin_released && cursor_col >= right_margin)
+                newLine();
+
+            if (insertRun(key, 1) && cursor_col == right_margin - EDITOR_WARN_COLS)
+                putchar(EDITOR_BELL);
+        }
+        break;
+    }
+
+    return 0;
+}
+
+/* Inserts count copies of c at the cursor and updates the terminal. Returns false
+ * (inserting nothing) if they don't all fit in the document or the line */
+uint8_t insertRun(uint8_t c, uint8_t count)
+{
+    uint8_t i;
+
+    if (gap_end - gap_start < count || cursor_col + count + restOfLineLength() >= EDITOR_MAX_COLS)
+    {
+        putchar(EDITOR_BELL);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        doc[gap_start++] = c;
+        putchar(c);
+    }
+    cursor_col += count;
+
+    backUp(printRestOfLine());
+
+    return 1;
+}
+
+/* Splits the line at the cursor. The rest of the line moves down to a new line
+ * that starts at the left margin */
+void newLine()
+{
+    uint8_t rest, i;
+
+    if (gap_end - gap_start < 1 + left_margin)
+    {
+        putchar(EDITOR_BELL);
+        return;
+    }
+
+    /* Blank out the part of the line that's moving down */
+    rest = printRestOfLine();
+    backUp(rest);
+    for (i = 0; i < rest; i++)
+        putchar(' ');
+
+    doc[gap_start++] = '\n';
+    putstr("\r\n");
+    cursor_col = 0;
+    margin_released = 0;
+
+    if (!insertRun(' ', left_margin))
+        backUp(printRestOfLine());
+}
+
+/* Deletes the character before the cursor. Deleting a line break joins the two
+ * lines, which are reprinted together below */
+void correctChar()
+{
+    uint8_t rest;
+
+    if (!gap_start)
+    {
+        putchar(EDITOR_BELL);
+        return;
+    }
+
+    if (doc[--gap_start] == '\n')
+    {
+        uint16_t col = gap_start - lineStart();
+
+        /* Joined line would be too long, so leave the break */
+        if (col + restOfLineLength() >= EDITOR_MAX_COLS)
+        {
+            gap_start++;
+            putchar(EDITOR_BELL);
+            return;
+        }
+
+        cursor_col = col;
+        showLine();
+        return;
+    }
+
+    cursor_col--;
+    putchar(BACKSPACE_CODE);
+    rest = printRestOfLine();
+    putchar(' ');
+    backUp(rest + 1);
+}
+
+/* Moves the cursor back a character within its line. Returns false if it's at
+ * the start of the line */
+uint8_t moveLeft()
+{
+    if (!gap_start || doc[gap_start - 1] == '\n')
+        return 0;
+
+    doc[--gap_end] = doc[--gap_start];
+    cursor_col--;
+
+    return 1;
+}
+
+/* Moves the cursor forward a character within its line. Returns false if it's at
+ * the end of the line */
+uint8_t moveRight()
+{
+    if (gap_end == EDITOR_BUF_SIZE || doc[gap_end] == '\n')
+        return 0;
+
+    doc[gap_start++] = doc[gap_end++];
+    cursor_col++;
+
+    return 1;
+}
+
+/* Moves the cursor to the same column (or the end) of the next line, or the
+ * previous line if up is set */
+void indexLine(uint8_t up)
+{
+    uint8_t col = cursor_col;
+
+    if (up)
+    {
+        uint16_t start = lineStart();
+
+        if (!start)
+        {
+            putchar(EDITOR_BELL);
+            return;
+        }
+
+        /* Back across this line and the line break before it */
+        while (moveLeft())
+            ;
+        doc[--gap_end] = doc[--gap_start];
+
+        /* Then to the start of the previous line */
+        cursor_col = gap_start - lineStart();
+        while (moveLeft())
+            ;
+    }
+    else
+    {
+        /* Last line */
+        if (gap_end + restOfLineLength() == EDITOR_BUF_SIZE)
+        {
+            putchar(EDITOR_BELL);
+            return;
+        }
+
+        /* Forward to this line's break, and across it */
+        while (moveRight())
+            ;
+        doc[gap_start++] = doc[gap_end++];
+        cursor_col = 0;
+    }
+
+    while (cursor_col < col && moveRight())
+        ;
+
+    showLine();
+}
+
+/* Spaces out to the next tab stop before the right margin */
+void tabOut()
+{
+    uint8_t col;
+
+    for (col = cursor_col + 1; col < right_margin && col < EDITOR_MAX_COLS; col++)
+    {
+        if (tab_stops[col >> 3] & (1 << (col & 7)))
+        {
+            insertRun(' ', col - cursor_col);
+            return;
+        }
+    }
+
+    putchar(EDITOR_BELL);
+}
+
+/* Prints the line after the cursor, leaving the terminal's cursor at its end.
+ * Returns how many characters were printed */
+uint8_t printRestOfLine()
+{
+    uint16_t i;
+    uint8_t count = 0;
+
+    for (i = gap_end; i < EDITOR_BUF_SIZE && doc[i] != '\n'; i++, count++)
+        putchar(doc[i]);
+
+    return count;
+}
+
+/* Returns the length of the line after the cursor */
+uint8_t restOfLineLength()
+{
+    uint16_t i;
+    uint8_t count = 0;
+
+    for (i = gap_end; i < EDITOR_BUF_SIZE && doc[i] != '\n'; i++)
+        count++;
+
+    return count;
+}
+
+/* Moves the terminal's cursor back count characters */
+void backUp(uint8_t count)
+{
+    while (count--)
+        putchar(BACKSPACE_CODE);
+}
+
+/* Prints the whole line the cursor is on, on a fresh terminal line, and puts the
+ * terminal's cursor where it is in the line */
+void showLine()
+{
+    uint16_t i;
+
+    putstr("\r\n");
+    for (i = lineStart(); i < gap_start; i++)
+        putchar(doc[i]);
+
+    backUp(printRestOfLine());
+}
+
+/* Returns where the line the cursor is on starts in doc[] */
+uint16_t lineStart()
+{
+    uint16_t i = gap_start;
+
+    while (i && doc[i - 1] != '\n')
+        i--;
+
+    return i;
+}
@@ -0,0 +1,67 @@
+/* editor.h
+ * Final Project - Document Editor Mode. Edits a plain text document held in a
+ *                 gap buffer in the external SRAM, with the typewriter's own tab
+ *                 stops, margins and correction keys. The terminal is updated a
+ *                 line at a time with just backspaces and carriage returns, never
+ *                 redrawn, so any dumb terminal (or a printer) works.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include <stdint.h>
+
+/* The document's gap buffer takes the external SRAM (0x0000-0x7FFF in FINAL.PLD)
+ * above the 1k of on-chip XRAM that shadows the bottom of it, up to the keystroke
+ * journal (see journal.h) */
+#define EDITOR_BUF_ADDR         (0x0400)
+#define EDITOR_BUF_SIZE         (0x5C00)
+
+/* Columns are tracked up to this, which is also the longest a line can get */
+#define EDITOR_MAX_COLS         (128)
+
+/* Margins and tab stops (every 8 columns) on startup */
+#define EDITOR_DEFAULT_LEFT     (0)
+#define EDITOR_DEFAULT_RIGHT    (72)
+#define EDITOR_DEFAULT_TAB      (8)
+
+/* The bell rings this many columns before the right margin, like the real thing */
+#define EDITOR_WARN_COLS        (6)
+
+/* Clears the document and sets the default margins and tab stops */
+void init_editor();
+
+/* Prints the editor's banner and the line the cursor is on, to start editing */
+void editorEnter();
+
+/* Applies one decoded keystroke to the document, and updates the terminal to
+ * match. Printable keys are inserted at the cursor, and the typewriter's keys do:
+ *   <RETURN>           New line, indented to the left margin. Wraps by itself
+ *                      at the right margin
+ *   <TAB>              Spaces out to the next tab stop
+ *   <TAB SET>          Sets a tab stop at the cursor's column
+ *   <TAB CLEAR>        Clears the tab stop at the cursor's column
+ *   <RIGHT MARGIN>     Sets the right margin at the cursor's column
+ *   <MARGIN RELEASE>   Lets the current line run past the right margin. Also
+ *                      changes the meaning of the next <RETURN> (sets the left
+ *                      margin at the cursor's column instead, since the left
+ *                      margin key sends the same code) or <INDEX> (moves up)
+ *   <CORRECT>          Deletes the character before the cursor
+ *   <BACKSPACE>        Moves the cursor back a character
+ *   <HALF SPACE>       Moves the cursor forward a character
+ *   <INDEX>            Moves the cursor down a line
+ * Returns true if the keystroke was <TAB CLEAR> off of a tab stop, which leaves
+ * the editor */
+uint8_t editorKeystroke(uint8_t key);
+
+/* Number of characters in the document */
+uint16_t editorLength();
+
+/* Returns the character at pos in the document (which must be less than
+ * editorLength()), as if there were no gap */
+uint8_t editorRead(uint16_t pos);
+
+#endif // EDITOR_H
@@ -0,0 +1,124 @@
+/* frames.h
+ * Final Project - Wire formats for the binary frames the firmware sends over
+ *                 the UART. Shared with the host tools (see Host/), so this
+ *                 header must not pull in anything specific to the MCU.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef FRAMES_H
+#define FRAMES_H
+
+/* ==== Raw capture frame ====
+ * Sent once per keystroke in raw capture mode, with no decoding done on the MCU:
+ *
+ *   [CAPTURE_FRAME_SYNC] [flags] [deltaTOA high] [deltaTOA low] [check]
+ *
+ * check is the XOR of flags and both deltaTOA bytes. Receivers resync by
+ * scanning for the sync byte and rejecting any frame whose check byte or
+ * reserved flag bits don't match, so human-readable text sent between frames
+ * (mode entry/exit messages) is skipped over safely */
+#define CAPTURE_FRAME_SYNC      (0xFE)
+#define CAPTURE_FRAME_SIZE      (5)
+
+/* Flag bits of a raw capture frame */
+#define CAPTURE_FLAG_A_FIRST    (0x01)  /* Channel A wavefront arrived first */
+#define CAPTURE_FLAG_A_POS      (0x02)  /* Channel A wavefront initially positive */
+#define CAPTURE_FLAG_B_POS      (0x04)  /* Channel B wavefront initially positive */
+#define CAPTURE_FLAG_SHIFT      (0x08)  /* SHIFT or CAPSLOCK held down */
+#define CAPTURE_FLAG_KEYBOARD2  (0x10)  /* Captured on the second keyboard */
+#define CAPTURE_FLAG_RESERVED   (0xE0)  /* Always sent as 0 */
+
+/* ==== Pulse width frame ====
+ * Sent just ahead of each raw capture frame when the firmware is in pulse width
+ * mode (see pulse_widths in pca.h), with how long the capture's pulses were high:
+ *
+ *   [WIDTH_FRAME_SYNC] [wavefront high] [wavefront low] [coincidence high]
+ *   [coincidence low] [check]
+ *
+ * Both widths are in PCA ticks, 0 if the falling edge was never seen. check is
+ * the XOR of the four width bytes. Receivers that don't know this frame skip over
+ * it while resyncing, like any other bytes between raw capture frames */
+#define WIDTH_FRAME_SYNC        (0xFC)
+#define WIDTH_FRAME_SIZE        (6)
+
+/* One board can serve two keyboards (see DUAL_KEYBOARD in pca.h). Captures and
+ * key events say which one they came from, so the two streams can be told apart */
+#define NUM_KEYBOARDS           (2)
+#define CAPTURE_KEYBOARD(flags) (((flags) & CAPTURE_FLAG_KEYBOARD2) ? 1 : 0)
+
+/* ==== Key event frame ====
+ * Sent once per keystroke in key event mode, with the keystroke decoded on the MCU:
+ *
+ *   [EVENT_FRAME_SYNC] [key] [shift | keyboard | dt high] [dt low] [check]
+ *
+ * key is the decoded character or special key code from keystrokes.h (0 for a
+ * keystroke that couldn't be decoded). The top bit of the third byte is set if
+ * SHIFT was held, the next bit if the key came from the second keyboard, and the
+ * remaining 14 bits are the milliseconds since the previous keystroke on the same
+ * keyboard, saturating at EVENT_DT_MAX. check is the XOR of the three bytes
+ * before it. Resync is the same as for raw capture frames */
+#define EVENT_FRAME_SYNC        (0xFD)
+#define EVENT_FRAME_SIZE        (5)
+
+#define EVENT_SHIFT_MASK        (0x80)  /* In the dt high byte */
+#define EVENT_KEYBOARD2_MASK    (0x40)  /* In the dt high byte */
+#define EVENT_DT_MAX            (0x3FFF)
+
+/* ==== Control frames ====
+ * Binary control and telemetry (see control.h), sharing the serial port with the
+ * text in both directions:
+ *
+ *   [CONTROL_ESCAPE] [type] [length] [payload, length bytes] [crc]
+ *
+ * crc is the CRC-8 (polynomial CONTROL_CRC_POLY, starting from 0) of the type,
+ * length and payload. Values in a payload go high byte first. The menus and the
+ * shell never print the escape byte, but the binary output of other modes can
+ * carry it: raw capture frames (CAPTURE_FLAG_KEYBOARD2 is the same value), key
+ * event and pulse width frames, and XMODEM exports. A receiver picks frames out
+ * from between the text by scanning for the escape byte, passing over any of the
+ * frames above that check out whole, and rescans from the byte after the escape
+ * on a bad crc. During an XMODEM export the port belongs to the receiver, so
+ * control frames shouldn't be sent until it's over. The firmware drops a frame
+ * from the host that fails its crc or isn't all there within CONTROL_TIMEOUT_MS */
+#define CONTROL_ESCAPE          (0x10)  /* DLE */
+#define CONTROL_CRC_POLY        (0x07)
+#define CONTROL_MAX_PAYLOAD     (16)
+#define CONTROL_OVERHEAD        (4)     /* Escape, type, length and crc */
+#define CONTROL_TIMEOUT_MS      (250)
+
+/* Host to firmware. Each is answered with the frame after the arrow, or
+ * CONTROL_NAK */
+#define CONTROL_PING            (0x01)  /* -> CONTROL_ACK */
+#define CONTROL_GET_COUNTERS    (0x02)  /* -> CONTROL_COUNTERS */
+#define CONTROL_GET_CONFIG      (0x03)  /* [key] -> CONTROL_CONFIG */
+#define CONTROL_SET_CONFIG      (0x04)  /* [key] [value high] [value low] -> CONTROL_CONFIG */
+#define CONTROL_SET_MODE        (0x05)  /* [BOOT_MODE_*] -> CONTROL_ACK, then the mode's banner text */
+#define CONTROL_STREAM          (0x06)  /* [1 to start, 0 to stop] -> CONTROL_ACK */
+
+/* Firmware to host */
+#define CONTROL_ACK             (0x81)  /* [type acknowledged] */
+#define CONTROL_NAK             (0x82)  /* [type refused] [CONTROL_ERR_*] */
+#define CONTROL_COUNTERS        (0x83)  /* CONTROL_NUM_COUNTERS 16 bit counters, CONTROL_CTR_* order */
+#define CONTROL_CONFIG          (0x84)  /* [key] [value high] [value low] */
+#define CONTROL_CAPTURE         (0x85)  /* Sent for every keystroke while streaming:
+                                         * [flags] [deltaTOA high] [deltaTOA low]
+                                         * [time high] [time low] [seq] */
+
+/* Reasons for a CONTROL_NAK */
+#define CONTROL_ERR_UNKNOWN     (1)     /* No such frame type */
+#define CONTROL_ERR_LENGTH      (2)     /* Wrong payload length for the type */
+#define CONTROL_ERR_VALUE       (3)     /* Key or value out of range */
+
+/* Counters in a CONTROL_COUNTERS frame */
+#define CONTROL_CTR_CAPTURES    (0)
+#define CONTROL_CTR_ERRORS      (1)     /* Keystroke errors */
+#define CONTROL_CTR_STUCK       (2)
+#define CONTROL_CTR_CAP_OVERRUN (3)
+#define CONTROL_CTR_RX_OVERRUN  (4)
+#define CONTROL_CTR_MACRO_OVERRUN (5)
+#define CONTROL_CTR_BAD_FRAMES  (6)     /* Control frames from the host dropped */
+#define CONTROL_NUM_COUNTERS    (7)
+
+#endif // FRAMES_H
@@ -0,0 +1,68 @@
+/* journal.c
+ * Final Project - Keystroke Journal. Every keystroke taken from the typewriter
+ *                 is kept as a raw capture frame (see frames.h) in a ring in the
+ *                 external SRAM, so a session can be pulled off later (see
+ *                 xmodem.h) and decoded again on the host, with any keymap.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+
+#include <stdint.h>
+
+#include "journal.h"
+#include "pca.h"
+
+/* See journal.h */
+uint8_t journal_hold;
+
+static __xdata __at(JOURNAL_ADDR) uint8_t journal[JOURNAL_SIZE];
+
+/* Where the next frame goes, and how many bytes of frames are kept */
+static uint16_t journal_head;
+static uint16_t journal_count;
+
+void journalCapture()
+{
+    uint8_t flags = capture.flags;
+    uint8_t dTOA_H = capture.deltaTOA >> 8;
+    uint8_t dTOA_L = capture.deltaTOA & 0xFF;
+
+    if (journal_hold)
+        return;
+
+    /* Frames are whole, so the ring never wraps partway through one */
+    journal[journal_head] = CAPTURE_FRAME_SYNC;
+    journal[journal_head + 1] = flags;
+    journal[journal_head + 2] = dTOA_H;
+    journal[journal_head + 3] = dTOA_L;
+    journal[journal_head + 4] = flags ^ dTOA_H ^ dTOA_L;
+
+    journal_head += CAPTURE_FRAME_SIZE;
+    if (journal_head >= JOURNAL_SIZE)
+        journal_head = 0;
+
+    if (journal_count < JOURNAL_SIZE)
+        journal_count += CAPTURE_FRAME_SIZE;
+}
+
+uint16_t journalLength()
+{
+    return journal_count;
+}
+
+uint8_t journalRead(uint16_t pos)
+{
+    /* The oldest frame is at the head once the ring has filled, else at 0 */
+    if (journal_count == JOURNAL_SIZE)
+    {
+        pos += journal_head;
+        if (pos >= JOURNAL_SIZE)
+            pos -= JOURNAL_SIZE;
+    }
+
+    return journal[pos];
+}
@@ -0,0 +1,39 @@
+/* journal.h
+ * Final Project - Keystroke Journal. Every keystroke taken from the typewriter
+ *                 is kept as a raw capture frame (see frames.h) in a ring in the
+ *                 external SRAM, so a session can be pulled off later (see
+ *                 xmodem.h) and decoded again on the host, with any keymap.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+#include "frames.h"
+
+/* The journal takes the top 8k of the external SRAM, above the editor's
+ * document (see editor.h) */
+#define JOURNAL_ADDR    (0x6000)
+#define JOURNAL_FRAMES  (1638)      /* As many whole frames as fit in 8k */
+#define JOURNAL_SIZE    (JOURNAL_FRAMES * CAPTURE_FRAME_SIZE)
+
+/* Set to stop new keystrokes from being journaled, so the journal holds still
+ * while it's exported */
+extern uint8_t journal_hold;
+
+/* Appends the current capture (see pca.h) to the journal, overwriting the
+ * oldest frame once it's full */
+void journalCapture();
+
+/* Number of bytes in the journal */
+uint16_t journalLength();
+
+/* Returns byte pos of the journal (which must be less than journalLength()),
+ * counting from the start of the oldest frame */
+uint8_t journalRead(uint16_t pos);
+
+#endif // JOURNAL_H
@@ -0,0 +1,234 @@
+/* keymaps.c
+ * Final Project - Decode tables for each typewriter model. GENERATED by
+ *                 Host/keymapgen from the keymap files in Keymaps/, so edit
+ *                 those and regenerate rather than editing this by hand.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include "keystrokes.h"
+
+/* default, from Keymaps/default.km */
+const keymap_t keymap_0 =
+{
+    "default",
+    {
+        /* A side, type A/C (A positive), no shift */
+        {
+            'h', 'h', 'h',
+            'y', 'y', 'y', 'y', 'y',
+            '6', '6', '6', '6', '6',
+            'g', 'g', 'g', 'g', 'g',
+            'v', 'v', 'v', 'v', 'v',
+            '5', '5', '5', '5', '5',
+            'r', 'r', 'r', 'r', 'r',
+            'c', 'c', 'c', 'c', 'c',
+            'd', 'd', 'd', 'd', 'd',
+            'e', 'e', 'e', 'e', 'e',
+            '3', '3', '3', '3', '3',
+            's', 's', 's', 's', 's',
+            'z', 'z', 'z', 'z', 'z',
+            '2', '2', '2', '2', '2',
+            'q', 'q', 'q', 'q', 'q',
+            ' ', ' ', ' ', ' ', ' ',
+            SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
+            0, 0, 0, 0, 0,
+            TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
+            0, 0, 0, 0, 0,
+            TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
+            MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE
+        },
+        /* A side, type B (B positive), no shift */
+        {
+            'h', 'h', 'h',
+            'b', 'b', 'b', 'b', 'b',
+            '6', '6', '6', '6', '6',
+            't', 't', 't', 't', 't',
+            'v', 'v', 'v', 'v', 'v',
+            'f', 'f', 'f', 'f', 'f',
+            'r', 'r', 'r', 'r', 'r',
+            '4', '4', '4', '4', '4',
+            'd', 'd', 'd', 'd', 'd',
+            'x', 'x', 'x', 'x', 'x',
+            '3', '3', '3', '3', '3',
+            'w', 'w', 'w', 'w', 'w',
+            'z', 'z', 'z', 'z', 'z',
+            'a', 'a', 'a', 'a', 'a',
+            'q', 'q', 'q', 'q', 'q',
+            '1', '1', '1', '1', '1',
+            SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
+            0, 0, 0, 0, 0,
+            TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
+            HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE,
+            TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
+            TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE
+        },
+        /* B side, type A/C (A positive), no shift */
+        {
+            'h', 'h', 'h',
+            'n', 'n', 'n', 'n', 'n',
+            'u', 'u', 'u', 'u', 'u',
+            '8', '8', '8', '8', '8',
+            'm', 'm', 'm', 'm', 'm',
+            'k', 'k', 'k', 'k', 'k',
+            '9', '9', '9', '9', '9',
+            'o', 'o', 'o', 'o', 'o',
+            'l', 'l', 'l', 'l', 'l',
+            '.', '.', '.', '.', '.',
+            'p', 'p', 'p', 'p', 'p',
+            '-', '-', '-', '-', '-',
+            '/', '/', '/', '/', '/',
+            '\'', '\'', '\'', '\'', '\'',
+            '=', '=', '=', '=', '=',
+            SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
+            '[', '[', '[', '[', '[',
+            '\r', '\r', '\r', '\r', '\r',
+            0, 0, 0, 0, 0,
+            INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE,
+            LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
+            RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE
+        },
+        /* B side, type B (B positive), no shift */
+        {
+            'h', 'h', 'h',
+            '7', '7', '7', '7', '7',
+            'u', 'u', 'u', 'u', 'u',
+            'j', 'j', 'j', 'j', 'j',
+            'm', 'm', 'm', 'm', 'm',
+            'i', 'i', 'i', 'i', 'i',
+            '9', '9', '9', '9', '9',
+            ',', ',', ',', ',', ',',
+            'l', 'l', 'l', 'l', 'l',
+            '0', '0', '0', '0', '0',
+            'p', 'p', 'p', 'p', 'p',
+            ';', ';', ';', ';', ';',
+            '/', '/', '/', '/', '/',
+            HALF_CODE, HALF_CODE, HALF_CODE, HALF_CODE, HALF_CODE,
+            '=', '=', '=', '=', '=',
+            0, 0, 0, 0, 0,
+            '[', '[', '[', '[', '[',
+            CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
+            BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE
+        },
+        /* A side, type A/C (A positive), shift */
+        {
+            'H', 'H', 'H',
+            'Y', 'Y', 'Y', 'Y', 'Y',
+            '^', '^', '^', '^', '^',
+            'G', 'G', 'G', 'G', 'G',
+            'V', 'V', 'V', 'V', 'V',
+            '%', '%', '%', '%', '%',
+            'R', 'R', 'R', 'R', 'R',
+            'C', 'C', 'C', 'C', 'C',
+            'D', 'D', 'D', 'D', 'D',
+            'E', 'E', 'E', 'E', 'E',
+            '#', '#', '#', '#', '#',
+            'S', 'S', 'S', 'S', 'S',
+            'Z', 'Z', 'Z', 'Z', 'Z',
+            '@', '@', '@', '@', '@',
+            'Q', 'Q', 'Q', 'Q', 'Q',
+            ' ', ' ', ' ', ' ', ' ',
+            SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
+            0, 0, 0, 0, 0,
+            TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
+            0, 0, 0, 0, 0,
+            TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
+            MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE
+        },
+        /* A side, type B (B positive), shift */
+        {
+            'H', 'H', 'H',
+            'B', 'B', 'B', 'B', 'B',
+            '^', '^', '^', '^', '^',
+            'T', 'T', 'T', 'T', 'T',
+            'V', 'V', 'V', 'V', 'V',
+            'F', 'F', 'F', 'F', 'F',
+            'R', 'R', 'R', 'R', 'R',
+            '$', '$', '$', '$', '$',
+            'D', 'D', 'D', 'D', 'D',
+            'X', 'X', 'X', 'X', 'X',
+            '#', '#', '#', '#', '#',
+            'W', 'W', 'W', 'W', 'W',
+            'Z', 'Z', 'Z', 'Z', 'Z',
+            'A', 'A', 'A', 'A', 'A',
+            'Q', 'Q', 'Q', 'Q', 'Q',
+            '!', '!', '!', '!', '!',
+            SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
+            0, 0, 0, 0, 0,
+            TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
+            HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE,
+            TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
+            TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE
+        },
+        /* B side, type A/C (A positive), shift */
+        {
+            'H', 'H', 'H',
+            'N', 'N', 'N', 'N', 'N',
+            'U', 'U', 'U', 'U', 'U',
+            '*', '*', '*', '*', '*',
+            'M', 'M', 'M', 'M', 'M',
+            'K', 'K', 'K', 'K', 'K',
+            '(', '(', '(', '(', '(',
+            'O', 'O', 'O', 'O', 'O',
+            'L', 'L', 'L', 'L', 'L',
+            '>', '>', '>', '>', '>',
+            'P', 'P', 'P', 'P', 'P',
+            '_', '_', '_', '_', '_',
+            '?', '?', '?', '?', '?',
+            '"', '"', '"', '"', '"',
+            '+', '+', '+', '+', '+',
+            SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
+            ']', ']', ']', ']', ']',
+            '\r', '\r', '\r', '\r', '\r',
+            0, 0, 0, 0, 0,
+            INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE,
+            LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
+            RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE
+        },
+        /* B side, type B (B positive), shift */
+        {
+            'H', 'H', 'H',
+            '&', '&', '&', '&', '&',
+            'U', 'U', 'U', 'U', 'U',
+            'J', 'J', 'J', 'J', 'J',
+            'M', 'M', 'M', 'M', 'M',
+            'I', 'I', 'I', 'I', 'I',
+            '(', '(', '(', '(', '(',
+            '<', '<', '<', '<', '<',
+            'L', 'L', 'L', 'L', 'L',
+            ')', ')', ')', ')', ')',
+            'P', 'P', 'P', 'P', 'P',
+            ':', ':', ':', ':', ':',
+            '?', '?', '?', '?', '?',
+            QUARTER_CODE, QUARTER_CODE, QUARTER_CODE, QUARTER_CODE, QUARTER_CODE,
+            '+', '+', '+', '+', '+',
+            0, 0, 0, 0, 0,
+            ']', ']', ']', ']', ']',
+            CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
+            BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE
+        }
+    },
+    {
+        /* A side, single type C tabs */
+        {
+            0x07, 0x1F, 0x7C, 0xF0, 0xC1, 0x07, 0x1F, 0x7C, 0xF0, 0xC1, 0xFF, 0x1F, 0x7C, 0x00
+        },
+        /* B side, single type C tabs */
+        {
+            0x07, 0x1F, 0x7C, 0xF0, 0xC1, 0x07, 0x1F, 0x7C, 0xF0, 0xC1, 0x07, 0x1F, 0x7C, 0x00
+        }
+    }
+};
+
+/* See keystrokes.h */
+const keymap_t * const keymaps[] =
+{
+    &keymap_0
+};
+
+const uint8_t num_keymaps = 1;
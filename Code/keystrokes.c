@@ -1,300 +1,316 @@
 /* keystrokes.c
- * Final Project - Keystroke Interpretation Functions and LUTs. Includes
-                   special character codes defined for weird typewriter
-                   keys (using the 128-255 ASCII special character space.
+ * Final Project - Keystroke Interpretation Functions. The lookup tables
+                   themselves are per typewriter model, in keymaps.c
  * Tristan Lennertz
  *
  * SDCC Toolchain for AT89C51RC2
  */
 
 #include "keystrokes.h"
+#include "bigram.h"
 
-uint8_t interpretKeystroke(uint8_t channel_A_first,
-                           uint8_t channel_A_pol,
-                           uint16_t dTOA)
+/* See keystrokes.h */
+uint8_t bigram_enabled = 1;
+uint8_t active_keymap = 0;
+uint8_t tab_type_mismatch;
+uint16_t tab_type_mismatches;
+uint16_t tab_type_corrections;
+uint16_t context_changes;
+uint8_t drift_enabled = 1;
+DECODER_XDATA drift_bucket_t drift_buckets[2][DRIFT_MAX_BUCKETS];
+uint8_t drift_num_buckets[2];
+uint16_t drift_moves;
+
+/* Previous character returned by decodeKeystroke() for each keyboard, for
+ * context. Two people typing at once mustn't mix up each other's context */
+static uint8_t last_char[NUM_KEYBOARDS];
+
+/* Internal function declarations */
+uint8_t tabTypeKey(uint8_t flags, uint8_t type, uint16_t dTOA);
+uint8_t driftBucketOf(uint8_t side, uint8_t step);
+uint16_t driftAdjust(uint8_t flags, uint16_t dTOA);
+void driftTrack(uint8_t flags, uint16_t dTOA, uint16_t lookup);
+
+uint8_t decodeKeystroke(uint8_t flags, uint16_t dTOA)
 {
-    uint16_t lookupNdx = dTOA / 3;
+    uint8_t kb = CAPTURE_KEYBOARD(flags);
+    uint8_t type = CAPTURE_TAB_TYPE(flags);
+    uint8_t corrected = 0;
+    uint16_t raw = dTOA;
+    uint16_t lookup, step;
+    uint8_t key;
 
-    if (N_SHIFT_KEY)            /* Shift key not pressed (active low signal) */
+    tab_type_mismatch = 0;
+
+    if (drift_enabled)
+        dTOA = driftAdjust(flags, dTOA);
+
+    /* A polarity pair that doesn't fit the bucket is most likely a deltaTOA that
+     * landed across an edge from the right one, so the nearest bucket either way
+     * that does fit is taken instead. When the same distance either way fits, the
+     * tab type can't tell the two apart and context picks. Past the end of the
+     * tables there's no bucket to check against */
+    if (dTOA < MAX_DELTA_TOA && type != expectedTabType(flags, dTOA))
     {
-        if (channel_A_first)
+        for (step = BIGRAM_MARGIN; type != TAB_TYPE_NONE && step <= TAB_TYPE_REACH;
+             step += BIGRAM_MARGIN)
         {
-            if (channel_A_pol)  /* TAB TYPE A or C */
+            uint8_t up = tabTypeKey(flags, type, dTOA + step);
+            uint8_t down = (dTOA >= step) ? tabTypeKey(flags, type, dTOA - step) : 0;
+
+            if (up && down && up != down && bigram_enabled &&
+                bigramScore(last_char[kb], down) > bigramScore(last_char[kb], up))
             {
-                return ASide_APositive_NoShift[lookupNdx];
+                up = 0;
+                context_changes++;
             }
-            else                /* Infer TAB TYPE B */
+
+            if (up || down)
             {
-                return ASide_BPositive_NoShift[lookupNdx];
+                dTOA = up ? dTOA + step : dTOA - step;
+                corrected = 1;
+                break;
             }
         }
-        else
+
+        if (!corrected)
         {
-            if (channel_A_pol)  /* TAB TYPE A or C */
-            {
-                return BSide_APositive_NoShift[lookupNdx];
-            }
-            else                /* Infer TAB TYPE B */
-            {
-                return BSide_BPositive_NoShift[lookupNdx];
-            }
-       }
+            tab_type_mismatch = 1;
+            tab_type_mismatches++;
+        }
+
+        tab_type_corrections += corrected;
     }
-    else    /* Shift key pressed. Use uppercase tables */
+
+    key = interpretKeystroke(flags, dTOA);
+    lookup = dTOA;
+
+    /* A capture moved by its tab type is already across the edge */
+    if (bigram_enabled && key && !corrected)
     {
-        if (channel_A_first)
+        uint16_t below = (dTOA >= BIGRAM_MARGIN) ? dTOA - BIGRAM_MARGIN : dTOA;
+        uint16_t across;
+        uint8_t neighbor;
+
+        /* Buckets are wider than twice the margin, so at most one side differs */
+        across = (interpretKeystroke(flags, below) != key) ? below : dTOA + BIGRAM_MARGIN;
+        neighbor = interpretKeystroke(flags, across);
+
+        /* Context never outvotes the polarities, unless they were no help anyway */
+        if (neighbor && neighbor != key &&
+            (tab_type_mismatch || type == expectedTabType(flags, across)) &&
+            bigramScore(last_char[kb], neighbor) > bigramScore(last_char[kb], key))
         {
-            if (channel_A_pol)  /* TAB TYPE A or C */
-            {
-                return ASide_APositive_Shift[lookupNdx];
-            }
-            else                /* Infer TAB TYPE B */
-            {
-                return ASide_BPositive_Shift[lookupNdx];
-            }
+            key = neighbor;
+            lookup = across;
+            context_changes++;
         }
-        else
+    }
+
+    if (drift_enabled && key && !tab_type_mismatch)
+        driftTrack(flags, raw, lookup);
+
+    last_char[kb] = key;
+
+    return key;
+}
+
+uint8_t interpretKeystroke(uint8_t flags, uint16_t dTOA)
+{
+    uint16_t lookupNdx = dTOA / 3;
+
+    /* Don't index off the end of the tables on a bad read */
+    if (lookupNdx >= KEYSTROKE_LUT_SIZE)
+        return 0;
+
+    return keymaps[active_keymap]->tables[KEYMAP_TABLE(flags)][lookupNdx];
+}
+
+uint8_t expectedTabType(uint8_t flags, uint16_t dTOA)
+{
+    uint16_t lookupNdx = dTOA / 3;
+    uint8_t side = (flags & CAPTURE_FLAG_A_FIRST) ? 0 : 1;
+
+    if (lookupNdx >= KEYSTROKE_LUT_SIZE)
+        return TAB_TYPE_NONE;
+
+    if (keymaps[active_keymap]->single_tab[side][lookupNdx / 8] & (1 << (lookupNdx % 8)))
+        return TAB_TYPE_C;
+
+    return (flags & CAPTURE_FLAG_A_POS) ? TAB_TYPE_A : TAB_TYPE_B;
+}
+
+/* Key at dTOA, or 0 if there's none or its bucket doesn't fit the tab type */
+uint8_t tabTypeKey(uint8_t flags, uint8_t type, uint16_t dTOA)
+{
+    if (type != expectedTabType(flags, dTOA))
+        return 0;
+
+    return interpretKeystroke(flags, dTOA);
+}
+
+void driftReset()
+{
+    const keymap_t *km = keymaps[active_keymap];
+    uint8_t side, step, t, n;
+
+    for (side = 0; side < 2; side++)
+    {
+        n = 0;
+
+        for (step = 0; step < KEYSTROKE_LUT_SIZE; step++)
         {
-            if (channel_A_pol)  /* TAB TYPE A or C */
+            uint8_t edge = (step == 0);
+
+            /* A new bucket starts wherever any of the side's four tables, or
+             * the tab type, changes */
+            if (step)
+            {
+                for (t = 0; t < 4; t++)
+                {
+                    uint8_t table = ((t & 2) ? 4 : 0) | (side * 2) | (t & 1);
+
+                    if (km->tables[table][step] != km->tables[table][step - 1])
+                        edge = 1;
+                }
+
+                if (((km->single_tab[side][step / 8] >> (step % 8)) ^
+                     (km->single_tab[side][(step - 1) / 8] >> ((step - 1) % 8))) & 1)
+                    edge = 1;
+            }
+
+            if (edge && n == DRIFT_MAX_BUCKETS)
             {
-                return BSide_APositive_Shift[lookupNdx];
+                /* Too many to track, so the side goes untracked */
+                n = 0;
+                break;
             }
-            else                /* Infer TAB TYPE B */
+
+            if (edge)
             {
-                return BSide_BPositive_Shift[lookupNdx];
+                drift_buckets[side][n].start = step;
+                drift_buckets[side][n].samples = 0;
+                drift_buckets[side][n].mean = 0;
+                n++;
             }
-       }
+        }
+
+        drift_num_buckets[side] = n;
     }
+
+    drift_moves = 0;
 }
 
-/* Keys with tabs on channel A's side of the acoustic bar, with initial positive
- * cycle on channel A's wavefront, with no shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t ASide_APositive_NoShift[] =
-{
-    'h', 'h', 'h', 'y',
-    'y', 'y', 'y', 'y',
-    '6', '6', '6', '6', '6',
-    'g', 'g', 'g', 'g', 'g',
-    'v', 'v', 'v', 'v', 'v',
-    '5', '5', '5', '5', '5',
-    'r', 'r', 'r', 'r', 'r',
-    'c', 'c', 'c', 'c', 'c',
-    'd', 'd', 'd', 'd', 'd',
-    'e', 'e', 'e', 'e', 'e',
-    '3', '3', '3', '3', '3',
-    's', 's', 's', 's', 's',
-    'z', 'z', 'z', 'z', 'z',
-    '2', '2', '2', '2', '2',
-    'q', 'q', 'q', 'q', 'q',
-    ' ', ' ', ' ', ' ', ' ',
-    SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
-    0, 0, 0, 0, 0,
-    TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
-    0, 0, 0, 0, 0,
-    TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
-    MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE
-};
-
-/* Keys with tabs on channel A's side of the acoustic bar, with initial positive
- * cycle on channel A's wavefront, with shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t ASide_APositive_Shift[] =
-{
-    'H', 'H', 'H', 'Y',
-    'Y', 'Y', 'Y', 'Y',
-    '^', '^', '^', '^', '^',
-    'G', 'G', 'G', 'G', 'G',
-    'V', 'V', 'V', 'V', 'V',
-    '%', '%', '%', '%', '%',
-    'R', 'R', 'R', 'R', 'R',
-    'C', 'C', 'C', 'C', 'C',
-    'D', 'D', 'D', 'D', 'D',
-    'E', 'E', 'E', 'E', 'E',
-    '#', '#', '#', '#', '#',
-    'S', 'S', 'S', 'S', 'S',
-    'Z', 'Z', 'Z', 'Z', 'Z',
-    '@', '@', '@', '@', '@',
-    'Q', 'Q', 'Q', 'Q', 'Q',
-    ' ', ' ', ' ', ' ', ' ',
-    SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
-    0, 0, 0, 0, 0,
-    TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
-    0, 0, 0, 0, 0,
-    TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
-    MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE, MARGIN_RELEASE_CODE
-};
-
-/* Keys with tabs on channel A's side of the acoustic bar, with initial positive
- * cycle on channel B's wavefront, with no shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t ASide_BPositive_NoShift[] =
+int8_t driftEdgeShift(uint8_t side, uint8_t bucket)
 {
-    'h', 'h', 'h', 'b',
-    'b', 'b', 'b', 'b',
-    '6', '6', '6', '6', '6',
-    't', 't', 't', 't', 't',
-    'v', 'v', 'v', 'v', 'v',
-    'f', 'f', 'f', 'f', 'f',
-    'r', 'r', 'r', 'r', 'r',
-    '4', '4', '4', '4', '4',
-    'd', 'd', 'd', 'd', 'd',
-    'x', 'x', 'x', 'x', 'x',
-    '3', '3', '3', '3', '3',
-    'w', 'w', 'w', 'w', 'w',
-    'z', 'z', 'z', 'z', 'z',
-    'a', 'a', 'a', 'a', 'a',
-    'q', 'q', 'q', 'q', 'q',
-    '1', '1', '1', '1', '1',
-    SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
-    0, 0, 0, 0, 0,
-    TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
-    HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE,
-    TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
-    TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE
-};
-
-/* Keys with tabs on channel A's side of the acoustic bar, with initial positive
- * cycle on channel B's wavefront, with shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t ASide_BPositive_Shift[] =
-{
-    'H', 'H', 'H', 'B',
-    'B', 'B', 'B', 'B',
-    '^', '^', '^', '^', '^',
-    'T', 'T', 'T', 'T', 'T',
-    'V', 'V', 'V', 'V', 'V',
-    'F', 'F', 'F', 'F', 'F',
-    'R', 'R', 'R', 'R', 'R',
-    '$', '$', '$', '$', '$',
-    'D', 'D', 'D', 'D', 'D',
-    'X', 'X', 'X', 'X', 'X',
-    '#', '#', '#', '#', '#',
-    'W', 'W', 'W', 'W', 'W',
-    'Z', 'Z', 'Z', 'Z', 'Z',
-    'A', 'A', 'A', 'A', 'A',
-    'Q', 'Q', 'Q', 'Q', 'Q',
-    '!', '!', '!', '!', '!',
-    SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
-    0, 0, 0, 0, 0,
-    TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE, TAB_CODE,
-    HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE, HALF_SPACE_CODE,
-    TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE, TAB_SET_CODE,
-    TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE, TAB_CLEAR_CODE
-};
-
-/* Keys with tabs on channel B's side of the acoustic bar, with initial positive
- * cycle on channel A's wavefront, with no shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t BSide_APositive_NoShift[] =
-{
-    'h', 'h', 'h', 'n',
-    'n', 'n', 'n', 'n',
-    'u', 'u', 'u', 'u', 'u',
-    '8', '8', '8', '8', '8',
-    'm', 'm', 'm', 'm', 'm',
-    'k', 'k', 'k', 'k', 'k',
-    '9', '9', '9', '9', '9',
-    'o', 'o', 'o', 'o', 'o',
-    'l', 'l', 'l', 'l', 'l',
-    '.', '.', '.', '.', '.',
-    'p', 'p', 'p', 'p', 'p',
-    '-', '-', '-', '-', '-',
-    '/', '/', '/', '/', '/',
-    '\'', '\'', '\'', '\'', '\'',
-    '=', '=', '=', '=', '=',
-    SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
-    '[', '[', '[', '[', '[',
-    '\r', '\r', '\r', '\r', '\r',
-    0, 0, 0, 0, 0,
-    INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE,
-    LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
-    RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE
-};
-
-/* Keys with tabs on channel B's side of the acoustic bar, with initial positive
- * cycle on channel A's wavefront, with shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t BSide_APositive_Shift[] =
+    DECODER_XDATA drift_bucket_t *lo, *hi;
+    int16_t mean_lo, mean_hi, shift;
+
+    if (bucket == 0 || bucket >= drift_num_buckets[side])
+        return 0;
+
+    lo = &drift_buckets[side][bucket - 1];
+    hi = &drift_buckets[side][bucket];
+
+    /* A bucket that hasn't seen enough keystrokes yet is taken to have drifted
+     * the same as its neighbour */
+    if (lo->samples >= DRIFT_MIN_SAMPLES)
+        mean_lo = lo->mean;
+    else if (hi->samples >= DRIFT_MIN_SAMPLES)
+        mean_lo = hi->mean;
+    else
+        return 0;
+
+    mean_hi = (hi->samples >= DRIFT_MIN_SAMPLES) ? hi->mean : mean_lo;
+
+    /* Average of the two, rounded to the nearest tick */
+    shift = ((mean_lo >> 1) + (mean_hi >> 1) + DRIFT_ONE / 2) >> DRIFT_FRAC_BITS;
+
+    if (shift > DRIFT_LIMIT)
+        return DRIFT_LIMIT;
+    if (shift < -DRIFT_LIMIT)
+        return -DRIFT_LIMIT;
+
+    return shift;
+}
+
+/* Returns the bucket a lookup step on a side falls in */
+uint8_t driftBucketOf(uint8_t side, uint8_t step)
 {
-    'H', 'H', 'H', 'H',
-    'N', 'N', 'N', 'N',
-    'U', 'U', 'U', 'U', 'U',
-    '*', '*', '*', '*', '*',
-    'M', 'M', 'M', 'M', 'M',
-    'K', 'K', 'K', 'K', 'K',
-    '(', '(', '(', '(', '(',
-    'O', 'O', 'O', 'O', 'O',
-    'L', 'L', 'L', 'L', 'L',
-    '>', '>', '>', '>', '>',
-    'P', 'P', 'P', 'P', 'P',
-    '_', '_', '_', '_', '_',
-    '?', '?', '?', '?', '?',
-    '"', '"', '"', '"', '"',
-    '+', '+', '+', '+', '+',
-    SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE, SHIFT_CODE,
-    ']', ']', ']', ']', ']',
-    '\r', '\r', '\r', '\r', '\r',
-    0, 0, 0, 0, 0,
-    INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE, INDEX_CODE,
-    LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
-    RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE, RIGHT_MARGIN_CODE
-};
-
-/* Keys with tabs on channel B's side of the acoustic bar, with initial positive
- * cycle on channel B's wavefront, with no shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t BSide_BPositive_NoShift[] =
+    uint8_t lo = 0;
+    uint8_t hi = drift_num_buckets[side] - 1;
+
+    /* Last bucket starting at or before the step */
+    while (lo < hi)
+    {
+        uint8_t mid = (lo + hi + 1) / 2;
+
+        if (drift_buckets[side][mid].start <= step)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+/* Moves a capture's deltaTOA by as much as the nearer edge of its bucket has
+ * moved, so that the tables compare it against the moved edge */
+uint16_t driftAdjust(uint8_t flags, uint16_t dTOA)
 {
-    'h', 'h', 'h', '7',
-    '7', '7', '7', '7',
-    'u', 'u', 'u', 'u', 'u',
-    'j', 'j', 'j', 'j', 'j',
-    'm', 'm', 'm', 'm', 'm',
-    'i', 'i', 'i', 'i', 'i',
-    '9', '9', '9', '9', '9',
-    ',', ',', ',', ',', ',',
-    'l', 'l', 'l', 'l', 'l',
-    '0', '0', '0', '0', '0',
-    'p', 'p', 'p', 'p', 'p',
-    ';', ';', ';', ';', ';',
-    '/', '/', '/', '/', '/',
-    HALF_CODE, HALF_CODE, HALF_CODE, HALF_CODE, HALF_CODE,
-    '=', '=', '=', '=', '=',
-    0, 0, 0, 0, 0,
-    '[', '[', '[', '[', '[',
-    CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE,
-    0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0,
-    LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
-    BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE
-};
-
-/* Keys with tabs on channel B's side of the acoustic bar, with initial positive
- * cycle on channel B's wavefront, with shift pressed. Difference in time of
- * arrival converted to index of this table */
-const uint8_t BSide_BPositive_Shift[] =
+    uint8_t side = (flags & CAPTURE_FLAG_A_FIRST) ? 0 : 1;
+    uint16_t lower, upper;
+    uint8_t bucket;
+    int8_t shift;
+
+    if (dTOA >= MAX_DELTA_TOA || !drift_num_buckets[side])
+        return dTOA;
+
+    bucket = driftBucketOf(side, dTOA / 3);
+    lower = drift_buckets[side][bucket].start * 3;
+    upper = (bucket + 1 < drift_num_buckets[side]) ?
+            drift_buckets[side][bucket + 1].start * 3 : MAX_DELTA_TOA;
+
+    if (dTOA - lower < upper - dTOA)
+        shift = driftEdgeShift(side, bucket);
+    else
+        shift = driftEdgeShift(side, bucket + 1);
+
+    if (shift > 0 && dTOA < (uint16_t)shift)
+        dTOA = 0;
+    else
+        dTOA -= shift;
+
+    if (dTOA < lower || dTOA >= upper)
+        drift_moves++;
+
+    return dTOA;
+}
+
+/* Folds a decoded capture's deltaTOA into the mean of the bucket it was decoded
+ * in (the bucket lookup falls in) */
+void driftTrack(uint8_t flags, uint16_t dTOA, uint16_t lookup)
 {
-    'H', 'H', 'H', '&',
-    '&', '&', '&', '&',
-    'U', 'U', 'U', 'U', 'U',
-    'J', 'J', 'J', 'J', 'J',
-    'M', 'M', 'M', 'M', 'M',
-    'I', 'I', 'I', 'I', 'I',
-    '(', '(', '(', '(', '(',
-    '<', '<', '<', '<', '<',
-    'L', 'L', 'L', 'L', 'L',
-    ')', ')', ')', ')', ')',
-    'P', 'P', 'P', 'P', 'P',
-    ':', ':', ':', ':', ':',
-    '?', '?', '?', '?', '?',
-    QUARTER_CODE, QUARTER_CODE, QUARTER_CODE, QUARTER_CODE, QUARTER_CODE,
-    '+', '+', '+', '+', '+',
-    0, 0, 0, 0, 0,
-    ']', ']', ']', ']', ']',
-    CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE, CORRECT_CODE,
-    0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0,
-    LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE, LEFT_MARGIN_CODE,
-    BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE, BACKSPACE_CODE
-};
+    uint8_t side = (flags & CAPTURE_FLAG_A_FIRST) ? 0 : 1;
+    DECODER_XDATA drift_bucket_t *b;
+    uint8_t bucket, end;
+    int16_t error;
+
+    if (lookup >= MAX_DELTA_TOA || !drift_num_buckets[side])
+        return;
+
+    bucket = driftBucketOf(side, lookup / 3);
+    b = &drift_buckets[side][bucket];
+    end = (bucket + 1 < drift_num_buckets[side]) ?
+          drift_buckets[side][bucket + 1].start : KEYSTROKE_LUT_SIZE;
+
+    /* In half ticks, from the middle of the bucket's ticks. The capture is within
+     * a bucket or so of lookup, so this can't overflow */
+    error = (int16_t)(dTOA * 2) - (int16_t)((b->start + end) * 3 - 1);
+    error *= DRIFT_ONE / 2;
+
+    b->mean += (error - b->mean) >> DRIFT_SHIFT;
+
+    if (b->samples < 255)
+        b->samples++;
+}
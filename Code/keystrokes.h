@@ -1,5 +1,5 @@
 /* keystrokes.h
- * Final Project - Keystroke Interpretation Functions and LUTs. Includes
+ * Final Project - Keystroke Interpretation Functions and keymaps. Includes
                    special character codes defined for weird typewriter
                    keys (using the 128-255 ASCII special character space.
  * Tristan Lennertz
@@ -10,13 +10,12 @@
 #ifndef KEYSTROKES_H
 #define KEYSTROKES_H
 
-#include <at89c51ed2.h>
-#include <mcs51reg.h>
 #include <stdint.h>
 
-/* Active-low signal indicating the CAPSLOCK or SHIFT keys are depressed on
- * the keyboard. These keys close a physical switch that pulls the pin low */
-#define N_SHIFT_KEY (P3_2)
+/* The decode tables are shared with the host tools (see Host/), so nothing in
+ * here may touch the MCU's registers. Captures are described with the
+ * CAPTURE_FLAG_* bits from the raw capture frame */
+#include "frames.h"
 
 #define LEFT_MARGIN_CODE ('\r') /* Set to be a carriage return */
 #define RIGHT_MARGIN_CODE (12)  /* Set to be a form feed */
@@ -33,23 +32,167 @@
 #define QUARTER_CODE (172)      /* 1/4 symbol */
 #define CORRECT_CODE (0x7F)     /* Set to be the delete key */
 
+/* Number of entries in each of the keymap lookup tables below. Time differences
+ * that index past the end of the tables decode as 0 (no key) */
+#define KEYSTROKE_LUT_SIZE (108)
+
+/* Longest time between a strike's wavefront detect and its coincidence that can
+ * still decode to a key, in PCA ticks (the lookup tables are indexed by ticks / 3) */
+#define MAX_DELTA_TOA (KEYSTROKE_LUT_SIZE * 3)
+
 /* Utilizes the keystroke lookup tables and all of the encoding
  * information collected during the keystroke detection cycle in
- * order to determine and return the character pressed on the keyboard */
-uint8_t interpretKeystroke(uint8_t channel_A_first,
-                           uint8_t channel_A_pol,
-                           uint16_t dTOA);
-
-/* All of the lookup tables, split by side of the keyboard and tab types.
- * Implement rounding with the indexes in order to allow for timing error */
-extern const uint8_t ASide_APositive_NoShift[];
-extern const uint8_t ASide_BPositive_NoShift[];
-extern const uint8_t BSide_APositive_NoShift[];
-extern const uint8_t BSide_BPositive_NoShift[];
-extern const uint8_t ASide_APositive_Shift[];
-extern const uint8_t ASide_BPositive_Shift[];
-extern const uint8_t BSide_APositive_Shift[];
-extern const uint8_t BSide_BPositive_Shift[];
+ * order to determine and return the character pressed on the keyboard.
+ * A pure function of the capture record (CAPTURE_FLAG_* bits and deltaTOA),
+ * so it gives the same result whenever and wherever it is called */
+uint8_t interpretKeystroke(uint8_t flags, uint16_t dTOA);
+
+/* How close (in PCA ticks of deltaTOA) a capture has to be to the edge of a
+ * table bucket for the context stage to consider the key on the other side */
+#define BIGRAM_MARGIN (3)
+
+/* Furthest (in PCA ticks of deltaTOA) decodeKeystroke() looks for a bucket that
+ * matches a capture's tab type */
+#define TAB_TYPE_REACH (3 * BIGRAM_MARGIN)
+
+/* Set to run captures through the context stage in decodeKeystroke() */
+extern uint8_t bigram_enabled;
+
+/* Captures decodeKeystroke() has decoded to a different key than it would have
+ * without the context stage */
+extern uint16_t context_changes;
+
+/* interpretKeystroke() plus drift tracking (below), a tab type check and a
+ * context stage. A capture whose tab type (below) doesn't match its bucket's is
+ * a bad read. The nearest bucket within TAB_TYPE_REACH, in steps of
+ * BIGRAM_MARGIN, that does match is taken instead, and otherwise the capture is
+ * flagged in tab_type_mismatch. The tab type rules out far more than context
+ * can, so context (see bigram.h) only decides what it can't: between matching
+ * buckets the same distance either side, and, when the capture is within
+ * BIGRAM_MARGIN of an edge, whether the key on the other side (if its tab type
+ * is the same, or the capture's was no help) is a more likely follow-on to the
+ * previously decoded character. Fixed cost of at most seventeen lookups and two
+ * scores, no matter the input (the lookup stage of a PERF_PROBES build, see
+ * perf.h, times it on the part). Keeps the previous character of each keyboard
+ * as state, so every decoded keystroke should go through here in order */
+uint8_t decodeKeystroke(uint8_t flags, uint16_t dTOA);
+
+/* Tab types of the acoustic bar, told apart by the polarity pair of a strike's
+ * wavefronts. A and B tabs come in pairs that share a deltaTOA, and C tabs stand
+ * alone. No tab starts both channels negative, so a capture that does is a bad
+ * read (TAB_TYPE_NONE) */
+#define TAB_TYPE_A      (0)     /* Channel A positive, channel B negative */
+#define TAB_TYPE_B      (1)     /* Channel B positive, channel A negative */
+#define TAB_TYPE_C      (2)     /* Both positive */
+#define TAB_TYPE_NONE   (3)     /* Both negative */
+
+/* Tab type a capture's polarity pair says it came from */
+#define CAPTURE_TAB_TYPE(flags) (((flags) & CAPTURE_FLAG_A_POS) ? \
+                                 (((flags) & CAPTURE_FLAG_B_POS) ? TAB_TYPE_C : TAB_TYPE_A) : \
+                                 (((flags) & CAPTURE_FLAG_B_POS) ? TAB_TYPE_B : TAB_TYPE_NONE))
+
+/* Tab type the active keymap has at the capture's bucket: TAB_TYPE_C for a
+ * single tab, or else whichever of the pair the capture's table is for.
+ * TAB_TYPE_NONE past the end of the tables */
+uint8_t expectedTabType(uint8_t flags, uint16_t dTOA);
+
+/* Acoustic timing drifts as the typewriter warms up, which slowly moves every
+ * key's deltaTOA away from the middle of its bucket. With drift tracking on,
+ * decodeKeystroke() keeps an exponentially weighted mean, per bucket, of how far
+ * the captures it decodes land from the bucket's middle, and moves each bucket
+ * edge by the average drift of the buckets either side of it (up to
+ * DRIFT_LIMIT). Captures are compared against the moved edges before anything
+ * else. Fixed cost per keystroke: a short search for the bucket, and a few
+ * additions and shifts. Captures that are flagged in tab_type_mismatch or don't
+ * decode to a key aren't tracked */
+#define DRIFT_FRAC_BITS     (8)     /* Means are kept in 1/256ths of a PCA tick */
+#define DRIFT_ONE           (1 << DRIFT_FRAC_BITS)
+#define DRIFT_SHIFT         (5)     /* Each keystroke moves its bucket's mean 1/32 of the way */
+#define DRIFT_MIN_SAMPLES   (8)     /* Keystrokes a bucket needs before it moves its edges */
+#define DRIFT_LIMIT         (4)     /* Furthest a bucket edge can move, in PCA ticks */
+
+/* Most buckets tracked on each side of the keyboard. A side of a keymap with
+ * more is decoded as usual, but not tracked */
+#define DRIFT_MAX_BUCKETS   (24)
+
+/* The decoder is built into the host tools as well, so its larger state is only
+ * put in external data memory when built for the MCU */
+#if defined(SDCC) || defined(__SDCC)
+#define DECODER_XDATA __xdata
+#else
+#define DECODER_XDATA
+#endif
+
+/* A run of lookup steps on one side that decode the same in every table, and
+ * how far off its middle the keystrokes decoded in it have been landing */
+typedef struct
+{
+    uint8_t start;      /* First lookup step */
+    uint8_t samples;    /* Keystrokes tracked, saturating at 255 */
+    int16_t mean;       /* Weighted mean of deltaTOA less the middle, DRIFT_ONE per tick */
+} drift_bucket_t;
+
+/* Set to track drift and decode against the moved edges */
+extern uint8_t drift_enabled;
+
+/* Buckets of the active keymap for each side (A first, then B), set up by
+ * driftReset() */
+extern DECODER_XDATA drift_bucket_t drift_buckets[2][DRIFT_MAX_BUCKETS];
+extern uint8_t drift_num_buckets[2];
+
+/* Captures decodeKeystroke() has decoded in a different bucket than the keymap
+ * has them in, because an edge had moved */
+extern uint16_t drift_moves;
+
+/* Finds the buckets of the active keymap and forgets all drift tracked so far.
+ * Must be called whenever active_keymap changes */
+void driftReset();
+
+/* PCA ticks the lower edge of a bucket has been moved by (0 for the first) */
+int8_t driftEdgeShift(uint8_t side, uint8_t bucket);
+
+/* Set by decodeKeystroke() if the capture it last decoded didn't match its
+ * bucket's tab type, and no bucket within TAB_TYPE_REACH did either */
+extern uint8_t tab_type_mismatch;
+
+/* Captures decodeKeystroke() has flagged in tab_type_mismatch, and captures it
+ * moved into a nearby bucket that matched their tab type */
+extern uint16_t tab_type_mismatches;
+extern uint16_t tab_type_corrections;
+
+/* Lookup tables in a keymap, one for each combination of the side of the
+ * keyboard the tab is on, the tab type (which channel is initially positive)
+ * and shift. Implement rounding with the indexes in order to allow for timing
+ * error */
+#define KEYMAP_NUM_TABLES (8)
+
+/* Table in a keymap to decode a capture with, from its CAPTURE_FLAG_* bits */
+#define KEYMAP_TABLE(flags) ((((flags) & CAPTURE_FLAG_SHIFT) ? 4 : 0) | \
+                             (((flags) & CAPTURE_FLAG_A_FIRST) ? 0 : 2) | \
+                             (((flags) & CAPTURE_FLAG_A_POS) ? 0 : 1))
+
+#define KEYMAP_NAME_SIZE (12)
+
+/* Bytes for a bit per lookup step on one side of the keyboard */
+#define KEYMAP_SIDE_BYTES ((KEYSTROKE_LUT_SIZE + 7) / 8)
+
+/* Everything needed to decode one typewriter model's keyboard. single_tab has a
+ * bit per lookup step for each side (A first, then B), set where the bucket is a
+ * single type C tab rather than a pair of type A and B tabs */
+typedef struct
+{
+    char name[KEYMAP_NAME_SIZE];
+    uint8_t tables[KEYMAP_NUM_TABLES][KEYSTROKE_LUT_SIZE];
+    uint8_t single_tab[2][KEYMAP_SIDE_BYTES];
+} keymap_t;
+
+/* Every model built in, generated into keymaps.c from the keymap files in
+ * Keymaps/ by Host/keymapgen */
+extern const keymap_t * const keymaps[];
+extern const uint8_t num_keymaps;
+
+/* Index into keymaps[] of the model captures are decoded with */
+extern uint8_t active_keymap;
 
 #endif // KEYSTROKES_H
 
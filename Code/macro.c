@@ -0,0 +1,195 @@
+/* macro.c
+ * Final Project - Abbreviation Expansion. The trie is walked a key at a time as
+ *                 keys are handed on to the mode (not as they're typed), so words
+ *                 typed ahead while an expansion is going out are still matched in
+ *                 order. Expansions are read straight out of code memory.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+
+#include <stdint.h>
+
+#include "macro.h"
+#include "serial.h"
+#include "keystrokes.h"
+
+/* Room needed in the transmit buffer before a key is handed on, so its echo (or
+ * the editor's update of the line) doesn't have to wait */
+#define MACRO_TX_ROOM   (TX_BUFFER_SIZE / 4)
+
+/* Offset of the trie's root node */
+#define MACRO_ROOT      (0)
+
+/* See macro.h */
+uint8_t macros_enabled;
+uint8_t macro_expanded;
+uint8_t macro_overruns;
+
+/* Typed keys not yet handed on. Head is moved by macroKeystroke() and tail by
+ * macroNext() */
+static __xdata uint8_t queue[MACRO_QUEUE_SIZE];
+static uint8_t queue_head;
+static uint8_t queue_tail;
+
+/* Node the word so far leads to, or MACRO_NONE once it can't be an abbreviation,
+ * and how many characters into the word it is */
+static uint16_t node;
+static uint8_t depth;
+
+/* Expansion going out: <CORRECT>s left to send, the rest of its text (NULL when
+ * there's none), and the key that ended the abbreviation, which goes out after */
+static uint8_t erase_left;
+static const char *expansion;
+static uint8_t end_key;
+static uint8_t end_key_pending;
+
+/* Internal function declarations */
+uint8_t macroMatch(uint8_t key);
+uint16_t macroChild(uint16_t parent, uint8_t key);
+
+void init_macro()
+{
+    queue_head = queue_tail = 0;
+    node = MACRO_ROOT;
+    depth = 0;
+    erase_left = 0;
+    expansion = 0;
+    end_key_pending = 0;
+    macro_expanded = 0;
+}
+
+void macroKeystroke(uint8_t key)
+{
+    uint8_t next_head = (queue_head + 1) & (MACRO_QUEUE_SIZE - 1);
+
+    if (next_head == queue_tail)
+    {
+        macro_overruns++;
+        return;
+    }
+
+    queue[queue_head] = key;
+    queue_head = next_head;
+}
+
+uint8_t macroReady()
+{
+    return ((erase_left || expansion || end_key_pending || queue_head != queue_tail) &&
+            txFree() >= MACRO_TX_ROOM);
+}
+
+uint8_t macroNext()
+{
+    uint8_t key;
+
+    if (erase_left)
+    {
+        erase_left--;
+        macro_expanded = 1;
+        return CORRECT_CODE;
+    }
+
+    if (expansion)
+    {
+        key = *expansion++;
+        if (!*expansion)
+            expansion = 0;
+
+        macro_expanded = 1;
+        return key;
+    }
+
+    if (end_key_pending)
+    {
+        end_key_pending = 0;
+        macro_expanded = 0;
+        return end_key;
+    }
+
+    key = queue[queue_tail];
+    queue_tail = (queue_tail + 1) & (MACRO_QUEUE_SIZE - 1);
+
+    /* Hold back the key ending an abbreviation until the expansion is out */
+    if (macros_enabled && macroMatch(key))
+    {
+        end_key = key;
+        end_key_pending = 1;
+        erase_left--;
+        macro_expanded = 1;
+        return CORRECT_CODE;
+    }
+
+    macro_expanded = 0;
+    return key;
+}
+
+/* Takes the next typed key down the trie. Returns true if it ended a word that's
+ * an abbreviation, having set up its expansion to go out */
+uint8_t macroMatch(uint8_t key)
+{
+    uint16_t text;
+
+    /* Shift comes in as a key of its own, and isn't part of the word */
+    if (key == SHIFT_CODE)
+        return 0;
+
+    if (key == ' ' || key == '\r' || key == TAB_CODE)
+    {
+        uint16_t ended = node;
+        uint8_t ended_depth = depth;
+
+        node = MACRO_ROOT;
+        depth = 0;
+
+        if (ended == MACRO_NONE || ended_depth == 0)
+            return 0;
+
+        text = (macro_trie[ended + 1] << 8) | macro_trie[ended + 2];
+        if (text == MACRO_NONE)
+            return 0;
+
+        erase_left = ended_depth;
+        expansion = &macro_text[text];
+        return 1;
+    }
+
+    /* Anything else that isn't printable (<CORRECT>, <INDEX>, etc.) moves off of
+     * the word, so it can't be an abbreviation any more */
+    if (node != MACRO_NONE)
+    {
+        if (key > ' ' && key < 0x7F && depth < MACRO_MAX_ABBREV)
+        {
+            node = macroChild(node, key);
+            depth++;
+        }
+        else
+        {
+            node = MACRO_NONE;
+        }
+    }
+
+    return 0;
+}
+
+/* Returns the child of the passed node along key, or MACRO_NONE */
+uint16_t macroChild(uint16_t parent, uint8_t key)
+{
+    const uint8_t *edge = &macro_trie[parent + MACRO_NODE_SIZE];
+    uint8_t children = macro_trie[parent];
+
+    for (; children; children--, edge += MACRO_EDGE_SIZE)
+    {
+        if (edge[0] == key)
+            return (edge[1] << 8) | edge[2];
+
+        /* Edges are sorted, so it's not coming */
+        if (edge[0] > key)
+            break;
+    }
+
+    return MACRO_NONE;
+}
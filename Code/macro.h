@@ -0,0 +1,69 @@
+/* macro.h
+ * Final Project - Abbreviation Expansion. Sits between the typewriter and the
+ *                 normal and editor modes. Each word typed is walked down a trie
+ *                 of abbreviations in code memory as it's typed, a step per key,
+ *                 so nothing more than the node it's got to is kept. When a word
+ *                 that's an abbreviation is ended with a space, return or tab, it's
+ *                 taken back out (a <CORRECT> per character) and its expansion is
+ *                 streamed out in its place, a key per pass of the main loop.
+ *
+ *                 The abbreviations live in the macro files in Macros/, which
+ *                 Host/macrogen turns into the trie in macros.c, so adding one is
+ *                 just a matter of regenerating that.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdint.h>
+
+/* The trie is shared with Host/macrogen, so nothing in here may touch the MCU.
+ * It's a flat array of nodes, the root first. Each node is:
+ *   <number of children> <expansion hi> <expansion lo>
+ * followed by an edge per child, sorted by key:
+ *   <key> <child hi> <child lo>
+ * where the expansion is an offset into macro_text[] (of a null terminated
+ * string) or MACRO_NONE, and the child is the offset of its node in the trie */
+#define MACRO_NODE_SIZE     (3)
+#define MACRO_EDGE_SIZE     (3)
+#define MACRO_NONE          (0xFFFF)
+
+/* Longest abbreviation, which bounds how much is taken back out */
+#define MACRO_MAX_ABBREV    (16)
+
+/* Keys typed while an expansion is still going out wait here. Must be a power of 2 */
+#define MACRO_QUEUE_SIZE    (16)
+
+/* Generated into macros.c by Host/macrogen */
+extern const uint8_t macro_trie[];
+extern const char macro_text[];
+extern const uint8_t num_macros;
+
+/* Set to expand abbreviations. Otherwise keys just pass through */
+extern uint8_t macros_enabled;
+
+/* Set if the key macroNext() last returned is part of an expansion (including
+ * the <CORRECT>s that take the abbreviation out), rather than one that was typed */
+extern uint8_t macro_expanded;
+
+/* Number of typed keys thrown away because the queue was full */
+extern uint8_t macro_overruns;
+
+/* Drops anything queued or partway out, and starts over at the start of a word */
+void init_macro();
+
+/* Queues a key decoded from the typewriter */
+void macroKeystroke(uint8_t key);
+
+/* Returns true if macroNext() has a key, and the transmit buffer has enough room
+ * for it to be echoed without waiting */
+uint8_t macroReady();
+
+/* Returns the next key for the mode: the typed keys in order, with expansions
+ * swapped in for abbreviations as each word ends */
+uint8_t macroNext();
+
+#endif // MACRO_H
@@ -0,0 +1,67 @@
+/* macros.c
+ * Final Project - Abbreviations and their expansions. GENERATED by
+ *                 Host/macrogen from the macro files in Macros/, so edit
+ *                 those and regenerate rather than editing this by hand.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include "macro.h"
+
+/* Expansions, each null terminated, in the order of the macro files */
+const char macro_text[] =
+    "Thank you\0"   /* ty */
+    "Thank you very much\0"   /* tyvm */
+    "as soon as possible\0"   /* asap */
+    "for your information\0"   /* fyi */
+    "The quick brown fox jumps over the lazy dog.\0"   /* qbf */
+    "Sincerely,\r\rTristan Lennertz\0"   /* sig */
+    "Best regards,\r\0";   /* br */
+
+/* Trie of the abbreviations, 117 bytes (see macro.h for the layout) */
+const uint8_t macro_trie[] =
+{
+    /* 0: "" */
+    6, 0xFF, 0xFF, 'a', 0x00, 0x15, 'b', 0x00, 0x2A, 'f', 0x00, 0x33, 'q', 0x00, 0x42, 's', 0x00, 0x51, 't', 0x00, 0x60,
+    /* 21: "a" */
+    1, 0xFF, 0xFF, 's', 0x00, 0x1B,
+    /* 27: "as" */
+    1, 0xFF, 0xFF, 'a', 0x00, 0x21,
+    /* 33: "asa" */
+    1, 0xFF, 0xFF, 'p', 0x00, 0x27,
+    /* 39: "asap" (abbreviation) */
+    0, 0x00, 0x1E,
+    /* 42: "b" */
+    1, 0xFF, 0xFF, 'r', 0x00, 0x30,
+    /* 48: "br" (abbreviation) */
+    0, 0x00, 0x91,
+    /* 51: "f" */
+    1, 0xFF, 0xFF, 'y', 0x00, 0x39,
+    /* 57: "fy" */
+    1, 0xFF, 0xFF, 'i', 0x00, 0x3F,
+    /* 63: "fyi" (abbreviation) */
+    0, 0x00, 0x32,
+    /* 66: "q" */
+    1, 0xFF, 0xFF, 'b', 0x00, 0x48,
+    /* 72: "qb" */
+    1, 0xFF, 0xFF, 'f', 0x00, 0x4E,
+    /* 78: "qbf" (abbreviation) */
+    0, 0x00, 0x47,
+    /* 81: "s" */
+    1, 0xFF, 0xFF, 'i', 0x00, 0x57,
+    /* 87: "si" */
+    1, 0xFF, 0xFF, 'g', 0x00, 0x5D,
+    /* 93: "sig" (abbreviation) */
+    0, 0x00, 0x74,
+    /* 96: "t" */
+    1, 0xFF, 0xFF, 'y', 0x00, 0x66,
+    /* 102: "ty" (abbreviation) */
+    1, 0x00, 0x00, 'v', 0x00, 0x6C,
+    /* 108: "tyv" */
+    1, 0xFF, 0xFF, 'm', 0x00, 0x72,
+    /* 114: "tyvm" (abbreviation) */
+    0, 0x00, 0x0A,
+};
+
+const uint8_t num_macros = 7;
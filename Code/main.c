@@ -16,6 +16,15 @@
 #include "pca.h"
 #include "keystrokes.h"
 #include "typist.h"
+#include "drill.h"
+#include "editor.h"
+#include "xmodem.h"
+#include "macro.h"
+#include "perf.h"
+#include "timer.h"
+#include "shell.h"
+#include "config.h"
+#include "control.h"
 
 /* Mask to enable full 1k of internal XRAM */
 #define XRAM_1024_EN_MASK (0x0C);
@@ -30,7 +39,16 @@
 void parseAndExecute(unsigned char c);
 void menuCmd();
 void diagnoseKeystroke();
-void init_external_int();
+void forwardKeystroke();
+void keyEventKeystroke();
+void editorInput(uint8_t key);
+void macroOutput(uint8_t key);
+void hostInput();
+void enterMode(uint8_t mode);
+void exitModes();
+#ifdef PERF_PROBES
+uint8_t currentMode();
+#endif
 
 /* Flag to indicate a manual reset is currently asserted on keyboard channel latches */
 uint8_t manualRst;
@@ -44,22 +62,64 @@ uint8_t diagnosticMode;
  * to commands until it's been exited with the correct exit key */
 uint8_t typistMode;
 
+/* Flag to indicate that the program is running raw capture mode, and will forward
+ * each keystroke's capture to the host as a binary frame (see frames.h) instead of
+ * decoding and echoing it. Decoding is left to the host daemon (Host/keydecoded.c) */
+uint8_t rawCaptureMode;
+
+/* Flag to indicate that the program is running key event mode, and will send each
+ * decoded keystroke to the host as a timestamped binary frame (see frames.h) instead
+ * of echoing it. Unlike echo, no keys are swallowed (SHIFT, INDEX, etc. all come out) */
+uint8_t keyEventMode;
+
+/* Flag to indicate that the program is running document editor mode, and keystrokes
+ * edit the document in XRAM (see editor.h) instead of being echoed */
+uint8_t editorMode;
+
 void main(void)
 {
-    init_serial();
+    /* Settings are needed to bring up everything else */
+    init_config();
+
+    init_serial(configGet(CONFIG_BAUD));
+    init_timer();
     init_pca_modules();
+    init_shell();
+    init_watchdog();
+
+    setPulseTrainTimeout(configGet(CONFIG_TIMEOUT));
+    enter_only_cr = configGet(CONFIG_ENTER_CR);
+    bigram_enabled = configGet(CONFIG_BIGRAM);
+    active_keymap = configGet(CONFIG_KEYMAP);
+    drift_enabled = configGet(CONFIG_DRIFT);
+    driftReset();
+    macros_enabled = configGet(CONFIG_MACROS);
+    setPulseWidths(configGet(CONFIG_PULSE_WIDTHS));
 
     /* Put the latches into a known (reset) state */
     CHANNEL_LATCH_RST = 1;
+#ifdef DUAL_KEYBOARD
+    KEYBOARD2_LATCH_RST = 1;
+#endif
     manualRst = 1;
 
     /* Flag initialization */
     diagnosticMode = 0;
     typistMode = 0;
+    rawCaptureMode = 0;
+    keyEventMode = 0;
+    editorMode = 0;
+
+    init_editor();
+    init_macro();
+    init_control();
 
     /* Output options menu */
     menuCmd();
 
+    /* Start in the configured mode */
+    enterMode(configGet(CONFIG_BOOT_MODE));
+
     /* Main loop; never exits. Has some simple states and dispatching based on them and keystrokes */
     while (1)
     {
@@ -68,19 +128,72 @@ void main(void)
         if (manualRst)
         {
             CHANNEL_LATCH_RST = 0;
+#ifdef DUAL_KEYBOARD
+            KEYBOARD2_LATCH_RST = 0;
+#endif
             manualRst = 0;
         }
 
+        kickWatchdog();
+
+        /* Trickle any changed settings out to the EEPROM */
+        configService();
+
+        /* Build the next typing drill a step at a time between keystrokes */
+        if (typistMode)
+            drillService();
+
+        /* Count the echoes that have made it out, against the mode they were in */
+        PERF_SERVICE();
+        PERF_SET_MODE(currentMode());
+
+        /* Keep an export moving along, a transmit buffer's worth at a time */
+        if (xmodem_active)
+            xmodemService();
+
+        /* Hand the normal and editor modes their next key from the macro layer.
+         * Expansions come out a key per pass too, so a long one never holds up
+         * the captures */
+        if (!xmodem_active && macroReady())
+            macroOutput(macroNext());
+
         /* Check if new character to receive, so as not to block */
         if (checkchar())
         {
+            /* Host input is handled the same in every mode, so it can be interleaved
+             * with someone typing away at the typewriter */
+            if (nextInputSource() == INPUT_SRC_SERIAL)
+            {
+                hostInput();
+            }
+            /* An export owns the serial port, so keystrokes are only journaled,
+             * except for <TAB CLEAR> to cancel it */
+            else if (xmodem_active)
+            {
+                if (getinput() == TAB_CLEAR_CODE)
+                    xmodemCancel();
+            }
             /* Different actions for keystroke reception based on current programs state */
-            if (diagnosticMode)
+            else if (diagnosticMode)
             {
                 /* Don't call getchar() because don't want an echo to terminal. This function
                  * will "receive" the character without echoing it, clearing the checkchar() condition */
                 diagnoseKeystroke();
             }
+            else if (rawCaptureMode)
+            {
+                /* Same as above, no echo. Only the capture frame goes out */
+                forwardKeystroke();
+            }
+            else if (keyEventMode)
+            {
+                keyEventKeystroke();
+            }
+            else if (editorMode)
+            {
+                /* Goes through the macro layer, and on to editorInput() from there */
+                macroKeystroke(getinput());
+            }
             else if (typistMode)
             {
                 uint8_t receivedChar = getchar();
@@ -90,6 +203,7 @@ void main(void)
                 {
                     typistMode = 0;
                     putstr("\r\nExiting typing coach mode\r\n");
+                    reportWeakKeys();
                 }
                 else
                 {
@@ -98,13 +212,55 @@ void main(void)
             }
             else
             {
-                /* Since not in a special mode, check if input keystroke is an explicit command */
-                parseAndExecute(getchar());
+                /* Since not in a special mode, the keystroke may be an explicit command.
+                 * It's echoed and checked once it comes out of the macro layer */
+                macroKeystroke(getinput());
             }
         }
     }
 }
 
+/* Enters a mode (BOOT_MODE_*) the same way its menu key would. Normal mode is
+ * already where the program is when no other mode is */
+void enterMode(uint8_t mode)
+{
+    switch (mode)
+    {
+    case BOOT_MODE_DIAGNOSTIC:
+        parseAndExecute(TAB_SET_CODE);
+        break;
+
+    case BOOT_MODE_TYPIST:
+        parseAndExecute('-');
+        break;
+
+    case BOOT_MODE_RAW_CAPTURE:
+        parseAndExecute('/');
+        break;
+
+    case BOOT_MODE_KEY_EVENT:
+        parseAndExecute('=');
+        break;
+
+    case BOOT_MODE_EDITOR:
+        parseAndExecute('+');
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Backs out of whatever special mode the program is in, to normal mode */
+void exitModes()
+{
+    if (diagnosticMode || typistMode || rawCaptureMode || keyEventMode || editorMode)
+    {
+        diagnosticMode = typistMode = rawCaptureMode = keyEventMode = editorMode = 0;
+        putstr("\r\nExiting to normal mode\r\n");
+    }
+}
+
 /* Dispatches commands based on the passed character, or does nothing if the character is not defined */
 void parseAndExecute(unsigned char c)
 {
@@ -119,11 +275,32 @@ void parseAndExecute(unsigned char c)
         putstr("\r\nEntering Diagnostic Mode (<TAB CLEAR> to exit)\r\n");
         break;
 
+#ifdef PERF_PROBES
+    case '*':
+        perfReport();
+        break;
+#endif
+
     case '-':
         typistMode = 1;
         newCoachString();
         break;
 
+    case '/':
+        rawCaptureMode = 1;
+        putstr("\r\nEntering Raw Capture Mode (<TAB CLEAR> to exit)\r\n");
+        break;
+
+    case '=':
+        keyEventMode = 1;
+        putstr("\r\nEntering Key Event Mode (<TAB CLEAR> to exit)\r\n");
+        break;
+
+    case '+':
+        editorMode = 1;
+        editorEnter();
+        break;
+
     default:
         break;
     }
@@ -135,7 +312,14 @@ void menuCmd()
     putstr("\r\nProgram options:\r\n");
     putstr(" '<TAB>' - Display this menu again\r\n");
     putstr(" '<TAB SET>' - Enter diagnostic mode\r\n");
+#ifdef PERF_PROBES
+    putstr(" '*' - Display and reset the performance counters\r\n");
+#endif
     putstr(" '-' - Enter typing coach mode\r\n");
+    putstr(" '/' - Enter raw capture mode\r\n");
+    putstr(" '=' - Enter key event mode\r\n");
+    putstr(" '+' - Enter document editor mode\r\n");
+    putstr("Type 'help' from the host terminal for serial commands\r\n");
 }
 
 /* Checks the exit condition keystroke for this mode, and exits if needed. Else,
@@ -144,13 +328,9 @@ void diagnoseKeystroke()
 {
     uint8_t interprettedCharacter;
 
-    /* These two actions are basically what goes on in getchar() when the
-     * typewriter keyboard is selected as the input source. This is done
-     * manually here to avoid echoing as getchar() does in this implementation */
-    interprettedCharacter = interpretKeystroke(channel_A_first_arrived,
-                                               channel_A_polarity,
-                                               deltaTOA);
-    cap_ready = 0;
+    /* Receive the keystroke without echoing it as getchar() does. This also leaves
+     * its capture in place for reporting */
+    interprettedCharacter = getinput();
 
     /* Exit condition check */
     if (interprettedCharacter == TAB_CLEAR_CODE)
@@ -161,11 +341,148 @@ void diagnoseKeystroke()
     else
     {
         reportKeystrokeStats();
+        printf_small("Tab Type: %c\r\n", "ABC?"[CAPTURE_TAB_TYPE(capture.flags)]);
         putstr("Interpreted as: ");
         putchar(interprettedCharacter);
         putstr("\r\n");
+
+        if (tab_type_mismatch)
+            putstr("Polarities don't match the tab type here, so this may be a bad read\r\n");
+    }
+}
+
+/* Checks the exit condition keystroke for this mode, and exits if needed. Else,
+ * forwards the keystroke's capture to the host undecoded */
+void forwardKeystroke()
+{
+    /* Only decoded locally to catch the exit keystroke */
+    if (getinput() == TAB_CLEAR_CODE)
+    {
+        rawCaptureMode = 0;
+        putstr("\r\nExiting raw capture mode\r\n");
+    }
+    else
+    {
+        sendCaptureFrame();
+    }
+}
+
+/* Checks the exit condition keystroke for this mode, and exits if needed. Else,
+ * sends the decoded keystroke to the host as a key event frame */
+void keyEventKeystroke()
+{
+    uint8_t key = getinput();
+
+    if (key == TAB_CLEAR_CODE)
+    {
+        keyEventMode = 0;
+        putstr("\r\nExiting key event mode\r\n");
+    }
+    else
+    {
+        sendEventFrame(key);
+    }
+}
+
+/* Checks the exit condition keystroke for this mode, and exits if needed. Else,
+ * applies the keystroke to the document. The editor echoes for itself */
+void editorInput(uint8_t key)
+{
+    if (editorKeystroke(key))
+    {
+        editorMode = 0;
+        printf_small("\r\nExiting document editor (%u characters)\r\n", editorLength());
+    }
+}
+
+/* Hands a key from the macro layer (see macro.h) on to the normal or editor mode.
+ * Only typed keys are commands in normal mode, and an abbreviation is taken back
+ * out of the echo by rubbing it out. Anything still queued once a mode that takes
+ * keystrokes itself has been entered is dropped */
+void macroOutput(uint8_t key)
+{
+    if (editorMode)
+    {
+        editorInput(key);
     }
+    else if (diagnosticMode || typistMode || rawCaptureMode || keyEventMode)
+    {
+        init_macro();
+    }
+    else if (macro_expanded)
+    {
+        if (key == CORRECT_CODE)
+            putstr("\b \b");
+        else
+            getchar_echoAction(key);
+    }
+    else
+    {
+        getchar_echoAction(key);
+        parseAndExecute(key);
+    }
+}
+
+/* Handles a byte sent from the host over the serial port. Host bytes all go to the
+ * command shell, which takes them one at a time so typewriter keystrokes keep being
+ * serviced in between. In the special modes the typewriter owns the terminal, so the
+ * bytes aren't echoed, and <TAB CLEAR> from the host backs out to normal mode. During
+ * an export, host bytes are the receiver's replies and all go to the transfer.
+ * Binary control frames (see control.h) are taken in every other mode, and never
+ * echoed */
+void hostInput()
+{
+    uint8_t c;
+
+    if (xmodem_active)
+    {
+        xmodemInput(getinput());
+        return;
+    }
+
+    c = getinput();
+
+    if (controlInput(c))
+    {
+        if (control_mode_request != CONTROL_NO_MODE)
+        {
+            exitModes();
+            enterMode(control_mode_request);
+            control_mode_request = CONTROL_NO_MODE;
+        }
+    }
+    else if (diagnosticMode || typistMode || rawCaptureMode || keyEventMode || editorMode)
+    {
+        if (c == TAB_CLEAR_CODE)
+            exitModes();
+        else
+            shellInput(c);
+    }
+    else
+    {
+        getchar_echoAction(c);
+        shellInput(c);
+    }
+}
+
+#ifdef PERF_PROBES
+/* Returns the mode the program is in, as the BOOT_MODE_* that would start it there */
+uint8_t currentMode()
+{
+    if (diagnosticMode)
+        return BOOT_MODE_DIAGNOSTIC;
+    else if (typistMode)
+        return BOOT_MODE_TYPIST;
+    else if (rawCaptureMode)
+        return BOOT_MODE_RAW_CAPTURE;
+    else if (keyEventMode)
+        return BOOT_MODE_KEY_EVENT;
+    else if (editorMode)
+        return BOOT_MODE_EDITOR;
+
+    return BOOT_MODE_NORMAL;
 }
+#endif // PERF_PROBES
 
 /* C startup code - Enables the full 1k of internal XRAM on startup, and ensures standard X2 mode on */
 _sdcc_external_startup()
@@ -3,8 +3,8 @@
  *                 PCA module. This exposes a number of flags and values for other
  *                 functions in this program to check and interpret as keystrokes
  *                 from the typewriter keyboard. These are driven / updated via PCA
- *                 module interrupts. cap_ready is set on update of these, and may
- *                 be cleared by external functions without interfering with operation.
+ *                 module interrupts, which queue up a capture record per keystroke
+ *                 for the main loop to pull off with nextCapture().
  *
  * Tristan Lennertz
  *
@@ -20,27 +20,102 @@
 #include "pca.h"
 #include "serial.h"
 #include "keystrokes.h"
+#include "frames.h"
+#include "timer.h"
 
-/* Timeout to clear reset pulse (occurs after keystroke signals settled) */
-#define PULSE_TRAIN_TIMEOUT_L   (0xF0)
-#define PULSE_TRAIN_TIMEOUT_H   (0x00)
 
 /* See PCA.h for descriptions of each of this flags / values */
-volatile __near uint8_t cap_ready;
-volatile __near uint8_t channel_A_first_arrived;
-volatile __near uint8_t channel_A_polarity;
-volatile __near uint8_t channel_B_polarity;
-volatile __near uint16_t deltaTOA;
-static volatile __near uint8_t cap_in_prog;
-
-/* Error flag, set to indicate that the read should be tossed because of something
- * unexpected. Internal flag. */
-static volatile __near uint8_t keystroke_error;
+__near keystroke_capture_t capture;
+volatile __near uint8_t capture_overruns;
+__near uint16_t pulse_train_timeout;
+__near uint8_t pulse_widths;
+volatile __near uint16_t capture_count;
+volatile __near uint16_t keystroke_errors;
+volatile __near uint16_t stuck_captures;
+#ifdef CHANNEL_TIMESTAMPS
+volatile __near uint16_t missing_channel[2];
+#endif
+
+/* PCA count at each keyboard's wavefront detect while its strike is waiting on
+ * the coincidence (bit per keyboard in strikes_in_flight). The wavefront detect
+ * is an OR of the channel latches, which hold until the latch reset (FINAL.PLD),
+ * so a keyboard can't start a second strike before the first one resolves */
+static volatile __near uint16_t strike_start[KEYBOARDS_FITTED];
+static volatile __near uint8_t strikes_in_flight;
+
+/* PCA count at each keyboard's last wavefront detect, for falling back on when a
+ * coincidence comes without a strike in flight, and for its pulse width */
+static volatile __near uint16_t wavefront_rise[KEYBOARDS_FITTED];
+
+/* Pulse width mode (see pulse_widths in pca.h). Each keyboard's last wavefront
+ * width (0 while it's still high), the PCA count at its last coincidence, and
+ * the capture held back for its coincidence to fall (bit per keyboard in
+ * captures_pending) */
+static volatile __near uint16_t wavefront_width[KEYBOARDS_FITTED];
+static volatile __near uint16_t coincidence_rise[KEYBOARDS_FITTED];
+static __xdata keystroke_capture_t pending_capture[KEYBOARDS_FITTED];
+static volatile __near uint8_t captures_pending;
+
+#ifdef CHANNEL_TIMESTAMPS
+/* Channels (bit per CHANNEL_*) whose wavefront has arrived on each keyboard's
+ * strike in progress, and the PCA count it arrived at */
+static volatile __near uint8_t channels_arrived[KEYBOARDS_FITTED];
+static volatile __near uint16_t channel_arrival[KEYBOARDS_FITTED][2];
+#endif
+
+/* PCA count at which each keyboard's latch reset is to be released, and which
+ * keyboards are held in reset (bit per keyboard). Module 0 is shared, so its
+ * compare is always set to the earliest pending release or stuck strike deadline */
+static volatile __near uint16_t latch_release[KEYBOARDS_FITTED];
+static volatile __near uint8_t latches_in_reset;
+
+#ifdef DUAL_KEYBOARD
+/* Buffer the second keyboard's latches are read through */
+static volatile __xdata __at(KEYBOARD2_LATCH_ADDR) uint8_t keyboard2_latches;
+#endif
+
+/* Queue of completed captures. Head is only moved by the ISR and tail only by the
+ * main loop, so neither needs interrupts disabled to update */
+static __xdata keystroke_capture_t cap_queue[CAPTURE_QUEUE_SIZE];
+static volatile __near uint8_t cap_head;
+static volatile __near uint8_t cap_tail;
+
+/* Capture time of the last key event frame sent from each keyboard, for the
+ * frame's delta time */
+static uint16_t last_event_time[NUM_KEYBOARDS];
 
 /* Internal Function Declarations */
 void init_mod0_timer();
 void init_mod1_cap();
 void init_mod2_cap();
+#ifdef DUAL_KEYBOARD
+void init_mod3_cap();
+void init_mod4_cap();
+#endif
+
+/* Only called from the PCA ISR, so they share its register bank. Each is built
+ * with #pragma nooverlay, since SDCC would otherwise be free to overlay their
+ * parameters and locals with a main loop function's, which the interrupt would
+ * then trample */
+static void strikeDetected(uint8_t kb, uint16_t startTime) __using (2);
+static void strikeCoincidence(uint8_t kb, uint8_t flags, uint16_t endTime) __using (2);
+#ifndef CHANNEL_TIMESTAMPS
+static void wavefrontFell(uint8_t kb, uint16_t fallTime) __using (2);
+static void coincidenceFell(uint8_t kb, uint16_t fallTime) __using (2);
+#endif
+static void queuePending(uint8_t kb) __using (2);
+#ifdef CHANNEL_TIMESTAMPS
+static void channelArrived(uint8_t kb, uint8_t channel, uint16_t time) __using (2);
+static uint8_t latchedFlags(uint8_t kb) __using (2);
+#endif
+static void serviceTimeouts(uint16_t now) __using (2);
+
+/* Sets the latch reset of keyboard kb */
+#ifdef DUAL_KEYBOARD
+#define SET_LATCH_RST(kb, state) do { if (kb) KEYBOARD2_LATCH_RST = (state); else CHANNEL_LATCH_RST = (state); } while (0)
+#else
+#define SET_LATCH_RST(kb, state) (CHANNEL_LATCH_RST = (state))
+#endif
 
 /* Reports all of the info needed to identify a keystroke. This includes:
  * - Which channel's wavefront arrived first
@@ -48,18 +123,192 @@ void init_mod2_cap();
  * - The difference in the time of arrival of both channels' wavefronts
  * This function isn't meant for user applications, but is good for profiling
  * the particular keyboard.
- * NOTE: Data is not valid unless cap_ready has been set */
+ * NOTE: Data is not valid until nextCapture() has been called */
 void reportKeystrokeStats()
 {
-    printf_small("\r\nFirst Wavefront: Channel %c\r\n", channel_A_first_arrived ? 'A' : 'B');
-    printf_small("Channel A Polarity: (%c)\r\n", channel_A_polarity ? '+' : '-');
-    printf_small("Channel B Polarity: (%c)\r\n", channel_B_polarity ? '+' : '-');
-    printf_small("PCA Ticks Between Channel Wavefronts: %d\r\n", (deltaTOA / 3));
+#ifdef DUAL_KEYBOARD
+    printf_small("\r\nKeyboard: %d", CAPTURE_KEYBOARD(capture.flags) + 1);
+#endif
+    printf_small("\r\nFirst Wavefront: Channel %c\r\n", (capture.flags & CAPTURE_FLAG_A_FIRST) ? 'A' : 'B');
+    printf_small("Channel A Polarity: (%c)\r\n", (capture.flags & CAPTURE_FLAG_A_POS) ? '+' : '-');
+    printf_small("Channel B Polarity: (%c)\r\n", (capture.flags & CAPTURE_FLAG_B_POS) ? '+' : '-');
+    printf_small("Shift: %s\r\n", (capture.flags & CAPTURE_FLAG_SHIFT) ? "Down" : "Up");
+    printf_small("PCA Ticks Between Channel Wavefronts: %d\r\n", (capture.deltaTOA / 3));
+
+    if (pulse_widths)
+    {
+        printf_small("Wavefront Pulse Width: %u PCA Ticks\r\n", capture.wavefrontWidth);
+        printf_small("Coincidence Pulse Width: %u PCA Ticks\r\n", capture.coincidenceWidth);
+    }
+}
+
+/* Returns true if there is a capture waiting in the queue */
+uint8_t captureReady()
+{
+    return (cap_head != cap_tail);
+}
+
+/* Returns the arrival sequence number of the oldest waiting capture.
+ * NOTE: Only valid if captureReady() */
+uint8_t nextCaptureSeq()
+{
+    return cap_queue[cap_tail].seq;
+}
+
+/* Pulls the oldest waiting capture off of the queue into capture.
+ * NOTE: Only valid if captureReady() */
+void nextCapture()
+{
+    __xdata keystroke_capture_t *rec = &cap_queue[cap_tail];
+
+    capture.flags = rec->flags;
+    capture.deltaTOA = rec->deltaTOA;
+    capture.time = rec->time;
+    capture.seq = rec->seq;
+    capture.wavefrontWidth = rec->wavefrontWidth;
+    capture.coincidenceWidth = rec->coincidenceWidth;
+#ifdef PERF_PROBES
+    capture.coincidence = rec->coincidence;
+#endif
+
+    cap_tail = (cap_tail + 1) & (CAPTURE_QUEUE_SIZE - 1);
+}
+
+/* Sends the current capture to the host as a raw capture frame (see frames.h)
+ * so that the decoding can be done off of the MCU.
+ * NOTE: Data is not valid until nextCapture() has been called */
+void sendCaptureFrame()
+{
+    uint8_t flags = capture.flags;
+    uint8_t dTOA_H = capture.deltaTOA >> 8;
+    uint8_t dTOA_L = capture.deltaTOA & 0xFF;
+
+    if (pulse_widths)
+    {
+        uint8_t wf_H = capture.wavefrontWidth >> 8;
+        uint8_t wf_L = capture.wavefrontWidth & 0xFF;
+        uint8_t co_H = capture.coincidenceWidth >> 8;
+        uint8_t co_L = capture.coincidenceWidth & 0xFF;
+
+        putchar(WIDTH_FRAME_SYNC);
+        putchar(wf_H);
+        putchar(wf_L);
+        putchar(co_H);
+        putchar(co_L);
+        putchar(wf_H ^ wf_L ^ co_H ^ co_L);
+    }
+
+    putchar(CAPTURE_FRAME_SYNC);
+    putchar(flags);
+    putchar(dTOA_H);
+    putchar(dTOA_L);
+    putchar(flags ^ dTOA_H ^ dTOA_L);
+}
+
+/* Sends the decoded keystroke to the host as a key event frame (see frames.h),
+ * timestamped relative to the previous key event frame.
+ * NOTE: Data is not valid until nextCapture() has been called */
+void sendEventFrame(uint8_t key)
+{
+    uint8_t kb = CAPTURE_KEYBOARD(capture.flags);
+    uint16_t dt = capture.time - last_event_time[kb];
+    uint8_t dt_H, dt_L;
+
+    last_event_time[kb] = capture.time;
+
+    if (dt > EVENT_DT_MAX)
+        dt = EVENT_DT_MAX;
+
+    dt_H = dt >> 8;
+    dt_L = dt & 0xFF;
+
+    if (capture.flags & CAPTURE_FLAG_SHIFT)
+        dt_H |= EVENT_SHIFT_MASK;
+    if (kb)
+        dt_H |= EVENT_KEYBOARD2_MASK;
+
+    putchar(EVENT_FRAME_SYNC);
+    putchar(key);
+    putchar(dt_H);
+    putchar(dt_L);
+    putchar(key ^ dt_H ^ dt_L);
+}
+
+/* Prints the running capture counters (see pca.h) */
+void reportCaptureCounters()
+{
+    uint16_t captures, errors, stuck;
+    uint8_t overruns;
+#ifdef CHANNEL_TIMESTAMPS
+    uint16_t missing_a, missing_b;
+#endif
+
+    /* Two byte counters can't be updated halfway through being read */
+    EC = 0;
+    captures = capture_count;
+    errors = keystroke_errors;
+    stuck = stuck_captures;
+    overruns = capture_overruns;
+#ifdef CHANNEL_TIMESTAMPS
+    missing_a = missing_channel[CHANNEL_A];
+    missing_b = missing_channel[CHANNEL_B];
+#endif
+    EC = 1;
+
+    printf_small("Captures: %u\r\n", captures);
+    printf_small("Keystroke errors: %u\r\n", errors);
+    printf_small("Stuck captures aborted: %u\r\n", stuck);
+    printf_small("Capture queue overruns: %u\r\n", overruns);
+
+#ifdef CHANNEL_TIMESTAMPS
+    printf_small("Missing channel A: %u\r\n", missing_a);
+    printf_small("Missing channel B: %u\r\n", missing_b);
+#endif
+}
+
+/* Changes the time the channel latches are held in reset after coincidence.
+ * Takes effect at the next coincidence */
+void setPulseTrainTimeout(uint16_t ticks)
+{
+    /* Two byte value is read by the ISR */
+    EC = 0;
+    pulse_train_timeout = ticks;
+    EC = 1;
+}
+
+/* Turns pulse width mode (see pulse_widths in pca.h) on or off */
+void setPulseWidths(uint8_t on)
+{
+    uint8_t edges;
+
+#ifdef CHANNEL_TIMESTAMPS
+    /* The modules only see each channel's own wavefront, not the combined
+     * signals the widths are of */
+    on = 0;
+#endif
+
+    edges = on ? (CAPP | CAPN) : CAPP;
+
+    EC = 0;
+
+    pulse_widths = on;
+    CCAPM1 = edges | ECCF;
+    CCAPM2 = edges | ECCF;
+#ifdef DUAL_KEYBOARD
+    CCAPM3 = edges | ECCF;
+    CCAPM4 = edges | ECCF;
+#endif
+
+    EC = 1;
 }
 
 /* Initializes all of the pca_modules for their respective functions */
 void init_pca_modules()
 {
+#ifdef CHANNEL_TIMESTAMPS
+    uint8_t kb;
+#endif
+
     CH = CL = 0x00; /* Initialize PCA count to 0 */
 
     /* Set PCA clock to PeriphClock / 2 (CPS0 = 1, CPS1 = 0) */
@@ -73,11 +322,26 @@ void init_pca_modules()
     init_mod0_timer();
     init_mod1_cap();
     init_mod2_cap();
+#ifdef DUAL_KEYBOARD
+    init_mod3_cap();
+    init_mod4_cap();
+#endif
 
     /* Make sure flags initially cleared */
-    cap_in_prog = 0;
-    cap_ready = 0;
-    keystroke_error = 0;
+    strikes_in_flight = 0;
+    latches_in_reset = 0;
+    captures_pending = 0;
+    pulse_widths = 0;
+#ifdef CHANNEL_TIMESTAMPS
+    for (kb = 0; kb < KEYBOARDS_FITTED; kb++)
+        channels_arrived[kb] = 0;
+    missing_channel[CHANNEL_A] = missing_channel[CHANNEL_B] = 0;
+#endif
+    cap_head = cap_tail = 0;
+    capture_overruns = 0;
+    capture_count = 0;
+    keystroke_errors = 0;
+    stuck_captures = 0;
 
     /* Enable Interrupts globally and PCA interrupt specifically */
     EA = EC = 1;
@@ -87,13 +351,17 @@ void init_pca_modules()
 }
 
 /* Timeout module to clear the reset of the keyboard channel latches (which is
- * set after channel coincidence is detected) */
+ * set after channel coincidence is detected), and to catch strikes whose
+ * coincidence never comes */
 void init_mod0_timer()
 {
-    /* Timeout is set from define in pca.h, should occur after keystroke
-     * signals have settled. */
-    CCAP0L = PULSE_TRAIN_TIMEOUT_L;
-    CCAP0H = PULSE_TRAIN_TIMEOUT_H;
+    /* Timeout defaults to the define in pca.h and can be changed at runtime with
+     * setPulseTrainTimeout(). Should occur after keystroke signals have settled.
+     * The compare value is set to the next deadline by the ISR, since the PCA
+     * count runs freely so that every keyboard's deadlines can share module 0 */
+    pulse_train_timeout = PULSE_TRAIN_TIMEOUT;
+    CCAP0L = PULSE_TRAIN_TIMEOUT & 0xFF;
+    CCAP0H = PULSE_TRAIN_TIMEOUT >> 8;
 
     CCAPM0 = 0x00;
     CCAPM0 |= MAT | ECOM; /* Enable comparator and flag on match, but not interrupt yet */
@@ -124,85 +392,538 @@ void init_mod2_cap()
     CCAPM2 |= CAPP | ECCF;  /* Enable positive transition interrupt */
 }
 
+#ifdef DUAL_KEYBOARD
+/* Second keyboard's initial wavefront detection. Same as module 1 */
+void init_mod3_cap()
+{
+    CCAPM3 = 0x00;
+    CCAPM3 |= CAPP | ECCF;  /* Enable positive transition interrupt */
+}
+
+/* Second keyboard's coincidence detection. Same as module 2 */
+void init_mod4_cap()
+{
+    CCAPM4 = 0x00;
+    CCAPM4 |= CAPP | ECCF;  /* Enable positive transition interrupt */
+}
+#endif // DUAL_KEYBOARD
+
+/* Initial wavefront on keyboard kb; start of keystroke detection cycle */
+#pragma nooverlay
+static void strikeDetected(uint8_t kb, uint16_t startTime) __using (2)
+{
+    /* The wavefront detect can't rise again until the latch reset, so a strike
+     * still in flight means something has gone wrong. It's given up on */
+    if (strikes_in_flight & (1 << kb))
+        keystroke_errors++;
+
+    strike_start[kb] = startTime;
+    strikes_in_flight |= (1 << kb);
+    wavefront_rise[kb] = startTime;
+    wavefront_width[kb] = 0;
+
+    /* Watch for the coincidence never coming */
+    serviceTimeouts(startTime);
+}
+
+/* Channel coincidence on keyboard kb; Actions to complete end of keystroke read
+ * cycle. flags has the latches already read */
+#pragma nooverlay
+static void strikeCoincidence(uint8_t kb, uint8_t flags, uint16_t endTime) __using (2)
+{
+    __xdata keystroke_capture_t *rec;
+    uint8_t next_head;
+    uint16_t startTime;
+
+    /* A strike that started longer ago than any key's time difference can't be
+     * the one this coincidence belongs to. Unsigned differences take care of the
+     * PCA count rolling over */
+    if ((strikes_in_flight & (1 << kb)) &&
+        (uint16_t)(endTime - strike_start[kb]) <= MAX_DELTA_TOA)
+    {
+        startTime = strike_start[kb];
+    }
+    else
+    {
+        /* No strike to go with it, so something has seriously gone wrong. Fall
+         * back on whatever was last captured */
+        startTime = wavefront_rise[kb];
+        keystroke_errors++;
+    }
+
+    strikes_in_flight &= ~(1 << kb);
+
+    if (pulse_widths)
+    {
+        /* Held back until the coincidence falls. One still waiting never saw its
+         * fall, so it goes without its widths */
+        if (captures_pending & (1 << kb))
+            queuePending(kb);
+
+        rec = &pending_capture[kb];
+        coincidence_rise[kb] = endTime;
+        captures_pending |= (1 << kb);
+    }
+    else
+    {
+        /* Queue up the capture for the main loop, unless it's fallen too far behind */
+        next_head = (cap_head + 1) & (CAPTURE_QUEUE_SIZE - 1);
+        if (next_head != cap_tail)
+        {
+            rec = &cap_queue[cap_head];
+        }
+        else
+        {
+            rec = 0;
+            capture_overruns++;
+        }
+    }
+
+    if (rec)
+    {
+        rec->flags = flags;
+        rec->deltaTOA = endTime - startTime;
+        rec->time = timer_ticks;
+        rec->wavefrontWidth = 0;
+        rec->coincidenceWidth = 0;
+#ifdef PERF_PROBES
+        rec->coincidence = endTime;
+#endif
+
+        if (!pulse_widths)
+        {
+            rec->seq = input_seq++;
+            cap_head = next_head;
+            capture_count++;
+        }
+    }
+
+    /* Activate latch reset signal, timed from the coincidence */
+    SET_LATCH_RST(kb, 1);
+    latch_release[kb] = endTime + pulse_train_timeout;
+    latches_in_reset |= (1 << kb);
+
+    serviceTimeouts(endTime);
+}
+
+#ifndef CHANNEL_TIMESTAMPS
+/* Falling edge of keyboard kb's wavefront detect, in pulse width mode */
+#pragma nooverlay
+static void wavefrontFell(uint8_t kb, uint16_t fallTime) __using (2)
+{
+#ifdef PERF_PROBES
+    uint16_t entered;
+
+    PERF_NOW(entered);
+#endif
+
+    wavefront_width[kb] = fallTime - wavefront_rise[kb];
+
+    PERF_ISR_PROBE(PERF_FALLING, entered);
+}
+
+/* Falling edge of keyboard kb's coincidence, in pulse width mode. Completes the
+ * capture held back for it */
+#pragma nooverlay
+static void coincidenceFell(uint8_t kb, uint16_t fallTime) __using (2)
+{
+#ifdef PERF_PROBES
+    uint16_t entered;
+
+    PERF_NOW(entered);
+#endif
+
+    if (captures_pending & (1 << kb))
+    {
+        pending_capture[kb].wavefrontWidth = wavefront_width[kb];
+        pending_capture[kb].coincidenceWidth = fallTime - coincidence_rise[kb];
+        queuePending(kb);
+    }
+
+    PERF_ISR_PROBE(PERF_FALLING, entered);
+}
+#endif // CHANNEL_TIMESTAMPS
+
+/* Queues up keyboard kb's held back capture for the main loop, unless it's
+ * fallen too far behind */
+#pragma nooverlay
+static void queuePending(uint8_t kb) __using (2)
+{
+    uint8_t next_head = (cap_head + 1) & (CAPTURE_QUEUE_SIZE - 1);
+    __xdata keystroke_capture_t *src, *rec;
+
+    captures_pending &= ~(1 << kb);
+
+    if (next_head != cap_tail)
+    {
+        /* Field by field, since a struct assignment can turn into a call to a
+         * generic copy routine that doesn't know about this register bank */
+        src = &pending_capture[kb];
+        rec = &cap_queue[cap_head];
+        rec->flags = src->flags;
+        rec->deltaTOA = src->deltaTOA;
+        rec->time = src->time;
+        rec->seq = input_seq++;
+        rec->wavefrontWidth = src->wavefrontWidth;
+        rec->coincidenceWidth = src->coincidenceWidth;
+#ifdef PERF_PROBES
+        rec->coincidence = src->coincidence;
+#endif
+
+        cap_head = next_head;
+        capture_count++;
+    }
+    else
+    {
+        capture_overruns++;
+    }
+}
+
+#ifdef CHANNEL_TIMESTAMPS
+/* Wavefront arriving on one channel of keyboard kb. The first channel to arrive
+ * starts the strike, and the other one resolves it */
+#pragma nooverlay
+static void channelArrived(uint8_t kb, uint8_t channel, uint16_t time) __using (2)
+{
+    uint8_t flags;
+    int16_t toa;
+
+    if (!channels_arrived[kb])
+    {
+        PERF_ISR_PROBE(PERF_WAVEFRONT, time);
+
+        channel_arrival[kb][channel] = time;
+        channels_arrived[kb] = (1 << channel);
+        strikeDetected(kb, time);
+        return;
+    }
+
+    /* Each channel's latch holds until the latch reset, so it can't rise twice
+     * in one strike */
+    if (channels_arrived[kb] & (1 << channel))
+        return;
+
+    PERF_ISR_PROBE(PERF_COINCIDENCE, time);
+
+    channel_arrival[kb][channel] = time;
+    channels_arrived[kb] = 0;
+
+    /* Signed time of arrival of B relative to A, so positive when A was first */
+    toa = channel_arrival[kb][CHANNEL_B] - channel_arrival[kb][CHANNEL_A];
+
+    flags = latchedFlags(kb);
+    if (toa >= 0)
+        flags |= CAPTURE_FLAG_A_FIRST;
+
+    strikeCoincidence(kb, flags, time);
+}
+
+/* Reads keyboard kb's polarity latches and shift into CAPTURE_FLAG_* bits, before
+ * the latch reset is triggered */
+#pragma nooverlay
+static uint8_t latchedFlags(uint8_t kb) __using (2)
+{
+    uint8_t latch_scan;
+    uint8_t flags = 0;
+
+#ifdef DUAL_KEYBOARD
+    if (kb)
+    {
+        latch_scan = keyboard2_latches;
+        flags |= CAPTURE_FLAG_KEYBOARD2;
+
+        if (!(latch_scan & KEYBOARD2_N_SHIFT_MASK))
+            flags |= CAPTURE_FLAG_SHIFT;
+    }
+    else
+#endif
+    {
+        latch_scan = P1;
+
+        if (!N_SHIFT_KEY)       /* Active low */
+            flags |= CAPTURE_FLAG_SHIFT;
+    }
+
+    if (latch_scan & CHANNEL_A_POS_MASK)
+        flags |= CAPTURE_FLAG_A_POS;
+    if (latch_scan & CHANNEL_B_POS_MASK)
+        flags |= CAPTURE_FLAG_B_POS;
+
+    return flags;
+}
+#endif // CHANNEL_TIMESTAMPS
+
+/* Handles module 0's deadlines as of PCA count now. Strikes that have gone too
+ * long without their coincidence are aborted, latch resets that are due are
+ * released, then module 0 is set to interrupt at the earliest deadline left */
+#pragma nooverlay
+static void serviceTimeouts(uint16_t now) __using (2)
+{
+    uint8_t kb;
+    uint16_t earliest = 0;
+    uint8_t pending = 0;
+
+    for (kb = 0; kb < KEYBOARDS_FITTED; kb++)
+    {
+        /* A strike that hasn't seen its coincidence by now never will, e.g. on a
+         * one sided acoustic event. Its latch would hold the wavefront detect up
+         * and keep the keyboard deaf, so the latches are reset to recover */
+        if ((strikes_in_flight & (1 << kb)) &&
+            (int16_t)(now - (strike_start[kb] + STUCK_CAPTURE_TIMEOUT)) >= 0)
+        {
+            stuck_captures++;
+            strikes_in_flight &= ~(1 << kb);
+
+#ifdef CHANNEL_TIMESTAMPS
+            /* Only one channel ever arrived, so the other is the one missing */
+            if (channels_arrived[kb])
+                missing_channel[(channels_arrived[kb] & (1 << CHANNEL_A)) ? CHANNEL_B : CHANNEL_A]++;
+            channels_arrived[kb] = 0;
+#endif
+
+            SET_LATCH_RST(kb, 1);
+            latch_release[kb] = now + pulse_train_timeout;
+            latches_in_reset |= (1 << kb);
+        }
+
+        if (latches_in_reset & (1 << kb))
+        {
+            /* Clear the channel latch reset to make them available for next keystroke */
+            if ((int16_t)(now - latch_release[kb]) >= 0)
+            {
+                SET_LATCH_RST(kb, 0);
+                latches_in_reset &= ~(1 << kb);
+
+                /* The coincidence should have fallen by now. If it hasn't, the
+                 * capture held back for it doesn't wait any longer */
+                if (captures_pending & (1 << kb))
+                    queuePending(kb);
+            }
+            else if (!pending || (int16_t)(latch_release[kb] - earliest) < 0)
+            {
+                earliest = latch_release[kb];
+                pending = 1;
+            }
+        }
+
+        if (strikes_in_flight & (1 << kb))
+        {
+            uint16_t deadline = strike_start[kb] + STUCK_CAPTURE_TIMEOUT;
+
+            if (!pending || (int16_t)(deadline - earliest) < 0)
+            {
+                earliest = deadline;
+                pending = 1;
+            }
+        }
+    }
+
+    if (pending)
+    {
+        uint8_t live_H, live_L;
+
+        /* Writing the low byte disables the comparator and writing the high
+         * byte re-enables it */
+        CCAP0L = earliest & 0xFF;
+        CCAP0H = earliest >> 8;
+
+        /* Any match flag already pending is left alone. It may be for a deadline
+         * that passed while this ran, and a stale one is harmless since the
+         * deadlines are checked against the count itself */
+        CCAPM0 |= ECCF;
+
+        /* now is when the capture was latched, not the count as it is. If the
+         * deadline has already gone by (ISR latency, or the other keyboard's
+         * work), the compare won't match until the count wraps, ~23ms on, so
+         * the flag is set by hand to come straight back */
+        do
+        {
+            live_H = CH;
+            live_L = CL;
+        } while (live_H != CH);
+
+        if ((int16_t)((((uint16_t)live_H << 8) | live_L) - earliest) >= 0)
+            CCF0 = 1;
+    }
+    else
+    {
+        CCAPM0 &= ~ECCF;    /* disable interrupt for this timer (activated at next keystroke) */
+    }
+}
+
 /* PCA ISR - Uses register bank 2 to reduce context switching overhead */
 void pca_isr(void) __critical __interrupt (6) __using (2)
 {
-    /* Initial wavefront; start of keystroke detection cycle */
+#ifdef CHANNEL_TIMESTAMPS
+    /* Each channel's wavefront, timestamped in its own module. The interrupts are
+     * cleared first, since the second channel sets the latch reset */
     if (CCF1)
     {
-        /* If this happens with a capture already in progess, something has definitely
-         * gone wrong and this is not a good read */
-        if (cap_in_prog)
-            keystroke_error = 1;
+        uint16_t captured = (CCAP1H << 8) | CCAP1L;
+
+        CCF1 = 0;   /* clear interrupt */
+        channelArrived(0, CHANNEL_A, captured);
+    }
+
+    if (CCF2)
+    {
+        uint16_t captured = (CCAP2H << 8) | CCAP2L;
+
+        CCF2 = 0;   /* clear interrupt */
+        channelArrived(0, CHANNEL_B, captured);
+    }
+
+#ifdef DUAL_KEYBOARD
+    /* Second keyboard's channels */
+    if (CCF3)
+    {
+        uint16_t captured = (CCAP3H << 8) | CCAP3L;
+
+        CCF3 = 0;   /* clear interrupt */
+        channelArrived(1, CHANNEL_A, captured);
+    }
+
+    if (CCF4)
+    {
+        uint16_t captured = (CCAP4H << 8) | CCAP4L;
 
-        /* Mark as a capture in progress */
-        cap_in_prog = 1;
+        CCF4 = 0;   /* clear interrupt */
+        channelArrived(1, CHANNEL_B, captured);
+    }
+#endif // DUAL_KEYBOARD
+
+#else
+    /* Initial wavefront; start of keystroke detection cycle. In pulse width mode
+     * the module captures both edges, and the pin tells which this was */
+    if (CCF1)
+    {
+        /* Time captured in module 1 */
+        uint16_t captured = (CCAP1H << 8) | CCAP1L;
 
         CCF1 = 0;   /* clear interrupt */
+
+        if (!pulse_widths || WAVEFRONT_DETECT_PIN)
+        {
+            PERF_ISR_PROBE(PERF_WAVEFRONT, captured);
+
+            strikeDetected(0, captured);
+        }
+        else
+        {
+            wavefrontFell(0, captured);
+        }
     }
 
-    /* Channel coincidence signal; Actions to complete end of keystroke read cycle */
+    /* Channel coincidence signal; Actions to complete end of keystroke read cycle.
+     * The interrupt is cleared first, since setting the latch reset here is what
+     * brings the coincidence back down, and in pulse width mode that falling edge
+     * mustn't be lost */
     if (CCF2)
     {
+        uint16_t captured = (CCAP2H << 8) | CCAP2L;
         uint8_t port1_scan;
-        uint16_t startTime, endTime;
+        uint8_t flags = 0;
+
+        CCF2 = 0;   /* clear interrupt */
 
-        /* Capture port 1 for use in a couple of calculatinos */
-        port1_scan = P1;
+        if (!pulse_widths || CHANNEL_COINCIDENCE_PIN)
+        {
+            PERF_ISR_PROBE(PERF_COINCIDENCE, captured);
 
-        /* This shouldn't happen before the wavefront detect, so something has seriously
-         * gone wrong if it does, and the keystroke should be tossed */
-        if (!cap_in_prog)
-            keystroke_error = 1;
+            /* Capture port 1 for use in a couple of calculatinos */
+            port1_scan = P1;
 
-        /* Capture wavefront polarity latches before triggering reset */
-        channel_A_polarity = port1_scan & CHANNEL_A_POS_MASK;
-        channel_B_polarity = port1_scan & CHANNEL_B_POS_MASK;
+            /* Capture wavefront polarity latches before triggering reset */
+            if (port1_scan & CHANNEL_A_POS_MASK)
+                flags |= CAPTURE_FLAG_A_POS;
+            if (port1_scan & CHANNEL_B_POS_MASK)
+                flags |= CAPTURE_FLAG_B_POS;
 
-        /* Capture the first channel to arrive latch before triggering reset */
-        channel_A_first_arrived = !CHANNEL_B_FIRST_LATCH;
+            /* Capture the first channel to arrive latch before triggering reset */
+            if (!CHANNEL_B_FIRST_LATCH)
+                flags |= CAPTURE_FLAG_A_FIRST;
 
-        /* Drop values into 16-bit vars for calculation */
-        startTime = (CCAP1H << 8);  /* Start time captured in module 1 */
-        startTime |= CCAP1L;
-        endTime = (CCAP2H << 8);    /* End time captured in module 2 */
-        endTime |= CCAP2L;
+            /* Latch the shift key along with the rest, so the decode doesn't depend on
+             * whether it is still held by the time the main loop gets to it */
+            if (!N_SHIFT_KEY)       /* Active low */
+                flags |= CAPTURE_FLAG_SHIFT;
 
-        if (startTime > endTime)    /* In case the PCA count rolled over between times */
-            deltaTOA = endTime + (0xFFFF - startTime);
+            /* End time captured in module 2 */
+            strikeCoincidence(0, flags, captured);
+        }
         else
-            deltaTOA = endTime - startTime;
+        {
+            coincidenceFell(0, captured);
+        }
+    }
 
-        cap_ready = 1;
+#ifdef DUAL_KEYBOARD
+    /* Second keyboard's initial wavefront */
+    if (CCF3)
+    {
+        uint16_t captured = (CCAP3H << 8) | CCAP3L;
 
-        /* Activate latch reset signal and timer that will clear it */
-        CHANNEL_LATCH_RST = 1;
+        CCF3 = 0;   /* clear interrupt */
 
-        CR = 0;         /* Start PCA timer off at 0 */
-        CH = CL = 0;
+        if (!pulse_widths || KEYBOARD2_WAVEFRONT_PIN)
+        {
+            PERF_ISR_PROBE(PERF_WAVEFRONT, captured);
 
-        CCF0 = 0;       /* Enable interrupt on this timer, but make sure it won't trip immediately */
-        CCAPM0 |= ECCF;
+            strikeDetected(1, captured);
+        }
+        else
+        {
+            wavefrontFell(1, captured);
+        }
+    }
 
-        CR = 1;
+    /* Second keyboard's coincidence. Its latches are all read through the buffer */
+    if (CCF4)
+    {
+        uint16_t captured = (CCAP4H << 8) | CCAP4L;
 
-        cap_in_prog = 0;
-        keystroke_error = 0;
+        CCF4 = 0;   /* clear interrupt */
 
-        CCF2 = 0;   /* clear interrupt */
+        if (!pulse_widths || KEYBOARD2_COINCIDENCE_PIN)
+        {
+            uint8_t latch_scan = keyboard2_latches;
+            uint8_t flags = CAPTURE_FLAG_KEYBOARD2;
+
+            PERF_ISR_PROBE(PERF_COINCIDENCE, captured);
+
+            if (latch_scan & CHANNEL_A_POS_MASK)
+                flags |= CAPTURE_FLAG_A_POS;
+            if (latch_scan & CHANNEL_B_POS_MASK)
+                flags |= CAPTURE_FLAG_B_POS;
+            if (!(latch_scan & KEYBOARD2_B_FIRST_MASK))
+                flags |= CAPTURE_FLAG_A_FIRST;
+            if (!(latch_scan & KEYBOARD2_N_SHIFT_MASK))
+                flags |= CAPTURE_FLAG_SHIFT;
+
+            strikeCoincidence(1, flags, captured);
+        }
+        else
+        {
+            coincidenceFell(1, captured);
+        }
     }
+#endif // DUAL_KEYBOARD
+#endif // CHANNEL_TIMESTAMPS
 
-    /* Reset timeout; end of keystroke read cycle */
+    /* Latch reset timeout or stuck strike deadline */
     if (CCF0)
     {
-        /* End of keystroke read cycle */
-        cap_in_prog = 0;
-        keystroke_error = 0;    /* Don't want error flag to carry to next cycle */
+        uint8_t now_H, now_L;
+
+        CCF0 = 0;   /* clear interrupt */
 
-        /* Clear the channel latch reset to make them available for next keystroke */
-        CHANNEL_LATCH_RST = 0;
+        /* Low byte can carry into the high byte between reads */
+        do
+        {
+            now_H = CH;
+            now_L = CL;
+        } while (now_H != CH);
 
-        CCAPM0 &= ~ECCF;    /* disable interrupt for this timer (activated at end of next keystroke cycle */
-        CCF0 = 0;           /* clear interrupt */
+        serviceTimeouts((now_H << 8) | now_L);
     }
 }
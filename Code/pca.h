@@ -3,8 +3,8 @@
  *                 PCA module. This exposes a number of flags and values for other
  *                 functions in this program to check and interpret as keystrokes
  *                 from the typewriter keyboard. These are driven / updated via PCA
- *                 module interrupts. cap_ready is set on update of these, and may
- *                 be cleared by external functions without interfering with operation.
+ *                 module interrupts, which queue up a capture record per keystroke
+ *                 for the main loop to pull off with nextCapture().
  *
  * Tristan Lennertz
  * SDCC Toolchain for AT89C51RC2
@@ -17,21 +17,79 @@
 #include <mcs51reg.h>
 #include <stdint.h>
 
-/* Is set when a capture is complete and a keystroke interpretation call can be made */
-volatile extern __near uint8_t cap_ready;
-
-/* Flag that indicates whether channel A wavefront arrived first (= true) or channel
- * B did (= false) */
-volatile extern __near uint8_t channel_A_first_arrived;
-
-/* Initial wavefront polarity flags for both channels. 1 = initially positive,
- * 0 = initially negative */
-volatile extern __near uint8_t channel_A_polarity;
-volatile extern __near uint8_t channel_B_polarity;
-
-/* After cap_ready flag is set, this contains the difference in time-of-arrival of
- * the wavefronts of keyboard channels A & B */
-volatile extern __near uint16_t deltaTOA;
+#include "frames.h"
+#include "keystrokes.h"
+#include "perf.h"
+
+/* Number of keystroke captures that can be waiting on the main loop. Must be
+ * a power of 2. One slot is always left empty to tell full from empty */
+#define CAPTURE_QUEUE_SIZE (4)
+
+/* Everything captured about a single keystroke. All of it is latched by the PCA
+ * ISR at channel coincidence, so decoding it later gives the same result no matter
+ * how long the main loop takes to get to it */
+typedef struct
+{
+    uint8_t flags;      /* CAPTURE_FLAG_* bits (see frames.h): first arrival, polarities, shift */
+    uint16_t deltaTOA;  /* Difference in time-of-arrival of the wavefronts of channels A & B */
+    uint16_t time;      /* Timebase tick (see timer.h) at channel coincidence */
+    uint8_t seq;        /* Order of arrival among all input sources (see input_seq in serial.h) */
+    uint16_t wavefrontWidth;    /* PCA ticks WavefrontDetect was high, in pulse width mode (else 0) */
+    uint16_t coincidenceWidth;  /* PCA ticks ChannelCoincidence was high, in pulse width mode (else 0) */
+#ifdef PERF_PROBES
+    uint16_t coincidence;   /* PCA count at channel coincidence (see perf.h) */
+#endif
+} keystroke_capture_t;
+
+/* After a call to nextCapture(), this contains the capture being worked on */
+extern __near keystroke_capture_t capture;
+
+/* Number of captures thrown away because the queue was full */
+volatile extern __near uint8_t capture_overruns;
+
+/* Running counts of queued captures and of strikes that went wrong (a second
+ * wavefront detect before the coincidence, or a coincidence without one).
+ * Updated by the ISR, so use reportCaptureCounters() to read them consistently */
+volatile extern __near uint16_t capture_count;
+volatile extern __near uint16_t keystroke_errors;
+
+/* Number of strikes aborted because their coincidence never came (see
+ * STUCK_CAPTURE_TIMEOUT). Read with reportCaptureCounters() */
+volatile extern __near uint16_t stuck_captures;
+
+/* PCA ticks after its wavefront detect that a strike is given up on if its
+ * coincidence hasn't come, after which the latches are reset. Comfortably past
+ * the longest deltaTOA any key can have */
+#define STUCK_CAPTURE_TIMEOUT (MAX_DELTA_TOA * 2)
+
+/* Default number of PCA ticks the channel latches are held in reset after
+ * coincidence (should be after the keystroke's pulse train has settled) */
+#define PULSE_TRAIN_TIMEOUT (0x00F0)
+
+/* Current latch reset timeout, in PCA ticks. Change with setPulseTrainTimeout() */
+extern __near uint16_t pulse_train_timeout;
+
+/* Set when the wavefront detect and coincidence modules capture both edges, so
+ * each capture carries how long its pulses were high. A capture is then held back
+ * until its coincidence falls (or its latch reset is released, at the latest).
+ * Change with setPulseWidths().
+ * NOTE: With FINAL.PLD both signals come off of latches, so they only fall when
+ * the latch reset is set at coincidence. The widths then mostly measure the ISR
+ * getting to the coincidence, and only say something about the keystroke itself
+ * with glue logic that lets the signals follow the acoustics. Not available in a
+ * CHANNEL_TIMESTAMPS build, where the modules see each channel on its own */
+extern __near uint8_t pulse_widths;
+
+/* Returns true if there is a capture waiting in the queue */
+uint8_t captureReady();
+
+/* Returns the arrival sequence number of the oldest waiting capture.
+ * NOTE: Only valid if captureReady() */
+uint8_t nextCaptureSeq();
+
+/* Pulls the oldest waiting capture off of the queue into capture.
+ * NOTE: Only valid if captureReady() */
+void nextCapture();
 
 /* Initializes all of the pca_modules for their respective functions */
 void extern init_pca_modules();
@@ -42,9 +100,68 @@ void extern init_pca_modules();
  * - The difference in the time of arrival of both channels' wavefronts
  * This function isn't meant for user applications, but is good for profiling
  * the particular keyboard.
- * NOTE: Data is not valid unless cap_ready has been set */
+ * NOTE: Data is not valid until nextCapture() has been called */
 void reportKeystrokeStats();
 
+/* Prints the running capture counters */
+void reportCaptureCounters();
+
+/* Changes the time the channel latches are held in reset after coincidence.
+ * Takes effect at the next coincidence */
+void setPulseTrainTimeout(uint16_t ticks);
+
+/* Turns pulse width mode (see pulse_widths) on or off. Captures already held back
+ * for their widths are still queued, at their latch reset release at the latest */
+void setPulseWidths(uint8_t on);
+
+/* Sends the current capture to the host as a raw capture frame (see frames.h)
+ * so that the decoding can be done off of the MCU. In pulse width mode, a pulse
+ * width frame goes just ahead of it.
+ * NOTE: Data is not valid until nextCapture() has been called */
+void sendCaptureFrame();
+
+/* Sends the decoded keystroke to the host as a key event frame (see frames.h),
+ * timestamped relative to the previous key event frame.
+ * NOTE: Data is not valid until nextCapture() has been called */
+void sendEventFrame(uint8_t key);
+
+/* Uncomment for a board wired to serve two keyboards. The second keyboard's
+ * WavefrontDetect and ChannelCoincidence (see KEYBOARD2.PLD) go to CEX3 (P1.6)
+ * and CEX4 (P1.7), so the first keyboard's latch reset and B first latch move
+ * off of those pins onto P3.4 and P3.5 (unused, since Timers 0 and 1 are clocked
+ * internally). The second keyboard's latches are read through a buffer mapped
+ * at KEYBOARD2_LATCH_ADDR, and its latch reset is on P3.3.
+ * Both keyboards feed the same capture queue, with CAPTURE_FLAG_KEYBOARD2 set
+ * on the second one's captures. The raw capture and key event modes pass that
+ * on to the host, while the interactive modes take both as one input stream */
+// #define DUAL_KEYBOARD
+
+/* Uncomment for a board with CHANNELS.PLD in place of FINAL.PLD (and the same
+ * change made to KEYBOARD2.PLD). Each channel's wavefront then goes to its own
+ * capture module, channel A to CEX1 (P1.4) and channel B to CEX2 (P1.5), or CEX3
+ * and CEX4 on the second keyboard, and is timestamped on its own. deltaTOA and
+ * which channel was first come straight from the two timestamps, so the B first
+ * latch isn't read, and a strike that only ever sees one channel is counted
+ * against the one that didn't arrive (missing_channel) */
+// #define CHANNEL_TIMESTAMPS
+
+/* Number of keyboards the board is wired for */
+#ifdef DUAL_KEYBOARD
+#define KEYBOARDS_FITTED (2)
+#else
+#define KEYBOARDS_FITTED (1)
+#endif
+
+/* Channels, as indexes into missing_channel[] */
+#define CHANNEL_A (0)
+#define CHANNEL_B (1)
+
+#ifdef CHANNEL_TIMESTAMPS
+/* Of the stuck captures, how many were missing each channel's wavefront (only the
+ * other one arrived). Read with reportCaptureCounters() */
+volatile extern __near uint16_t missing_channel[2];
+#endif
+
 /* Mask to the channel A positive and negative wavefront latches. Located
  * at Port 1, Pins 0 & 1 currently */
 #define CHANNEL_A_LATCH_MASK (0x03)
@@ -59,6 +176,17 @@ void reportKeystrokeStats();
 /* Mask for individual channel B positive wavefront latch pin */
 #define CHANNEL_B_POS_MASK (0x04)
 
+/* WavefrontDetect and ChannelCoincidence, read in pulse width mode to tell which
+ * edge a capture was. They come in on CEX1 (P1.4) and CEX2 (P1.5) */
+#define WAVEFRONT_DETECT_PIN (P1_4)
+#define CHANNEL_COINCIDENCE_PIN (P1_5)
+
+/* Active-low signal indicating the CAPSLOCK or SHIFT keys are depressed on
+ * the keyboard. These keys close a physical switch that pulls the pin low */
+#define N_SHIFT_KEY (P3_2)
+
+#ifndef DUAL_KEYBOARD
+
 /* Pin that takes in the Q of the latch that indicates whether channel B's
  * wavefront arrived first (1 = B first, 0 = A first) */
 #define CHANNEL_B_FIRST_LATCH (P1_7)
@@ -66,6 +194,30 @@ void reportKeystrokeStats();
 /* Reset pin for the keyboard channel latches */
 #define CHANNEL_LATCH_RST (P1_6)
 
+#else
+
+#define CHANNEL_B_FIRST_LATCH (P3_5)
+#define CHANNEL_LATCH_RST (P3_4)
+
+/* Reset pin for the second keyboard's channel latches */
+#define KEYBOARD2_LATCH_RST (P3_3)
+
+/* Address the second keyboard's latches are read from. Reads anywhere in
+ * 0xC000-0xFFFF work, which the LCD decode in FINAL.PLD leaves free */
+#define KEYBOARD2_LATCH_ADDR (0xC000)
+
+/* Bits of the second keyboard's latch byte. The channel positive latches are
+ * at the same bits as the first keyboard's on Port 1 (CHANNEL_A_POS_MASK and
+ * CHANNEL_B_POS_MASK) */
+#define KEYBOARD2_B_FIRST_MASK (0x10)   /* 1 = B first, 0 = A first */
+#define KEYBOARD2_N_SHIFT_MASK (0x20)   /* Active low */
+
+/* Second keyboard's WavefrontDetect and ChannelCoincidence, on CEX3 and CEX4 */
+#define KEYBOARD2_WAVEFRONT_PIN (P1_6)
+#define KEYBOARD2_COINCIDENCE_PIN (P1_7)
+
+#endif // DUAL_KEYBOARD
+
 /* ISR for PCA module */
 void pca_isr(void) __critical __interrupt (6) __using (2);
 
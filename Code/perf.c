@@ -0,0 +1,272 @@
+/* perf.c
+ * Final Project - Performance Probes. The main loop's side of timing a keystroke
+ *                 through to the wire, the latency histograms, and the report. The
+ *                 ISRs' probes are all macros in perf.h.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "perf.h"
+
+#ifdef PERF_PROBES
+
+#include "pca.h"
+#include "serial.h"
+#include "timer.h"
+
+/* See perf.h */
+__idata perf_counter_t perf_counters[PERF_NUM_PROBES];
+__xdata perf_echo_t perf_echoes[PERF_ECHOES];
+__near uint8_t perf_echo_head;
+volatile __near uint8_t perf_echo_sent;
+__near uint8_t perf_echo_tail;
+__xdata uint8_t perf_tx_marks[TX_BUFFER_SIZE / 8];
+__near uint8_t perf_mark_next;
+__near uint8_t perf_mode;
+uint16_t perf_lookup_at;
+
+/* Keystrokes per latency bucket, for each mode. Saturate rather than wrap */
+static __xdata uint16_t perf_hist[PERF_NUM_MODES][PERF_HIST_BUCKETS];
+
+/* Echoes that couldn't be followed because too many were already on their way */
+static uint16_t perf_unfollowed;
+
+/* Wavefront of the keystroke last decoded, when it was decoded, and whether its
+ * echo is still to come */
+static uint16_t perf_wavefront_at;
+static uint16_t perf_wavefront_ms;
+static uint16_t perf_decoded_at;
+static uint16_t perf_decoded_ms;
+static uint8_t perf_echo_due;
+
+/* Names of the stages, in perf_counters[] order */
+static const char * const perf_names[PERF_NUM_PROBES] =
+{
+    "wavefront",
+    "coincidence",
+    "decode",
+    "echo",
+    "wire",
+    "falling",
+    "lookup",
+};
+
+/* Histogram column headings, in BOOT_MODE_* order */
+static const char * const perf_mode_names[PERF_NUM_MODES] =
+{
+    " normal",
+    "   diag",
+    "  coach",
+    "    raw",
+    "  event",
+    " editor",
+};
+
+/* Lower bound of each histogram bucket, for PERF_HIST_SHIFT at the PCA's rate */
+static const char * const perf_bucket_names[PERF_HIST_BUCKETS] =
+{
+    "     0", "  93us", " 185us", " 370us", " 741us", " 1.5ms", " 3.0ms", " 5.9ms",
+    "  12ms", "  24ms", "  47ms", "  95ms", " 190ms", " 379ms", " 758ms", "  1.5s",
+};
+
+/* Internal function declarations */
+uint32_t perfElapsed(uint16_t from, uint16_t from_ms, uint16_t to, uint16_t to_ms);
+uint8_t perfBucket(uint32_t ticks);
+
+/* Main loop has decoded the current capture */
+void perfDecoded()
+{
+    uint16_t now;
+
+    PERF_NOW(now);
+    perf_decoded_ms = getTicks();
+
+    if ((uint16_t)(perf_decoded_ms - capture.time) < PERF_WRAP_MS)
+        PERF_RECORD(PERF_DECODE, now - capture.coincidence);
+    else
+        PERF_RECORD(PERF_DECODE, 0xFFFF);
+
+    /* deltaTOA is how long before the coincidence the wavefront was */
+    perf_wavefront_at = capture.coincidence - capture.deltaTOA;
+    perf_wavefront_ms = capture.time;
+    perf_decoded_at = now;
+    perf_echo_due = 1;
+}
+
+/* putchar() is about to queue a byte. The first one after a decode is its echo,
+ * and is followed the rest of the way if there's room to */
+void perfQueued()
+{
+    uint8_t next_head = (perf_echo_head + 1) & (PERF_ECHOES - 1);
+    __xdata perf_echo_t *e;
+    uint16_t now, now_ms;
+
+    if (!perf_echo_due)
+        return;
+
+    perf_echo_due = 0;
+
+    PERF_NOW(now);
+    now_ms = getTicks();
+
+    if ((uint16_t)(now_ms - perf_decoded_ms) >= PERF_WRAP_MS)
+        return;
+
+    PERF_RECORD(PERF_ECHO, now - perf_decoded_at);
+
+    if (next_head == perf_echo_tail)
+    {
+        perf_unfollowed++;
+        return;
+    }
+
+    e = &perf_echoes[perf_echo_head];
+    e->wavefront = perf_wavefront_at;
+    e->wavefront_ms = perf_wavefront_ms;
+    e->echoed = now;
+    e->echoed_ms = now_ms;
+    e->mode = perf_mode;
+
+    perf_echo_head = next_head;
+    perf_mark_next = 1;
+}
+
+/* putchar() has handed its byte straight to the idle UART */
+void perfTxDirect()
+{
+    __xdata perf_echo_t *e;
+
+    if (!perf_mark_next)
+        return;
+
+    e = &perf_echoes[perf_echo_sent];
+    PERF_NOW(e->sent);
+    e->sent_ms = getTicks();
+
+    perf_echo_sent = (perf_echo_sent + 1) & (PERF_ECHOES - 1);
+    perf_mark_next = 0;
+}
+
+/* Counts the echoes that have gone out since the last pass */
+void perfService()
+{
+    __xdata perf_echo_t *e;
+    uint32_t ticks;
+    uint16_t *count;
+
+    while (perf_echo_tail != perf_echo_sent)
+    {
+        e = &perf_echoes[perf_echo_tail];
+
+        ticks = perfElapsed(e->echoed, e->echoed_ms, e->sent, e->sent_ms);
+        PERF_RECORD(PERF_WIRE, (ticks > 0xFFFF) ? 0xFFFF : ticks);
+
+        ticks = perfElapsed(e->wavefront, e->wavefront_ms, e->sent, e->sent_ms);
+        count = &perf_hist[e->mode][perfBucket(ticks)];
+        if (*count != 0xFFFF)
+            (*count)++;
+
+        perf_echo_tail = (perf_echo_tail + 1) & (PERF_ECHOES - 1);
+    }
+}
+
+/* Returns the PCA ticks between two points, each a PCA count and a timebase tick.
+ * Past a PCA count wrap, the timebase is the only one that can tell */
+uint32_t perfElapsed(uint16_t from, uint16_t from_ms, uint16_t to, uint16_t to_ms)
+{
+    uint16_t ms = to_ms - from_ms;
+
+    if (ms < PERF_WRAP_MS)
+        return (uint16_t)(to - from);
+
+    return (uint32_t)ms * PERF_PCA_TICKS_PER_MS;
+}
+
+/* Returns the histogram bucket for a latency in PCA ticks */
+uint8_t perfBucket(uint32_t ticks)
+{
+    uint8_t bucket = 0;
+
+    ticks >>= PERF_HIST_SHIFT;
+
+    while (ticks && bucket < PERF_HIST_BUCKETS - 1)
+    {
+        ticks >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void perfReport()
+{
+    static __xdata perf_counter_t counters[PERF_NUM_PROBES];
+    uint8_t i, m;
+
+    /* Every stage as of the same moment, then start over */
+    EA = 0;
+    memcpy(counters, perf_counters, sizeof(counters));
+    memset(perf_counters, 0, sizeof(perf_counters));
+    EA = 1;
+
+    putstr("\r\nStage times, in PCA ticks:\r\n");
+
+    for (i = 0; i < PERF_NUM_PROBES; i++)
+    {
+        if (!counters[i].count)
+        {
+            printf_small(" %s: no samples\r\n", perf_names[i]);
+            continue;
+        }
+
+        printf_small(" %s: %u samples, min %u, mean %u, max %u\r\n", perf_names[i],
+                     counters[i].count, counters[i].min,
+                     (uint16_t)(counters[i].sum / counters[i].count), counters[i].max);
+    }
+
+    /* One row per bucket anything landed in, one column per mode */
+    putstr("Wavefront to wire, keystrokes per bucket:\r\n  from");
+    for (m = 0; m < PERF_NUM_MODES; m++)
+        putstr((char *)perf_mode_names[m]);
+    putstr("\r\n");
+
+    for (i = 0; i < PERF_HIST_BUCKETS; i++)
+    {
+        for (m = 0; m < PERF_NUM_MODES && !perf_hist[m][i]; m++)
+            ;
+        if (m == PERF_NUM_MODES)
+            continue;
+
+        putstr((char *)perf_bucket_names[i]);
+
+        for (m = 0; m < PERF_NUM_MODES; m++)
+        {
+            uint16_t count = perf_hist[m][i];
+            uint16_t width;
+
+            /* Right aligned under the 7 character headings */
+            for (width = 10000; width > 1 && count < width; width /= 10)
+                putchar(' ');
+            printf_small("  %u", count);
+        }
+
+        putstr("\r\n");
+    }
+
+    if (perf_unfollowed)
+        printf_small("%u echoes not followed (too many on their way at once)\r\n", perf_unfollowed);
+
+    memset(perf_hist, 0, sizeof(perf_hist));
+    perf_unfollowed = 0;
+
+    putstr("Counters reset\r\n");
+}
+
+#endif // PERF_PROBES
@@ -0,0 +1,233 @@
+/* perf.h
+ * Final Project - Performance Probes. Times each keystroke through the stages it
+ *                 goes through on its way back out to the terminal, with the free
+ *                 running PCA count, and keeps the min, max and total time of each
+ *                 stage in counters in internal RAM:
+ *                   wavefront     Wavefront detect's capture to the ISR getting to it
+ *                   coincidence   Coincidence's capture to the ISR getting to it
+ *                   decode        Coincidence to the main loop decoding the keystroke
+ *                   echo          Decode to the first byte in response being queued
+ *                   wire          That byte queued to the UART starting to send it
+ *                   falling       ISR time spent on a falling edge, in pulse width
+ *                                 mode (see pulse_widths in pca.h), which is all
+ *                                 that mode adds to the ISR besides its extra entries
+ *                   lookup        Time spent in decodeKeystroke() itself: the table
+ *                                 lookups, tab type check, context stage and drift
+ *                                 tracking. Run with the "bigram" setting on and off
+ *                                 to see what the context stage costs
+ *                 All in PCA ticks. A decode or send more than a PCA count wrap
+ *                 (~23ms) late is counted as the longest there is. A keystroke
+ *                 with nothing queued within a wrap of its decode had no echo (e.g.
+ *                 <SHIFT>), so it isn't counted at all.
+ *
+ *                 The whole way through, from the wavefront to the echo going into
+ *                 SBUF, is also counted in a histogram per mode, in log2 buckets,
+ *                 to show the tail (and which mode's printing is behind it). Past a
+ *                 PCA count wrap that's measured with the timebase instead, so a
+ *                 spike of any length lands in the right bucket.
+ *
+ *                 Only built in with PERF_PROBES defined. Otherwise every probe is
+ *                 an empty macro, so a release build carries none of the code or
+ *                 RAM. <*> in normal mode (or "perf" from the host) prints and
+ *                 resets the counters and histograms.
+ *
+ *                 NOTE: No PERF_PROBES build has been run on the part yet, so
+ *                 there are no measured ISR, decode or echo timings to go on.
+ *                 Until there are, take any cost given for firmware code (the
+ *                 bigram stage, the ISR, pulse width mode, ...) as a count of
+ *                 work done, not time. Host/accuracy.sh only covers decoding
+ *                 accuracy.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+#include <stdint.h>
+
+#include "timer.h"
+#include "serial.h"
+#include "config.h"
+
+/* Uncomment for a build with the performance probes in it */
+// #define PERF_PROBES
+
+/* Stages timed, indexes into perf_counters[] */
+#define PERF_WAVEFRONT      (0)
+#define PERF_COINCIDENCE    (1)
+#define PERF_DECODE         (2)
+#define PERF_ECHO           (3)
+#define PERF_WIRE           (4)
+#define PERF_FALLING        (5)
+#define PERF_LOOKUP         (6)
+#define PERF_NUM_PROBES     (7)
+
+/* Timebase ticks (ms) the PCA count takes to wrap, less a little for safety */
+#define PERF_WRAP_MS        (22)
+
+/* PCA count rate, 11.0592MHz / 4 */
+#define PERF_PCA_TICKS_PER_MS   (2765)
+
+/* Latency histogram buckets. Bucket 0 is everything under 2^PERF_HIST_SHIFT PCA
+ * ticks (~93us), and each one after covers twice the time of the one before, up
+ * to the last, which takes everything from 2^(PERF_HIST_SHIFT + 14) (~1.5s) up */
+#define PERF_HIST_BUCKETS   (16)
+#define PERF_HIST_SHIFT     (8)
+
+/* A histogram for each mode, indexed by the BOOT_MODE_* that starts it */
+#define PERF_NUM_MODES      (BOOT_MODE_MAX + 1)
+
+/* Most echoes that can be on their way to the wire at once and still be followed.
+ * Must be a power of 2. One slot is always left empty to tell full from empty */
+#define PERF_ECHOES         (8)
+
+#ifdef PERF_PROBES
+
+/* Running counters of one stage. min is only meaningful once count isn't 0 */
+typedef struct
+{
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+    uint16_t count;     /* Stops counting (and summing) once it's full */
+} perf_counter_t;
+
+/* Each is only updated from one place (ISR or main loop), and read and reset
+ * by perfReport() with interrupts held off. They're 70 bytes, and with them in
+ * directly addressed RAM a PERF_PROBES build would need ~110 bytes of it (~120
+ * with DUAL_KEYBOARD) against the ~90 the four register banks leave. So they're
+ * in indirectly addressed RAM, which still needs no DPTR from an ISR */
+extern __idata perf_counter_t perf_counters[PERF_NUM_PROBES];
+
+/* An echo on its way to the wire. The main loop fills in where its keystroke
+ * started and when it was queued, and whoever hands it to the UART when that was */
+typedef struct
+{
+    uint16_t wavefront;     /* PCA count at the keystroke's wavefront detect */
+    uint16_t wavefront_ms;  /* Timebase tick at the keystroke's coincidence */
+    uint16_t echoed;        /* PCA count when the echo was queued */
+    uint16_t echoed_ms;
+    uint16_t sent;          /* PCA count when it went into SBUF */
+    uint16_t sent_ms;
+    uint8_t mode;           /* BOOT_MODE_* it was echoed in */
+} perf_echo_t;
+
+/* Echoes followed to the wire, in the order they were queued. Head is moved as
+ * they're queued and tail as they're counted, both by the main loop. Sent is
+ * moved as each is handed to the UART, which always happens in order */
+extern __xdata perf_echo_t perf_echoes[PERF_ECHOES];
+extern __near uint8_t perf_echo_head;
+extern volatile __near uint8_t perf_echo_sent;
+extern __near uint8_t perf_echo_tail;
+
+/* Bit per transmit buffer slot, set if the byte in it is an echo being followed */
+extern __xdata uint8_t perf_tx_marks[TX_BUFFER_SIZE / 8];
+
+/* Set when the next byte putchar() queues is an echo to follow */
+extern __near uint8_t perf_mark_next;
+
+/* BOOT_MODE_* the main loop is handling keystrokes in */
+extern __near uint8_t perf_mode;
+
+/* PCA count the lookup stage started at */
+extern uint16_t perf_lookup_at;
+
+/* Reads the PCA count into t. The low byte can carry into the high byte between reads */
+#define PERF_NOW(t) do { \
+        uint8_t perf_h_; \
+        do { perf_h_ = CH; (t) = ((uint16_t)perf_h_ << 8) | CL; } while (perf_h_ != CH); \
+    } while (0)
+
+/* Adds a time to a stage's counters. A macro, so a probe doesn't add a call of
+ * its own to the ISR (or ISR helper) it's in */
+#define PERF_RECORD(probe, ticks) do { \
+        uint16_t perf_t_ = (ticks); \
+        if (perf_counters[probe].count != 0xFFFF) \
+        { \
+            if (!perf_counters[probe].count || perf_t_ < perf_counters[probe].min) \
+                perf_counters[probe].min = perf_t_; \
+            if (perf_t_ > perf_counters[probe].max) \
+                perf_counters[probe].max = perf_t_; \
+            perf_counters[probe].sum += perf_t_; \
+            perf_counters[probe].count++; \
+        } \
+    } while (0)
+
+/* PCA ISR has got to a capture (PERF_WAVEFRONT or PERF_COINCIDENCE) latched at
+ * PCA count captured, or is done with a falling edge (PERF_FALLING) it started
+ * on at PCA count captured */
+#define PERF_ISR_PROBE(probe, captured) do { \
+        uint16_t perf_now_; \
+        PERF_NOW(perf_now_); \
+        PERF_RECORD(probe, perf_now_ - (captured)); \
+    } while (0)
+
+/* Main loop is handling keystrokes in mode (BOOT_MODE_*) */
+#define PERF_SET_MODE(mode)     (perf_mode = (mode))
+
+/* Main loop is about to decode the current capture, and is done decoding it.
+ * Everything between is timed as the lookup stage */
+#define PERF_LOOKUP_START()     PERF_NOW(perf_lookup_at)
+#define PERF_LOOKUP_END()       do { \
+        uint16_t perf_lookup_end_; \
+        PERF_NOW(perf_lookup_end_); \
+        PERF_RECORD(PERF_LOOKUP, perf_lookup_end_ - perf_lookup_at); \
+    } while (0)
+
+/* Main loop has decoded the current capture (see pca.h) */
+#define PERF_DECODED()          perfDecoded()
+
+/* putchar() is about to queue a byte */
+#define PERF_QUEUED()           perfQueued()
+
+/* putchar() has handed its byte straight to the idle UART, or into slot of the
+ * transmit buffer. Called with the UART interrupt off */
+#define PERF_TX_DIRECT()        perfTxDirect()
+#define PERF_TX_BUFFERED(slot)  do { if (perf_mark_next) { \
+        perf_tx_marks[(slot) >> 3] |= 1 << ((slot) & 7); perf_mark_next = 0; } } while (0)
+
+/* UART ISR is starting to send the byte from slot of the transmit buffer. The
+ * timebase can be read directly, since its ISR can't interrupt this one */
+#define PERF_TX_SENT(slot) do { \
+        if (perf_tx_marks[(slot) >> 3] & (1 << ((slot) & 7))) \
+        { \
+            __xdata perf_echo_t *perf_e_ = &perf_echoes[perf_echo_sent]; \
+            perf_tx_marks[(slot) >> 3] &= ~(1 << ((slot) & 7)); \
+            PERF_NOW(perf_e_->sent); \
+            perf_e_->sent_ms = timer_ticks; \
+            perf_echo_sent = (perf_echo_sent + 1) & (PERF_ECHOES - 1); \
+        } \
+    } while (0)
+
+/* Counts the echoes that have made it to the wire. Called every pass of the main loop */
+#define PERF_SERVICE()          perfService()
+
+void perfDecoded();
+void perfQueued();
+void perfTxDirect();
+void perfService();
+
+/* Prints every stage's count, min, mean and max and the latency histograms, then
+ * resets them all */
+void perfReport();
+
+#else
+
+#define PERF_ISR_PROBE(probe, captured)
+#define PERF_SET_MODE(mode)
+#define PERF_LOOKUP_START()
+#define PERF_LOOKUP_END()
+#define PERF_DECODED()
+#define PERF_QUEUED()
+#define PERF_TX_DIRECT()
+#define PERF_TX_BUFFERED(slot)
+#define PERF_TX_SENT(slot)
+#define PERF_SERVICE()
+
+#endif // PERF_PROBES
+
+#endif // PERF_H
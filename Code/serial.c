@@ -13,90 +13,209 @@
 #include <stdint.h>
 
 #include "serial.h"
+#include "timer.h"
 #include "pca.h"
 #include "keystrokes.h"
-
-/* Uncomment to specify terminal emulator "enter" keystrokes as only '\r' */
-#define ENTER_ONLY_CR
-
-/* Uncomment to enable the typewriter keyboard as getchar()'s source */
-#define USE_TYPEWRITER_KEYBOARD
+#include "journal.h"
+#include "perf.h"
+#include "control.h"
 
 /* Internal function declarations */
 unsigned char getFirstNum();
 unsigned char getFirstHexNum();
 int isNum(unsigned char c);
 int isHexNum(unsigned char c);
-int16_t hexstr_to_int(char *str);
-void getchar_echoAction(uint8_t c);
-
-/* The 9600 baud setup from AT89C51RC2 UART App Note */
-void init_serial()
+uint8_t hexstr_to_int(char *str, uint16_t *value);
+void kickOnProgress();
+
+/* See serial.h */
+volatile __near uint8_t input_seq;
+uint8_t input_source;
+uint8_t enter_only_cr;
+__near uint8_t rx_overruns;
+
+/* Receive buffer, filled by the ISR. Each byte's arrival stamp is kept alongside
+ * it. Head is only moved by the ISR and tail only by the main loop */
+static __xdata uint8_t rx_buffer[RX_BUFFER_SIZE];
+static __xdata uint8_t rx_seq[RX_BUFFER_SIZE];
+static volatile __near uint8_t rx_head;
+static volatile __near uint8_t rx_tail;
+
+/* Transmit buffer, drained by the ISR. Head is only moved by the main loop and
+ * tail only by the ISR */
+static __xdata uint8_t tx_buffer[TX_BUFFER_SIZE];
+static volatile __near uint8_t tx_head;
+static volatile __near uint8_t tx_tail;
+
+/* Set while the UART is shifting out a byte, so the ISR will be back for more */
+static volatile __near uint8_t tx_busy;
+
+/* Transmit buffer tail as of the last time kickOnProgress() kicked the watchdog */
+static uint8_t kicked_tail;
+
+/* The baud setup from AT89C51RC2 UART App Note. Falls back on DEFAULT_BAUD if
+ * the passed rate can't be generated */
+void init_serial(uint16_t baud)
 {
+    if (!baudIsValid(baud))
+        baud = DEFAULT_BAUD;
+
     PCON |= 0x00; /* Double the baud */
-    SCON = 0x52; /* UART in mode 1 (8 bit), REN=1 */
-    TMOD = 0x20 ; /* Timer 1 in mode 2 */
-    TH1 = 0xFD; /* 9600 Bds at 11.059MHz (19200 in X2) */
-    TL1 = 0xFD; /* 9600 Bds at 11.059MHz (19200 in X2) */
+    SCON = 0x50; /* UART in mode 1 (8 bit), REN=1, TI left clear as nothing's been sent */
+    TMOD = (TMOD & 0x0F) | 0x20; /* Timer 1 in mode 2, leave timer 0 alone */
+    TH1 = 256 - (BAUD_CLOCK / baud); /* 0xFD for 19200 in X2 at 11.059MHz */
+    TL1 = TH1;
+
+    enter_only_cr = 1;
+    rx_head = rx_tail = 0;
+    tx_head = tx_tail = 0;
+    tx_busy = 0;
+    rx_overruns = 0;
+    input_seq = 0;
+    input_source = INPUT_SRC_NONE;
 
     TR1 = 1; /* Timer 1 run */
+
+    ES = 1; /* Global enable is handled along with the PCA interrupt */
+}
+
+/* Returns true if the passed baud rate can be generated */
+uint8_t baudIsValid(uint16_t baud)
+{
+    return (baud != 0 && baud <= BAUD_CLOCK &&
+            (BAUD_CLOCK % baud) == 0 && (BAUD_CLOCK / baud) <= 255);
 }
 
 /* Returns true if a char can be received without blocking */
 int checkchar()
 {
-#ifdef USE_TYPEWRITER_KEYBOARD
-    return (cap_ready);
-#else
-    return (RI != 0);
-#endif // USE_TYPEWRITER_KEYBOARD
+    return (captureReady() || rx_head != rx_tail);
+}
+
+/* Returns the source (INPUT_SRC_*) that the next getchar() will take its
+ * character from, or INPUT_SRC_NONE if nothing is waiting */
+uint8_t nextInputSource()
+{
+    uint8_t typewriter_waiting = captureReady();
+    uint8_t serial_waiting = (rx_head != rx_tail);
+
+    if (typewriter_waiting && serial_waiting)
+    {
+        /* Both have something, so whichever was stamped first goes first. The
+         * signed difference handles the stamps wrapping around */
+        if ((int8_t)(nextCaptureSeq() - rx_seq[rx_tail]) < 0)
+            return INPUT_SRC_TYPEWRITER;
+        else
+            return INPUT_SRC_SERIAL;
+    }
+    else if (typewriter_waiting)
+    {
+        return INPUT_SRC_TYPEWRITER;
+    }
+    else if (serial_waiting)
+    {
+        return INPUT_SRC_SERIAL;
+    }
+
+    return INPUT_SRC_NONE;
 }
 
 /* Standard putchar, getchar, and putstr function implementations */
 void putchar(char c)
 {
-    /* wait for transmit flag to be set */
-    while (TI == 0)
+    uint8_t next_head = (tx_head + 1) & (TX_BUFFER_SIZE - 1);
+
+    /* wait for room in the transmit buffer. A long report draining at a slow
+     * baud rate isn't a hang, as long as the bytes keep going out */
+    while (next_head == tx_tail)
+    {
+        kickOnProgress();
+    }
+
+    PERF_QUEUED();
+
+    ES = 0;     /* Keep the ISR from finishing up a transfer halfway through this */
+
+    if (tx_busy)
     {
-        ; /*intentional */
+        PERF_TX_BUFFERED(tx_head);
+        tx_buffer[tx_head] = c; /* ISR will send it when the UART gets to it */
+        tx_head = next_head;
+    }
+    else
+    {
+        PERF_TX_DIRECT();
+        tx_busy = 1;
+        SBUF = c;               /* UART idle, so load transmit buffer directly */
     }
 
-    SBUF = c; /* load transmit buffer */
-    TI = 0; /* clear flag, allowing for next transfer */
+    ES = 1;
 }
 
 /* Normal getchar() operation, but also echos received char to terminal
  * (if it is a normal character). Can build in special terminal actions
  * to be taken on certain special characters from the beyboard as well. */
 char getchar()
+{
+    unsigned char landing_pad = getinput();
+
+    /* Implementation of automatic echoing of received characer */
+    getchar_echoAction(landing_pad);
+
+    return landing_pad;                 /* return buffer with read contents */
+}
+
+/* Same as getchar(), but without echoing the received character */
+uint8_t getinput()
 {
     unsigned char landing_pad;
 
-#ifdef USE_TYPEWRITER_KEYBOARD
-    /* Wait for data to become available from the typewriter */
-    while (!cap_ready)
+    /* Wait for data to become available from either source. Waiting on someone
+     * to type isn't a hang, as long as the output isn't stuck meanwhile */
+    while (!checkchar())
     {
-        ; /* intentional */
+        kickOnProgress();
     }
-    landing_pad = interpretKeystroke(channel_A_first_arrived,
-                                     channel_A_polarity,
-                                     deltaTOA);
-    cap_ready = 0;
-#else
-    /* Wait for receive flag to be set */
-    while (RI == 0)
+
+    input_source = nextInputSource();
+
+    if (input_source == INPUT_SRC_TYPEWRITER)
+    {
+        nextCapture();
+        journalCapture();
+        controlCapture();
+        PERF_LOOKUP_START();
+        landing_pad = decodeKeystroke(capture.flags, capture.deltaTOA);
+        PERF_LOOKUP_END();
+        PERF_DECODED();
+    }
+    else
     {
-        ; /* intentional */
+        landing_pad = rx_buffer[rx_tail]; /* Retrieve char from buffer */
+        rx_tail = (rx_tail + 1) & (RX_BUFFER_SIZE - 1);
     }
-    landing_pad = SBUF; /* Retrieve char from buffer */
 
-    RI = 0; /* clear for next read */
-#endif // USE_TYPEWRITER_KEYBOARD
+    return landing_pad;
+}
 
-    /* Implementation of automatic echoing of received characer */
-    getchar_echoAction(landing_pad);
+/* Kicks the watchdog while blocked waiting on the UART or the typist, but only
+ * if the transmit buffer is empty or has drained some since the last kick. The
+ * main loop is the only place it's kicked unconditionally, so a transmitter that
+ * has wedged (TI never coming) still gets the unit reset */
+void kickOnProgress()
+{
+    uint8_t tail = tx_tail;
 
-    return landing_pad;                 /* return buffer with read contents */
+    if (tail != kicked_tail || tail == tx_head)
+    {
+        kicked_tail = tail;
+        kickWatchdog();
+    }
+}
+
+uint8_t txFree()
+{
+    return (tx_tail - tx_head - 1) & (TX_BUFFER_SIZE - 1);
 }
 
 int putstr(char *str)
@@ -119,7 +238,7 @@ unsigned int acquire_number()
     unsigned char num_digits = 0;
 
     /* Acquire at least one char */
-    temp_buff[num_digits++] = getFirstHexNum();
+    temp_buff[num_digits++] = getFirstNum();
 
     while (num_digits < MAX_INPUT_DIGITS)
     {
@@ -155,7 +274,7 @@ uint16_t acquire_hex_number()
 {
     unsigned char c, temp_buff[MAX_INPUT_HEX_DIGITS + 1];
     unsigned char num_digits = 0;
-    int16_t conversion;
+    uint16_t conversion = 0;
 
     /* Acquire at least one char */
     temp_buff[num_digits++] = getFirstHexNum();
@@ -177,7 +296,7 @@ uint16_t acquire_hex_number()
         {
             printf_small("\r\nInvalid character entered during number input. Reenter full number.\r\n");
             num_digits = 0;
-            temp_buff[num_digits++] = getFirstNum();
+            temp_buff[num_digits++] = getFirstHexNum();
         }
     }
 
@@ -185,112 +304,44 @@ uint16_t acquire_hex_number()
     temp_buff[MAX_INPUT_HEX_DIGITS] = 0;
 
     /* Convert string to usable number and return */
-    conversion = hexstr_to_int(temp_buff);
-    if (conversion == -1)
+    if (!hexstr_to_int(temp_buff, &conversion))
         printf_small("\r\nSomething went wrong with hex conversion\r\n");
 
-    return ((uint16_t)conversion);
+    return conversion;
 }
 
-/* Converts the passed hex string to an integer, returning it (or -1 on invalid hex string */
-int16_t hexstr_to_int(char *str)
+/* Converts the passed hex string to an integer in value. Returns false on an
+ * invalid hex string, so that every 16 bit value (0xFFFF too) can come back */
+uint8_t hexstr_to_int(char *str, uint16_t *value)
 {
-    int16_t total = 0;
-    char numDigits = 0;
-    char i;
+    uint16_t total = 0;
 
-    /* Find end of string, to work backward from least significant digit */
-    while (*str++)
+    /* Work forward from the most significant digit, shifting up a digit each time */
+    while (*str)
     {
-        numDigits++;
-    }
-    str -= 2; /* Back track to just before null */
-
-    for (i = 0; numDigits > 0; numDigits--, i++)
-    {
-        int hexMagnitude = (1 << (4 * i)); /* Goes up by powers of 16 */
-
-        switch(*str)
-        {
-        case '0':
-            /* Digit does not add to total */
-            break;
-
-        case '1':
-            total += hexMagnitude;
-            break;
-
-        case '2':
-            total += hexMagnitude * 2;
-            break;
-
-        case '3':
-            total += hexMagnitude * 3;
-            break;
+        int8_t digit = hexDigitValue(*str++);
 
-        case '4':
-            total += hexMagnitude * 4;
-            break;
+        if (digit < 0)
+            return 0;   /* invalid digit, return error */
 
-        case '5':
-            total += hexMagnitude * 5;
-            break;
-
-        case '6':
-            total += hexMagnitude * 6;
-            break;
-
-        case '7':
-            total += hexMagnitude * 7;
-            break;
-
-        case '8':
-            total += hexMagnitude * 8;
-            break;
-
-        case '9':
-            total += hexMagnitude * 9;
-            break;
-
-        case 'a':
-        case 'A':
-            total += hexMagnitude * 10;
-            break;
-
-        case 'b':
-        case 'B':
-            total += hexMagnitude * 11;
-            break;
-
-        case 'c':
-        case 'C':
-            total += hexMagnitude * 12;
-            break;
-
-        case 'd':
-        case 'D':
-            total += hexMagnitude * 13;
-            break;
-
-        case 'e':
-        case 'E':
-            total += hexMagnitude * 14;
-            break;
-
-        case 'f':
-        case 'F':
-            total += hexMagnitude * 15;
-            break;
-
-        default:
-            /* invalid digit, return error */
-            return -1;
-        }
-
-        str--;
+        total = (total << 4) | digit;
     }
 
-    return total;
+    *value = total;
+    return 1;
+}
+
+/* Returns the value (0-15) of the passed hex digit char, or -1 if it isn't one */
+int8_t hexDigitValue(unsigned char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    else if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    return -1;
 }
 
 /* Ensures that a number digit char is received, returning it */
@@ -326,9 +377,7 @@ int isNum(unsigned char c)
 /* Returns true if input char is a hex digit, false otherwise */
 int isHexNum(unsigned char c)
 {
-    return ((c >= '0' && c <= '9')  ||
-            (c >= 'A' && c <= 'F')  ||
-            (c >= 'a' && c <= 'f')      );
+    return (hexDigitValue(c) >= 0);
 }
 
 char *acquire_string()
@@ -386,10 +435,48 @@ void getchar_echoAction(uint8_t landing_pad)
             break;
     }
 
-#ifdef ENTER_ONLY_CR
-    if (landing_pad == '\r')            /* Echo additional linefeed for terminal */
+    if (enter_only_cr && landing_pad == '\r')  /* Echo additional linefeed for terminal */
     {
         putchar('\n');
     }
-#endif
+}
+
+/* UART ISR - Moves received bytes into the receive buffer and feeds the
+ * transmitter from the transmit buffer. Uses register bank 3 so as not to
+ * collide with the other ISRs */
+void serial_isr(void) __interrupt (4) __using (3)
+{
+    if (RI)
+    {
+        uint8_t next_head = (rx_head + 1) & (RX_BUFFER_SIZE - 1);
+
+        if (next_head != rx_tail)
+        {
+            rx_buffer[rx_head] = SBUF;
+            rx_seq[rx_head] = input_seq++;
+            rx_head = next_head;
+        }
+        else
+        {
+            rx_overruns++;  /* Main loop fell too far behind, byte is lost */
+        }
+
+        RI = 0;
+    }
+
+    if (TI)
+    {
+        TI = 0;
+
+        if (tx_head != tx_tail)
+        {
+            PERF_TX_SENT(tx_tail);
+            SBUF = tx_buffer[tx_tail];
+            tx_tail = (tx_tail + 1) & (TX_BUFFER_SIZE - 1);
+        }
+        else
+        {
+            tx_busy = 0;    /* Nothing left to send */
+        }
+    }
 }
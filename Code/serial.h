@@ -19,17 +19,71 @@
 /* Size of an allocated buffer dedicated to receiving strings */
 #define STRING_BUFFER_SIZE  (128)
 
+/* Sizes of the interrupt-driven UART receive and transmit buffers. Must be
+ * powers of 2. One slot of each is always left empty to tell full from empty */
+#define RX_BUFFER_SIZE  (16)
+#define TX_BUFFER_SIZE  (64)
+
+/* Sources that getchar() can return input from (see input_source) */
+#define INPUT_SRC_NONE          (0)
+#define INPUT_SRC_TYPEWRITER    (1)
+#define INPUT_SRC_SERIAL        (2)
+
+/* Arrival counter shared by the PCA and serial ISRs. Each keystroke capture and
+ * each received UART byte is stamped with the next value, which is how input
+ * from the two sources is merged back together in the order it arrived.
+ * Both ISRs run at the same priority, so they never interrupt each other's update */
+volatile extern __near uint8_t input_seq;
+
+/* Source (INPUT_SRC_*) of the character most recently returned by getchar() */
+extern uint8_t input_source;
+
+/* Number of received UART bytes thrown away because the buffer was full */
+extern __near uint8_t rx_overruns;
+
+/* Timer 1 overflow rate in X2 mode (11.0592MHz / 192). Any baud rate that
+ * divides evenly into this (and not more than 255 times) can be generated */
+#define BAUD_CLOCK      (57600)
+#define DEFAULT_BAUD    (19200)
+
+/* When set, the host terminal's "enter" key only sends '\r', so a '\n' is
+ * echoed after it */
+extern uint8_t enter_only_cr;
+
 /* Initializes serial communication using timer 1 for baud rate */
-void init_serial();
+void init_serial(uint16_t baud);
+
+/* Returns true if the passed baud rate can be generated */
+uint8_t baudIsValid(uint16_t baud);
 
 /* Returns true if a getchar() call will not block, false otherwise */
 int checkchar();
 
-/* Standard putchar, getchar, and putstr implementations */
+/* Returns the source (INPUT_SRC_*) that the next getchar() will take its
+ * character from, or INPUT_SRC_NONE if nothing is waiting */
+uint8_t nextInputSource();
+
+/* Standard putchar, getchar, and putstr implementations. getchar() takes
+ * typewriter keystrokes and host serial bytes in the order they arrived.
+ * putchar() only blocks if the transmit buffer is full */
 void putchar(char c);
 char getchar();
 int putstr(char *str);
 
+/* Same as getchar(), but without echoing the received character. Typewriter
+ * keystrokes are journaled here (see journal.h) */
+uint8_t getinput();
+
+/* Returns how many bytes putchar() can take right now without waiting */
+uint8_t txFree();
+
+/* Echoes a received character the way getchar() does, for input taken with
+ * getinput() that's to be echoed later */
+void getchar_echoAction(uint8_t c);
+
+/* ISR for the UART */
+void serial_isr(void) __interrupt (4) __using (3);
+
 /* Polls the serial input for incoming number chars and converts them
  * into int to return. Rejects bad inputs and prompts for redos */
 unsigned int acquire_number();
@@ -38,6 +92,9 @@ unsigned int acquire_number();
  * into int to return. Rejects bad inputs and prompts for redos */
 uint16_t acquire_hex_number();
 
+/* Returns the value (0-15) of the passed hex digit char, or -1 if it isn't one */
+int8_t hexDigitValue(unsigned char c);
+
 /* Acquires a string from serial terminal and returns pointer to an
  * allocated buffer of the acquired string */
 char *acquire_string();
@@ -0,0 +1,467 @@
+/* shell.c
+ * Final Project - Non-blocking command shell for the host side of the serial
+ *                 port. Bytes are fed in one at a time from the main loop as they
+ *                 arrive, and numbers are parsed as their digits come in, so the
+ *                 shell never waits on input and keystroke servicing never stalls.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "shell.h"
+#include "serial.h"
+#include "pca.h"
+#include "config.h"
+#include "keystrokes.h"
+#include "xmodem.h"
+#include "macro.h"
+#include "perf.h"
+
+/* States of the token currently being received */
+#define TOKEN_NONE      (0)     /* Between tokens */
+#define TOKEN_WORD      (1)
+#define TOKEN_NUMBER    (2)
+
+/* Most words on a line (command plus setting name) */
+#define MAX_WORDS       (2)
+
+/* Returned by shellLookupSetting() for an unknown name (config keys start at 1) */
+#define SETTING_NONE    (0)
+
+/* Internal function declarations */
+void shellEndToken();
+void shellExecute();
+uint8_t shellLookupSetting(char *name);
+void shellHelp();
+void shellStats();
+void shellDrift();
+void shellKeyName(uint8_t key);
+void shellGet(uint8_t setting);
+void shellSet(uint8_t setting, uint16_t value);
+void shellExport(char *name);
+
+/* Words received so far on the current line */
+static char words[MAX_WORDS][SHELL_WORD_SIZE + 1];
+static uint8_t num_words;
+
+/* Number on the current line, accumulated digit by digit as it arrives */
+static uint16_t number;
+static uint8_t have_number;
+static uint8_t number_hex;
+static uint8_t number_digits;
+
+/* State of the token being received, its length so far, and whether anything
+ * on the line was malformed (too long, bad digit, overflow, extra tokens) */
+static uint8_t token_state;
+static uint8_t word_len;
+static uint8_t line_error;
+
+/* Resets the shell to the start of an empty line */
+void init_shell()
+{
+    num_words = 0;
+    have_number = 0;
+    token_state = TOKEN_NONE;
+    line_error = 0;
+}
+
+/* Feeds the next received byte to the shell. A carriage return or line feed
+ * runs the command on the line so far */
+void shellInput(uint8_t c)
+{
+    if (c == '\r' || c == '\n')
+    {
+        shellEndToken();
+
+        if (line_error)
+            putstr("\r\nerror: bad command line\r\n");
+        else if (num_words)
+            shellExecute();
+
+        init_shell();
+        return;
+    }
+
+    if (c == ' ' || c == '\t')
+    {
+        shellEndToken();
+        return;
+    }
+
+    /* Once a line has gone bad, just wait for it to end */
+    if (line_error)
+        return;
+
+    if (token_state == TOKEN_NONE)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            if (have_number)
+            {
+                line_error = 1;     /* Only one number per line */
+                return;
+            }
+
+            token_state = TOKEN_NUMBER;
+            number = 0;
+            number_hex = 0;
+            number_digits = 0;
+        }
+        else
+        {
+            if (num_words >= MAX_WORDS || have_number)
+            {
+                line_error = 1;     /* Words come before the number */
+                return;
+            }
+
+            token_state = TOKEN_WORD;
+            word_len = 0;
+        }
+    }
+
+    if (token_state == TOKEN_WORD)
+    {
+        if (word_len >= SHELL_WORD_SIZE)
+        {
+            line_error = 1;
+            return;
+        }
+
+        /* Lowercase so commands aren't case sensitive */
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        words[num_words][word_len++] = c;
+    }
+    else /* TOKEN_NUMBER */
+    {
+        int8_t digit = hexDigitValue(c);
+
+        /* "0x" switches the number over to hex */
+        if (!number_hex && number_digits == 1 && number == 0 && (c == 'x' || c == 'X'))
+        {
+            number_hex = 1;
+            number_digits = 0;
+            return;
+        }
+
+        if (digit < 0 || (!number_hex && digit > 9))
+        {
+            line_error = 1;
+            return;
+        }
+
+        /* Fold the digit in, catching anything that won't fit in 16 bits */
+        if (number_hex)
+        {
+            if (number & 0xF000)
+            {
+                line_error = 1;
+                return;
+            }
+
+            number = (number << 4) | digit;
+        }
+        else
+        {
+            if (number > 6553 || (number == 6553 && digit > 5))
+            {
+                line_error = 1;
+                return;
+            }
+
+            number = (number * 10) + digit;
+        }
+
+        number_digits++;
+    }
+}
+
+/* Finishes off the token being received, if any */
+void shellEndToken()
+{
+    if (token_state == TOKEN_WORD)
+    {
+        words[num_words++][word_len] = 0;
+    }
+    else if (token_state == TOKEN_NUMBER)
+    {
+        if (number_digits == 0)
+            line_error = 1;     /* "0x" with nothing after it */
+        else
+            have_number = 1;
+    }
+
+    token_state = TOKEN_NONE;
+}
+
+/* Runs the command on the completed line */
+void shellExecute()
+{
+    uint8_t setting = SETTING_NONE;
+
+    /* The only command whose second word isn't a setting */
+    if (!strcmp(words[0], "export") && num_words == 2 && !have_number)
+    {
+        shellExport(words[1]);
+        return;
+    }
+
+    if (num_words > 1)
+    {
+        setting = shellLookupSetting(words[1]);
+
+        if (setting == SETTING_NONE)
+        {
+            putstr("\r\nerror: unknown setting\r\n");
+            return;
+        }
+    }
+
+    if (!strcmp(words[0], "help") && num_words == 1 && !have_number)
+    {
+        shellHelp();
+    }
+    else if (!strcmp(words[0], "stats") && num_words == 1 && !have_number)
+    {
+        shellStats();
+    }
+    else if (!strcmp(words[0], "drift") && num_words == 1 && !have_number)
+    {
+        shellDrift();
+    }
+#ifdef PERF_PROBES
+    else if (!strcmp(words[0], "perf") && num_words == 1 && !have_number)
+    {
+        perfReport();
+    }
+#endif
+    else if (!strcmp(words[0], "get") && num_words == 2 && !have_number)
+    {
+        shellGet(setting);
+    }
+    else if (!strcmp(words[0], "set") && num_words == 2 && have_number)
+    {
+        shellSet(setting, number);
+    }
+    else
+    {
+        putstr("\r\nerror: unknown command (try help)\r\n");
+    }
+}
+
+/* Returns the config key (see config.h) matching the passed name, or SETTING_NONE */
+uint8_t shellLookupSetting(char *name)
+{
+    if (!strcmp(name, "baud"))
+        return CONFIG_BAUD;
+    else if (!strcmp(name, "timeout"))
+        return CONFIG_TIMEOUT;
+    else if (!strcmp(name, "bootmode"))
+        return CONFIG_BOOT_MODE;
+    else if (!strcmp(name, "entercr"))
+        return CONFIG_ENTER_CR;
+    else if (!strcmp(name, "bigram"))
+        return CONFIG_BIGRAM;
+    else if (!strcmp(name, "keymap"))
+        return CONFIG_KEYMAP;
+    else if (!strcmp(name, "macros"))
+        return CONFIG_MACROS;
+    else if (!strcmp(name, "pulsewidths"))
+        return CONFIG_PULSE_WIDTHS;
+    else if (!strcmp(name, "drift"))
+        return CONFIG_DRIFT;
+
+    return SETTING_NONE;
+}
+
+void shellHelp()
+{
+    uint8_t i;
+
+    putstr("\r\nCommands:\r\n");
+    putstr(" help - Display this list\r\n");
+    putstr(" stats - Display capture and serial counters\r\n");
+    putstr(" drift - Display the timing drift tracked for each key\r\n");
+#ifdef PERF_PROBES
+    putstr(" perf - Display and reset the performance counters\r\n");
+#endif
+    putstr(" get <name> - Display a setting\r\n");
+    putstr(" set <name> <value> - Change a setting (decimal or 0x hex)\r\n");
+    putstr(" export <doc|journal> - Send the document or keystroke journal by XMODEM\r\n");
+    putstr("Settings:\r\n");
+    putstr(" baud - UART baud rate (on next reset)\r\n");
+    putstr(" timeout - Latch reset timeout, in PCA ticks\r\n");
+    putstr(" bootmode - 0 normal, 1 diagnostic, 2 typist, 3 raw, 4 event, 5 editor (on next reset)\r\n");
+    putstr(" entercr - 1 if the terminal's enter key only sends a CR\r\n");
+    putstr(" bigram - 1 to resolve bucket edge keystrokes by context\r\n");
+    putstr(" keymap - Typewriter model to decode with:");
+    for (i = 0; i < num_keymaps; i++)
+        printf_small(" %u %s", i, keymaps[i]->name);
+    putstr("\r\n");
+    printf_small(" macros - 1 to expand the %u abbreviations built in\r\n", num_macros);
+    putstr(" pulsewidths - 1 to capture both edges and measure pulse widths\r\n");
+    putstr(" drift - 1 to move bucket edges to follow timing drift (set to start over)\r\n");
+#ifdef CONFIG_USE_EEPROM
+    putstr("Settings are saved automatically\r\n");
+#else
+    putstr("Settings last until the next reset (no data EEPROM, see config.h)\r\n");
+#endif
+}
+
+void shellStats()
+{
+    putstr("\r\n");
+    reportCaptureCounters();
+    printf_small("Serial receive overruns: %u\r\n", rx_overruns);
+    printf_small("Macro queue overruns: %u\r\n", macro_overruns);
+    printf_small("Tab type mismatches: %u\r\n", tab_type_mismatches);
+    printf_small("Tab type corrections: %u\r\n", tab_type_corrections);
+    printf_small("Keys changed by context: %u\r\n", context_changes);
+}
+
+/* Lists every bucket that has tracked keystrokes with its keys, how far off its
+ * middle they've been landing, and how far its lower edge has moved */
+void shellDrift()
+{
+    const keymap_t *km = keymaps[active_keymap];
+    uint8_t side, bucket, moved = 0;
+    int8_t furthest = 0;
+
+    printf_small("\r\nDrift tracking: %s\r\n", drift_enabled ? "on" : "off");
+
+    for (side = 0; side < 2; side++)
+    {
+        printf_small("%c side:\r\n", 'A' + side);
+
+        for (bucket = 0; bucket < drift_num_buckets[side]; bucket++)
+        {
+            __xdata drift_bucket_t *b = &drift_buckets[side][bucket];
+            int8_t shift = driftEdgeShift(side, bucket);
+            uint16_t mean;
+
+            if (shift)
+                moved++;
+            if ((shift < 0 ? -shift : shift) > (furthest < 0 ? -furthest : furthest))
+                furthest = shift;
+
+            if (!b->samples)
+                continue;
+
+            /* The bucket's type A/C key, and its type B key if it's a pair */
+            putstr(" ");
+            shellKeyName(km->tables[side * 2][b->start]);
+            if (km->tables[side * 2 + 1][b->start] != km->tables[side * 2][b->start])
+            {
+                putstr("/");
+                shellKeyName(km->tables[side * 2 + 1][b->start]);
+            }
+
+            mean = (b->mean < 0) ? -b->mean : b->mean;
+            printf_small(": %c%u.%u ticks over %u keystrokes, edge %d\r\n",
+                         (b->mean < 0) ? '-' : '+', mean >> DRIFT_FRAC_BITS,
+                         ((mean & (DRIFT_ONE - 1)) * 10) >> DRIFT_FRAC_BITS,
+                         b->samples, shift);
+        }
+    }
+
+    printf_small("Edges moved: %u, furthest %d ticks (limit %u)\r\n",
+                 moved, furthest, DRIFT_LIMIT);
+    printf_small("Keystrokes decoded across a moved edge: %u\r\n", drift_moves);
+}
+
+/* Prints a decoded key: the character if it's printable, or else its code */
+void shellKeyName(uint8_t key)
+{
+    if (key > ' ' && key < 0x7F)
+        putchar(key);
+    else if (key == ' ')
+        putstr("space");
+    else
+        printf_small("0x%x", key);
+}
+
+void shellGet(uint8_t setting)
+{
+    printf_small("\r\n%s = %u\r\n", words[1], configGet(setting));
+}
+
+/* Changes the setting in the config store (which saves it), then puts it into
+ * effect if it can be without a reset */
+void shellSet(uint8_t setting, uint16_t value)
+{
+    if (!configSet(setting, value))
+    {
+        putstr("\r\nerror: bad value\r\n");
+        return;
+    }
+
+    settingApply(setting, value);
+    shellGet(setting);
+}
+
+/* Puts a changed setting into effect, if it can be without a reset */
+void settingApply(uint8_t setting, uint16_t value)
+{
+    switch (setting)
+    {
+    case CONFIG_TIMEOUT:
+        setPulseTrainTimeout(value);
+        break;
+
+    case CONFIG_ENTER_CR:
+        enter_only_cr = value;
+        break;
+
+    case CONFIG_BIGRAM:
+        bigram_enabled = value;
+        break;
+
+    case CONFIG_KEYMAP:
+        active_keymap = value;
+        driftReset();
+        break;
+
+    case CONFIG_DRIFT:
+        drift_enabled = value;
+        driftReset();
+        break;
+
+    case CONFIG_MACROS:
+        macros_enabled = value;
+        break;
+
+    case CONFIG_PULSE_WIDTHS:
+        setPulseWidths(value);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Starts an XMODEM export of the named thing (see xmodem.h) */
+void shellExport(char *name)
+{
+    uint8_t source;
+
+    if (!strcmp(name, "doc"))
+        source = XMODEM_SRC_DOC;
+    else if (!strcmp(name, "journal"))
+        source = XMODEM_SRC_JOURNAL;
+    else
+    {
+        putstr("\r\nerror: can export doc or journal\r\n");
+        return;
+    }
+
+    putstr("\r\nStart the XMODEM receiver (<TAB CLEAR> on the typewriter cancels)\r\n");
+    xmodemStart(source);
+}
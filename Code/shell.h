@@ -0,0 +1,56 @@
+/* shell.h
+ * Final Project - Non-blocking command shell for the host side of the serial
+ *                 port. Bytes are fed in one at a time from the main loop as they
+ *                 arrive, and numbers are parsed as their digits come in, so the
+ *                 shell never waits on input and keystroke servicing never stalls.
+ *
+ *                 Commands (one per line, words separated by spaces):
+ *                   help                - List the commands
+ *                   stats               - Print capture and serial counters
+ *                   drift               - Print the timing drift tracked for each
+ *                                         bucket, and how far its edge has moved
+ *                   perf                - Print and reset the performance counters,
+ *                                         in a PERF_PROBES build (perf.h)
+ *                   get <name>          - Print a setting
+ *                   set <name> <value>  - Change a setting. Values are decimal,
+ *                                         or hex with a leading 0x
+ *                   export <doc|journal> - Send the editor's document or the
+ *                                         keystroke journal by XMODEM (xmodem.h)
+ *
+ *                 Settings (saved on ED2/ID2 parts only, see config.h):
+ *                   baud                - UART baud rate, on next reset
+ *                   timeout             - Latch reset timeout after coincidence, in PCA ticks
+ *                   bootmode            - Mode to start in (BOOT_MODE_*), on next reset
+ *                   entercr             - Echo a '\n' after a '\r' from the host
+ *                   bigram              - Resolve bucket edge keystrokes by context
+ *                   keymap              - Typewriter model to decode with (keystrokes.h)
+ *                   macros              - Expand abbreviations as they're typed (macro.h)
+ *                   pulsewidths         - Capture both edges for pulse widths (pca.h)
+ *                   drift               - Move bucket edges to follow timing drift
+ *                                         (keystrokes.h). Setting it starts over
+ *
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <stdint.h>
+
+/* Longest command or setting name accepted, not including the null */
+#define SHELL_WORD_SIZE (11)    /* "pulsewidths" */
+
+/* Resets the shell to the start of an empty line */
+void init_shell();
+
+/* Feeds the next received byte to the shell. A carriage return or line feed
+ * runs the command on the line so far */
+void shellInput(uint8_t c);
+
+/* Puts a setting already changed in the config store into effect, if it can be
+ * without a reset. Shared with the binary control protocol (control.h) */
+void settingApply(uint8_t setting, uint16_t value);
+
+#endif // SHELL_H
@@ -0,0 +1,71 @@
+/* timer.c
+ * Final Project - Free-running millisecond timebase driven by Timer 0. Gives
+ *                 the rest of the program a way to timestamp events that outlives
+ *                 the PCA counter (which wraps every ~24ms). Also looks after the
+ *                 hardware watchdog.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+#include <stdint.h>
+
+#include "timer.h"
+
+/* See timer.h */
+volatile __near uint16_t timer_ticks;
+
+/* Sets up Timer 0 as a 1ms tick and starts it running */
+void init_timer()
+{
+    timer_ticks = 0;
+
+    TMOD = (TMOD & 0xF0) | 0x01;    /* Timer 0 in mode 1 (16 bit), leave timer 1 alone */
+    TH0 = TICK_RELOAD_H;
+    TL0 = TICK_RELOAD_L;
+
+    ET0 = 1;    /* Global enable is handled along with the PCA interrupt */
+    TR0 = 1;
+}
+
+/* Returns the current tick count. Safe to call outside of interrupt context */
+uint16_t getTicks()
+{
+    uint16_t ticks;
+
+    /* Two byte read can't be interrupted by an update halfway through */
+    ET0 = 0;
+    ticks = timer_ticks;
+    ET0 = 1;
+
+    return ticks;
+}
+
+/* Starts the hardware watchdog */
+void init_watchdog()
+{
+    WDTPRG = (WDTPRG & 0xF8) | WATCHDOG_PERIOD;
+    kickWatchdog();     /* First reset sequence starts it */
+}
+
+/* Restarts the watchdog's count */
+void kickWatchdog()
+{
+    /* Has to be this exact sequence, back to back */
+    WDTRST = 0x1E;
+    WDTRST = 0xE1;
+}
+
+/* Timer 0 ISR - Reloads for the next millisecond. Uses register bank 1 so as
+ * not to collide with the PCA ISR */
+void timer0_isr(void) __interrupt (1) __using (1)
+{
+    TR0 = 0;
+    TH0 = TICK_RELOAD_H;
+    TL0 = TICK_RELOAD_L;
+    TR0 = 1;
+
+    timer_ticks++;
+}
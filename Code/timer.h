@@ -0,0 +1,49 @@
+/* timer.h
+ * Final Project - Free-running millisecond timebase driven by Timer 0. Gives
+ *                 the rest of the program a way to timestamp events that outlives
+ *                 the PCA counter (which wraps every ~24ms). Also looks after the
+ *                 hardware watchdog.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+#include <stdint.h>
+
+/* Timer 0 reload for a 1ms overflow. In X2 mode the timer counts at
+ * 11.0592MHz / 6 = 1.8432MHz, so 1843 counts per millisecond */
+#define TICK_RELOAD_H   (0xF8)
+#define TICK_RELOAD_L   (0xCD)
+
+/* Milliseconds since init_timer() was called. Wraps every ~65 seconds, so only
+ * differences between two reads are meaningful. Use getTicks() to read it
+ * outside of an interrupt */
+volatile extern __near uint16_t timer_ticks;
+
+/* Sets up Timer 0 as a 1ms tick and starts it running */
+void init_timer();
+
+/* Returns the current tick count. Safe to call outside of interrupt context */
+uint16_t getTicks();
+
+/* Watchdog period select (WDTPRG S2:S0). 7 gives 2^21 machine cycles, a bit
+ * over a second in X2 mode */
+#define WATCHDOG_PERIOD (0x07)
+
+/* Starts the hardware watchdog. Once started it can't be stopped, and resets
+ * the MCU unless kickWatchdog() is called more often than its period */
+void init_watchdog();
+
+/* Restarts the watchdog's count. Called every pass of the main loop, so the
+ * unit comes back on its own if it ever hangs */
+void kickWatchdog();
+
+/* ISR for Timer 0 overflow */
+void timer0_isr(void) __interrupt (1) __using (1);
+
+#endif // TIMER_H
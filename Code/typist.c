@@ -15,6 +15,8 @@
 #include "keystrokes.h"
 #include "typist.h"
 #include "serial.h"
+#include "timer.h"
+#include "drill.h"
 
 /* Internal Function Declarations */
 uint8_t * randomCoachString();
@@ -29,15 +31,30 @@ static uint8_t typedChars;
  * advancing */
 static uint8_t *currChar;
 
+/* Tick count of the last correct keystroke, for timing how long each key takes.
+ * Not valid until the first correct keystroke of a coach string */
+static uint16_t lastHitTime;
+static uint8_t lastHitValid;
+
+/* Toggled every coach string. Drills go in on every other one, quotes between */
+static uint8_t drillTurn;
+
 /* Takes the input keystroke character and compares it to the
  * current character the typist should be matching. If the typist does not match
  * the correct character, a backspace will be applied to keep them from advancing
  * (and internally the program keeps its pointer on the same character in the
- * coaching string */
+ * coaching string. Every keystroke is also counted against the key the typist
+ * should have hit, for the drills (see drill.h) */
 void coachKeystroke(uint8_t keystroke)
 {
     if (keystroke == *currChar)
     {
+        uint16_t now = getTicks();
+
+        drillRecordKey(keystroke, 1, lastHitValid ? (now - lastHitTime) : 0);
+        lastHitTime = now;
+        lastHitValid = 1;
+
         /* Advance to next char in the coach string and add to the number of correct
          * input chars */
         typedChars++;
@@ -50,7 +67,10 @@ void coachKeystroke(uint8_t keystroke)
         else if (keystroke == BACKSPACE_CODE || keystroke == CORRECT_CODE)
             putchar(*(currChar - 1));   /* If a delete or backspace was made, replace the character lost */
         else if (keystroke != SHIFT_CODE)
+        {
+            drillRecordKey(*currChar, 0, 0);
             putchar(BACKSPACE_CODE);    /* Put cursor over incorrect character to be overwritten next time */
+        }
     }
 
     /* Check for reaching the end of the current coach string. Need to formfeed and
@@ -62,18 +82,33 @@ void coachKeystroke(uint8_t keystroke)
 }
 
 /* Clears the display and outputs a new coach string for the operator to match
- * Sets currChar to the beginning of the new coach string */
+ * Sets currChar to the beginning of the new coach string. Every other string is
+ * a drill on the typist's weak keys, once there are any */
 void newCoachString()
 {
-    uint8_t *newString = randomCoachString();
+    uint8_t *newString = 0;
+
+    drillTurn ^= 1;
+    if (drillTurn)
+        newString = drillTake();
 
     putchar(FORM_FEED_CODE);        /* Clears the current terminal display */
-    putstr("TYPE LIKE THE DICKENS\r\n\r\n");
+
+    if (newString)
+    {
+        putstr("DRILL THOSE WEAK KEYS\r\n\r\n");
+    }
+    else
+    {
+        newString = randomCoachString();
+        putstr("TYPE LIKE THE DICKENS\r\n\r\n");
+    }
 
     putstr(newString);              /* Display new coach string and create soem whitespace */
     putstr("\r\n\r\n");
 
     currChar = newString;
+    lastHitValid = 0;
 }
 
 /* Returns a (pseudo) random coaching string */
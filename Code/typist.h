@@ -16,7 +16,8 @@ void newCoachString();
  * the correct character, a backspace will be applied to keep them from advancing
  * (and internally the program keeps its pointer on the same character in the
  * coaching string. Otherwise, advances the current character. Calls newCoachString
- * if it advances to the end of the current coach string */
+ * if it advances to the end of the current coach string. Misses and the time
+ * between correct keystrokes are counted per key for the drills (see drill.h) */
 void coachKeystroke(uint8_t keystroke);
 
 /* == Below is the database of strings that the typing coach pulls from == */
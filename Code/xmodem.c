@@ -0,0 +1,328 @@
+/* xmodem.c
+ * Final Project - XMODEM-CRC Export. Sends the editor's document or the
+ *                 keystroke journal to the host as an XMODEM transfer, a transmit
+ *                 buffer's worth at a time from the main loop.
+ *
+ *                 Blocks are never copied anywhere: each byte is read straight out
+ *                 of the source as it's sent (and read again if the block has to
+ *                 be resent), with the CRC worked out along the way. The length
+ *                 of the source is fixed when the transfer starts, and the journal
+ *                 is held still until it's over.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#include <at89c51ed2.h>
+#include <mcs51reg.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "xmodem.h"
+#include "serial.h"
+#include "timer.h"
+#include "editor.h"
+#include "journal.h"
+
+/* States of the transfer */
+#define XM_WAIT_START   (0)     /* Waiting for the receiver to ask for the first block */
+#define XM_SEND_BLOCK   (1)     /* Block partway out */
+#define XM_WAIT_ACK     (2)     /* Block out, waiting to hear how it went */
+#define XM_WAIT_EOT     (3)     /* EOT out, waiting for it to be acknowledged */
+
+/* Bytes in a block around its data: start, number, inverted number */
+#define XM_HEADER_SIZE  (3)
+
+/* See xmodem.h */
+uint8_t xmodem_active;
+
+static uint8_t xm_state;
+static uint8_t xm_source;
+static uint8_t xm_crc_mode;
+static uint8_t xm_cans;
+
+/* Source length at the start of the transfer */
+static uint16_t xm_length;
+
+/* Current block: its number, where its data starts in the source, how much data
+ * it carries, how much of it (header and all) has been sent, and how many times
+ * it's been sent */
+static uint8_t xm_block_num;
+static uint16_t xm_block_start;
+static uint16_t xm_block_size;
+static uint16_t xm_sent;
+static uint8_t xm_tries;
+
+static uint16_t xm_crc;
+static uint8_t xm_sum;
+
+/* Tick count that the current wait started at */
+static uint16_t xm_wait_start;
+
+/* Totals for the report at the end */
+static uint16_t xm_blocks;
+static uint16_t xm_resent;
+
+/* Internal Function Declarations */
+uint8_t xmodemSourceByte(uint16_t pos);
+void xmodemNextBlock();
+void xmodemResend();
+void xmodemSendEOT();
+void xmodemFinish(uint8_t ok);
+uint16_t crc16Update(uint16_t crc, uint8_t c);
+
+void xmodemStart(uint8_t source)
+{
+    xm_source = source;
+
+    if (source == XMODEM_SRC_JOURNAL)
+    {
+        journal_hold = 1;
+        xm_length = journalLength();
+    }
+    else
+    {
+        xm_length = editorLength();
+    }
+
+    xm_block_num = 1;
+    xm_block_start = 0;
+    xm_block_size = 0;
+    xm_blocks = 0;
+    xm_resent = 0;
+    xm_cans = 0;
+
+    xm_state = XM_WAIT_START;
+    xm_wait_start = getTicks();
+    xmodem_active = 1;
+}
+
+void xmodemInput(uint8_t c)
+{
+    /* Two CANs in a row from the receiver calls it off */
+    if (c == XMODEM_CAN)
+    {
+        if (++xm_cans >= 2)
+            xmodemFinish(0);
+        return;
+    }
+    xm_cans = 0;
+
+    switch (xm_state)
+    {
+    case XM_WAIT_START:
+        if (c == XMODEM_CRC_START || c == XMODEM_NAK)
+        {
+            xm_crc_mode = (c == XMODEM_CRC_START);
+            xm_block_size = 0;
+            xmodemNextBlock();
+        }
+        break;
+
+    case XM_WAIT_ACK:
+        if (c == XMODEM_ACK)
+        {
+            xm_blocks++;
+            xm_block_num++;
+            xm_block_start += xm_block_size;
+            xmodemNextBlock();
+        }
+        else if (c == XMODEM_NAK)
+        {
+            xmodemResend();
+        }
+        break;
+
+    case XM_WAIT_EOT:
+        if (c == XMODEM_ACK)
+            xmodemFinish(1);
+        else if (c == XMODEM_NAK)
+            xmodemSendEOT();
+        break;
+
+    default:
+        /* Leftover 'C's from the receiver starting up, etc. */
+        break;
+    }
+}
+
+void xmodemService()
+{
+    uint16_t frame_size;
+    uint8_t room, c;
+
+    switch (xm_state)
+    {
+    case XM_WAIT_START:
+        if ((uint16_t)(getTicks() - xm_wait_start) > XMODEM_START_TIMEOUT)
+            xmodemFinish(0);
+        break;
+
+    case XM_SEND_BLOCK:
+        frame_size = XM_HEADER_SIZE + xm_block_size + (xm_crc_mode ? 2 : 1);
+
+        /* Only as much as the transmit buffer has room for, so this never waits */
+        for (room = txFree(); room && xm_sent < frame_size; room--, xm_sent++)
+        {
+            if (xm_sent == 0)
+            {
+                c = (xm_block_size == XMODEM_BLOCK_1K) ? XMODEM_STX : XMODEM_SOH;
+                xm_crc = 0;
+                xm_sum = 0;
+            }
+            else if (xm_sent == 1)
+            {
+                c = xm_block_num;
+            }
+            else if (xm_sent == 2)
+            {
+                c = ~xm_block_num;
+            }
+            else if (xm_sent < XM_HEADER_SIZE + xm_block_size)
+            {
+                uint16_t pos = xm_block_start + (xm_sent - XM_HEADER_SIZE);
+
+                c = (pos < xm_length) ? xmodemSourceByte(pos) : XMODEM_PAD;
+                xm_crc = crc16Update(xm_crc, c);
+                xm_sum += c;
+            }
+            else if (!xm_crc_mode)
+            {
+                c = xm_sum;
+            }
+            else if (xm_sent == XM_HEADER_SIZE + xm_block_size)
+            {
+                c = xm_crc >> 8;
+            }
+            else
+            {
+                c = xm_crc & 0xFF;
+            }
+
+            putchar(c);
+        }
+
+        if (xm_sent == frame_size)
+        {
+            xm_state = XM_WAIT_ACK;
+            xm_wait_start = getTicks();
+        }
+        break;
+
+    case XM_WAIT_ACK:
+        if ((uint16_t)(getTicks() - xm_wait_start) > XMODEM_ACK_TIMEOUT)
+            xmodemResend();
+        break;
+
+    case XM_WAIT_EOT:
+        if ((uint16_t)(getTicks() - xm_wait_start) > XMODEM_ACK_TIMEOUT)
+            xmodemSendEOT();
+        break;
+
+    default:
+        break;
+    }
+}
+
+void xmodemCancel()
+{
+    uint8_t i;
+
+    for (i = 0; i < 3; i++)
+        putchar(XMODEM_CAN);
+
+    xmodemFinish(0);
+}
+
+/* Returns byte pos of the source being exported */
+uint8_t xmodemSourceByte(uint16_t pos)
+{
+    if (xm_source == XMODEM_SRC_JOURNAL)
+        return journalRead(pos);
+
+    return editorRead(pos);
+}
+
+/* Starts sending the block at xm_block_start, or the EOT if there's nothing left.
+ * 1k blocks are used while there's enough left to mostly fill one */
+void xmodemNextBlock()
+{
+    uint16_t left = xm_length - xm_block_start;
+
+    xm_tries = 0;
+
+    if (xm_block_start >= xm_length)
+    {
+        xmodemSendEOT();
+        return;
+    }
+
+    if (xm_crc_mode && left > XMODEM_BLOCK_1K - XMODEM_BLOCK_SIZE)
+        xm_block_size = XMODEM_BLOCK_1K;
+    else
+        xm_block_size = XMODEM_BLOCK_SIZE;
+
+    xmodemResend();
+}
+
+/* Sends the current block again from the top, unless it's been tried too often */
+void xmodemResend()
+{
+    if (xm_tries++ >= XMODEM_MAX_TRIES)
+    {
+        xmodemCancel();
+        return;
+    }
+
+    if (xm_tries > 1)
+        xm_resent++;
+
+    xm_sent = 0;
+    xm_state = XM_SEND_BLOCK;
+}
+
+/* Sends the end of transfer, unless it's been tried too often */
+void xmodemSendEOT()
+{
+    if (xm_tries++ >= XMODEM_MAX_TRIES)
+    {
+        xmodemFinish(0);
+        return;
+    }
+
+    putchar(XMODEM_EOT);
+    xm_state = XM_WAIT_EOT;
+    xm_wait_start = getTicks();
+}
+
+/* Ends the transfer and reports how it went */
+void xmodemFinish(uint8_t ok)
+{
+    xmodem_active = 0;
+    journal_hold = 0;
+
+    if (ok)
+        printf_small("\r\nExport done: %u bytes in %u blocks, %u resent\r\n", xm_length, xm_blocks, xm_resent);
+    else
+        putstr("\r\nExport cancelled\r\n");
+}
+
+/* One byte of the CRC-16 XMODEM uses (polynomial 0x1021, starting from 0). Bitwise
+ * to keep the code small, and it's plenty fast for the baud rate */
+uint16_t crc16Update(uint16_t crc, uint8_t c)
+{
+    uint8_t i;
+
+    crc ^= (uint16_t)c << 8;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (crc & 0x8000)
+            crc = (crc << 1) ^ 0x1021;
+        else
+            crc <<= 1;
+    }
+
+    return crc;
+}
@@ -0,0 +1,70 @@
+/* xmodem.h
+ * Final Project - XMODEM-CRC Export. Sends the editor's document or the
+ *                 keystroke journal to the host as an XMODEM transfer (1k blocks,
+ *                 CRC-16, with the 128 byte blocks and 8-bit checksum of plain
+ *                 XMODEM used too if the receiver asks for them), so a bad block
+ *                 is all that ever has to be sent again. Runs from the main loop
+ *                 a transmit buffer's worth at a time, so keystrokes are still
+ *                 taken (and journaled) all the way through.
+ *
+ *                 Started from the host shell with "export doc" or "export
+ *                 journal", after which the host's XMODEM receiver (e.g. "rx"
+ *                 from lrzsz, or Host/xmrecv) has a minute to start. <TAB CLEAR>
+ *                 from the typewriter cancels.
+ *
+ *                 The protocol bytes and sizes are shared with Host/xmrecv, so this
+ *                 header must not pull in anything specific to the MCU.
+ * Tristan Lennertz
+ *
+ * SDCC Toolchain for AT89C51RC2
+ */
+
+#ifndef XMODEM_H
+#define XMODEM_H
+
+#include <stdint.h>
+
+/* Things that can be exported */
+#define XMODEM_SRC_DOC      (0)     /* The editor's document (editor.h) */
+#define XMODEM_SRC_JOURNAL  (1)     /* The keystroke journal (journal.h) */
+
+/* Protocol bytes */
+#define XMODEM_SOH          (0x01)  /* Starts a 128 byte block */
+#define XMODEM_STX          (0x02)  /* Starts a 1k block */
+#define XMODEM_EOT          (0x04)
+#define XMODEM_ACK          (0x06)
+#define XMODEM_NAK          (0x15)
+#define XMODEM_CAN          (0x18)
+#define XMODEM_CRC_START    ('C')   /* Receiver asking for CRC-16 blocks */
+#define XMODEM_PAD          (0x1A)  /* Fills out the last block */
+
+#define XMODEM_BLOCK_SIZE   (128)
+#define XMODEM_BLOCK_1K     (1024)
+
+/* How long the receiver has to start, and to answer each block (ms) */
+#define XMODEM_START_TIMEOUT    (60000)
+#define XMODEM_ACK_TIMEOUT      (10000)
+
+/* Times a block (or the EOT) is sent before giving up */
+#define XMODEM_MAX_TRIES    (10)
+
+/* Set while a transfer is running. The serial port belongs to the transfer
+ * then, so nothing else may be printed */
+extern uint8_t xmodem_active;
+
+/* Starts exporting the passed XMODEM_SRC_* */
+void xmodemStart(uint8_t source);
+
+/* Feeds the transfer a byte received from the host */
+void xmodemInput(uint8_t c);
+
+/* Moves the transfer along: sends as much of the current block as fits in the
+ * transmit buffer without waiting, and handles timeouts. Called every pass of
+ * the main loop while xmodem_active is set. Prints the outcome once the
+ * transfer is over */
+void xmodemService();
+
+/* Cancels the transfer */
+void xmodemCancel();
+
+#endif // XMODEM_H
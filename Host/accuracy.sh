@@ -0,0 +1,97 @@
+#!/bin/bash
+# accuracy.sh
+# Final Project - Decoding accuracy runs. Builds capgen and keydecoded, types a
+#                 text through capgen at each jitter level, decodes the trace
+#                 with keydecoded, and counts the keys that came back as typed.
+#                 This is where the accuracy figures for the decode pipeline
+#                 (tab type check, bigram context stage, drift tracking) come
+#                 from, so they can be rerun after any change to it.
+#
+#                 One line is printed per jitter level:
+#                     jitter drift keys correct percent context tab drift
+#                 where context, tab and drift are the keys keydecoded reports
+#                 changed by context, moved by tab type and moved by drift.
+#                 Keys are compared position by position, so a dropped or extra
+#                 key counts every key after it as wrong, as it would a reader.
+#
+#                 Only the host side is measured here. Nothing in this runs the
+#                 firmware, so it says nothing about ISR or main loop timing;
+#                 see PERF_PROBES in perf.h for that.
+#
+#                 Usage: ./accuracy.sh [-i text] [-n repeats] [-j "jitter levels"]
+#                                      [-g drift] [-S seed] [-K keymap] [-c]
+#
+#                 The defaults repeat the built in text to 3440 keys and run
+#                 jitter 2 to 5 with seed 7 and no drift. -c turns the context
+#                 stage off (keydecoded -c), for comparing with it on.
+#
+# Tristan Lennertz
+#
+# Bash, GCC Toolchain for Linux
+
+set -e
+
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+CODE_DIR="$HOST_DIR/../Code"
+
+TEXT="the quick brown fox jumps over the lazy dog, pack my box with five dozen liquor jugs. "
+REPEATS=40
+JITTERS="2 3 4 5"
+DRIFT=0
+SEED=7
+KEYMAP=
+CONTEXT=
+
+while getopts "i:n:j:g:S:K:ch" opt; do
+    case $opt in
+        i) TEXT=$(cat "$OPTARG") ;;
+        n) REPEATS=$OPTARG ;;
+        j) JITTERS=$OPTARG ;;
+        g) DRIFT=$OPTARG ;;
+        S) SEED=$OPTARG ;;
+        K) KEYMAP=$OPTARG ;;
+        c) CONTEXT=-c ;;
+        *) sed -n 's/^#                 Usage: //p' "$0" >&2; exit 1 ;;
+    esac
+done
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Same build lines as in the tools' headers
+DECODER="$CODE_DIR/keystrokes.c $CODE_DIR/keymaps.c $CODE_DIR/bigram.c"
+gcc -O2 -Wall -I"$CODE_DIR" -o "$WORK/capgen" "$HOST_DIR/capgen.c" $DECODER -lm
+gcc -O2 -Wall -I"$CODE_DIR" -o "$WORK/keydecoded" "$HOST_DIR/keydecoded.c" $DECODER
+
+# One of keydecoded's exit counters, by its description
+counted()
+{
+    sed -n "s/.* \([0-9]*\) $1.*/\1/p" "$WORK/stats.txt"
+}
+
+for ((i = 0; i < REPEATS; i++)); do
+    printf '%s' "$TEXT"
+done > "$WORK/text.txt"
+
+printf '%-7s %-6s %-6s %-8s %-8s %-8s %-6s %s\n' \
+       jitter drift keys correct percent context tab drift
+
+for j in $JITTERS; do
+    "$WORK/capgen" -i "$WORK/text.txt" -w "$WORK/trace.bin" -x "$WORK/expected.txt" \
+                   -j "$j" -g "$DRIFT" -S "$SEED" ${KEYMAP:+-K "$KEYMAP"} 2> /dev/null
+
+    # Text is the third field of each batch line, with \xNN escapes
+    "$WORK/keydecoded" -d "$WORK/trace.bin" ${KEYMAP:+-K "$KEYMAP"} $CONTEXT \
+        2> "$WORK/stats.txt" | cut -f 3- | tr -d '\n' > "$WORK/escaped.txt"
+    printf '%b' "$(cat "$WORK/escaped.txt")" > "$WORK/decoded.txt"
+
+    keys=$(wc -c < "$WORK/expected.txt")
+    wrong=$(cmp -l "$WORK/expected.txt" "$WORK/decoded.txt" 2> /dev/null | wc -l)
+    short=$((keys - $(wc -c < "$WORK/decoded.txt")))
+    [ $short -gt 0 ] && wrong=$((wrong + short))
+    correct=$((keys - wrong))
+
+    printf '%-7s %-6s %-6s %-8s %-8s %-8s %-6s %s\n' "$j" "$DRIFT" "$keys" "$correct" \
+           "$(awk -v c=$correct -v k=$keys 'BEGIN { printf "%.2f", 100 * c / k }')" \
+           "$(counted 'changed by context')" "$(counted 'moved by tab type')" "$(counted 'moved by drift')"
+done
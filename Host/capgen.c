@@ -0,0 +1,467 @@
+/* capgen.c
+ * Final Project - Synthetic keystroke capture generator. Turns text into the
+ *                 captures a typewriter would produce typing it, using the same
+ *                 lookup tables as the firmware (keymaps.c) run backwards, so
+ *                 the decoders can be driven at rates no typist can manage.
+ *
+ *                 Each key is struck at the middle of its deltaTOA bucket, then
+ *                 roughed up by the options below:
+ *                     -j  Gaussian jitter on deltaTOA (standard deviation, PCA ticks)
+ *                     -g  drift of every deltaTOA, in PCA ticks per 1000 keys, as
+ *                         the bar warms up over a long session
+ *                     -e  chance of an echo retrigger after a strike
+ *                     -s  Gaussian spread on how far SHIFT leads a shifted key (ms).
+ *                         A shift that lands after the strike's coincidence is missed
+ *
+ *                 Output (-F) is one of:
+ *                     frames  Raw capture frames, as the firmware sends in raw capture
+ *                             mode. Can be fed straight to keydecoded, and with -p
+ *                             is written in real time at the key rate (e.g. into a pty)
+ *                     stim    Channel wavefront arrivals and SHIFT switch changes, one
+ *                             per line as "<microseconds> <event>", where event is
+ *                             A+, A-, B+, B-, SHIFT 1 or SHIFT 0. For driving the
+ *                             latch inputs in the simulator
+ *                 The text the decoders should produce is written to -x, if given.
+ *
+ *                 Build: gcc -O2 -Wall -I../Code -o capgen capgen.c \
+ *                            ../Code/keystrokes.c ../Code/keymaps.c ../Code/bigram.c -lm
+ *
+ *                 Usage: capgen [-i text] [-w out] [-x expected] [-F frames|stim]
+ *                               [-r keys/sec] [-j ticks] [-g ticks] [-e prob]
+ *                               [-s ms] [-k 1|2] [-S seed] [-T pca Hz] [-p]
+ *                               [-K keymap]
+ *
+ *                 -K picks the typewriter model (by name or index, as the
+ *                 firmware's "keymap" setting) to type on, instead of the first.
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "keystrokes.h"
+#include "frames.h"
+
+/* PCA count rate. 11.0592MHz crystal with the PCA left out of X2 mode, and the
+ * PCA clocked at PeriphClock / 2 (see init_pca_modules()) */
+#define PCA_TICK_HZ             (2764800.0)
+#define TICKS_TO_US(t)          ((t) * 1000000.0 / pca_tick_hz)
+
+#define DEFAULT_RATE            (10.0)      /* Keys per second */
+#define SHIFT_LEAD_MS           (40.0)      /* SHIFT goes down this long before the strike */
+#define SHIFT_HOLD_MS           (20.0)      /* and comes up this long after it */
+#define ECHO_DELAY_MS           (2.0)       /* Echo retrigger, after the latch reset */
+
+/* Flags of the eight lookup tables, in the order interpretKeystroke() picks them */
+#define NUM_TABLES              (8)
+
+/* Where each character can be found in the tables */
+struct key_location
+{
+    uint8_t found;
+    uint8_t flags;
+    uint16_t dTOA;      /* Middle of the key's bucket */
+};
+
+/* One strike on the keyboard */
+struct strike
+{
+    double start_us;    /* First wavefront arrives */
+    double end_us;      /* Second wavefront arrives (coincidence) */
+    uint8_t flags;
+    uint16_t dTOA;
+    int shifted;        /* Typed with SHIFT, whether or not it made it in time */
+    double shift_us;    /* SHIFT goes down, for shifted keys */
+    int echo;           /* Not a real key; an echo retriggering the latches */
+};
+
+/* One line of stim output */
+struct stim_event
+{
+    double t_us;
+    char text[12];
+};
+
+static struct key_location locations[256];
+
+/* PCA count rate the stimulus is timed for. Can be changed (-T) to match a
+ * simulator that doesn't clock the PCA like the hardware does */
+static double pca_tick_hz = PCA_TICK_HZ;
+
+/* Internal function declarations */
+static void usage(const char *prog);
+static int find_keymap(const char *name);
+static void build_locations(void);
+static double gaussian(double sigma);
+static double uniform(void);
+static void emit_frame(FILE *out, const struct strike *s, uint16_t dTOA);
+static void add_stim(struct stim_event *ev, size_t *n, const struct strike *s);
+static int by_end(const void *a, const void *b);
+static int by_time(const void *a, const void *b);
+static void pace_until(double t_us, const struct timespec *t0);
+
+int main(int argc, char **argv)
+{
+    const char *in_path = NULL, *out_path = NULL, *expected_path = NULL;
+    const char *format = "frames";
+    double rate = DEFAULT_RATE, jitter = 0, echo_prob = 0, shift_sigma = 0;
+    double drift = 0;
+    int keyboard = 1, pace = 0, opt, c, km;
+    unsigned seed = 1;
+    FILE *in = stdin, *out = stdout, *expected = NULL;
+    struct strike *strikes = NULL;
+    size_t n = 0, cap = 0, i, skipped = 0, missed_shifts = 0;
+    double t = 0;
+
+    while ((opt = getopt(argc, argv, "i:w:x:F:r:j:g:e:s:k:S:T:K:ph")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i': in_path = optarg; break;
+        case 'w': out_path = optarg; break;
+        case 'x': expected_path = optarg; break;
+        case 'F': format = optarg; break;
+        case 'r': rate = atof(optarg); break;
+        case 'j': jitter = atof(optarg); break;
+        case 'g': drift = atof(optarg); break;
+        case 'e': echo_prob = atof(optarg); break;
+        case 's': shift_sigma = atof(optarg); break;
+        case 'k': keyboard = atoi(optarg); break;
+        case 'S': seed = strtoul(optarg, NULL, 0); break;
+        case 'T': pca_tick_hz = atof(optarg); break;
+        case 'p': pace = 1; break;
+        case 'K':
+            if ((km = find_keymap(optarg)) < 0)
+            {
+                fprintf(stderr, "unknown keymap '%s'\n", optarg);
+                return 2;
+            }
+            active_keymap = km;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (rate <= 0 || pca_tick_hz <= 0 || (keyboard != 1 && keyboard != 2) ||
+        (strcmp(format, "frames") && strcmp(format, "stim")))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (in_path && !(in = fopen(in_path, "r")))
+    {
+        perror(in_path);
+        return 1;
+    }
+
+    if (out_path && !(out = fopen(out_path, "wb")))
+    {
+        perror(out_path);
+        return 1;
+    }
+
+    if (expected_path && !(expected = fopen(expected_path, "wb")))
+    {
+        perror(expected_path);
+        return 1;
+    }
+
+    srand(seed);
+    build_locations();
+
+    /* Lay out the strikes in time */
+    while ((c = fgetc(in)) != EOF)
+    {
+        struct key_location *loc;
+        struct strike *s;
+        double dTOA;
+
+        /* The carriage return is what the typewriter has for ending a line */
+        if (c == '\n')
+            c = LEFT_MARGIN_CODE;
+
+        loc = &locations[c];
+        if (!loc->found)
+        {
+            skipped++;
+            continue;
+        }
+
+        if (n + 2 > cap)
+        {
+            cap = cap ? cap * 2 : 256;
+            if (!(strikes = realloc(strikes, cap * sizeof(*strikes))))
+            {
+                perror("realloc");
+                return 1;
+            }
+        }
+
+        s = &strikes[n++];
+
+        if (n > 1)
+            t += 1000000.0 / rate;
+
+        /* Timing drifts as the bar warms up, moving every key the same way */
+        dTOA = loc->dTOA + gaussian(jitter) + drift * (n - 1) / 1000.0;
+        if (dTOA < 0)
+            dTOA = 0;
+
+        s->start_us = t;
+        s->dTOA = (uint16_t)(dTOA + 0.5);
+        s->end_us = t + TICKS_TO_US(s->dTOA);
+        s->flags = loc->flags;
+        s->shifted = (loc->flags & CAPTURE_FLAG_SHIFT) != 0;
+        s->echo = 0;
+
+        if (keyboard == 2)
+            s->flags |= CAPTURE_FLAG_KEYBOARD2;
+
+        /* A shift pressed too late isn't down yet at coincidence */
+        s->shift_us = t - (SHIFT_LEAD_MS + gaussian(shift_sigma)) * 1000.0;
+        if ((s->flags & CAPTURE_FLAG_SHIFT) && s->shift_us > s->end_us)
+        {
+            s->flags &= ~CAPTURE_FLAG_SHIFT;
+            missed_shifts++;
+        }
+
+        if (expected)
+            fputc(c, expected);
+
+        /* The bar rings on after a strike, and can trip the latches again once
+         * they come out of reset */
+        if (uniform() < echo_prob)
+        {
+            struct strike *e = &strikes[n++];
+
+            e->start_us = s->end_us + ECHO_DELAY_MS * 1000.0;
+            e->dTOA = (uint16_t)(uniform() * KEYSTROKE_LUT_SIZE * 3);
+            e->end_us = e->start_us + TICKS_TO_US(e->dTOA);
+            e->flags = (uint8_t)(rand() & (CAPTURE_FLAG_A_FIRST | CAPTURE_FLAG_A_POS | CAPTURE_FLAG_B_POS)) |
+                       (s->flags & CAPTURE_FLAG_KEYBOARD2);
+            e->shifted = 0;
+            e->echo = 1;
+        }
+    }
+
+    if (!strcmp(format, "stim"))
+    {
+        /* Up to four lines per strike */
+        struct stim_event *ev = malloc((n * 4 + 1) * sizeof(*ev));
+        size_t n_ev = 0;
+
+        for (i = 0; i < n; i++)
+            add_stim(ev, &n_ev, &strikes[i]);
+
+        qsort(ev, n_ev, sizeof(*ev), by_time);
+
+        for (i = 0; i < n_ev; i++)
+            fprintf(out, "%.3f %s\n", ev[i].t_us, ev[i].text);
+
+        free(ev);
+    }
+    else
+    {
+        /* The wavefront latches hold until the latch reset (FINAL.PLD), so a
+         * keyboard's strikes never overlap and each frame is its own strike's */
+        struct timespec t0;
+
+        qsort(strikes, n, sizeof(*strikes), by_end);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        for (i = 0; i < n; i++)
+        {
+            if (pace)
+                pace_until(strikes[i].end_us, &t0);
+
+            emit_frame(out, &strikes[i], strikes[i].dTOA);
+        }
+    }
+
+    fprintf(stderr, "capgen: %zu strikes over %.3f s, %zu characters skipped, %zu shifts missed\n",
+            n, n ? strikes[n - 1].end_us / 1000000.0 : 0.0, skipped, missed_shifts);
+
+    free(strikes);
+    if (expected)
+        fclose(expected);
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-i text] [-w out] [-x expected] [-F frames|stim] [-r keys/sec]\n"
+            "          [-j jitter ticks] [-g drift ticks/1000 keys] [-e echo prob]\n"
+            "          [-s shift ms]\n"
+            "          [-k keyboard 1|2] [-S seed] [-T pca tick Hz] [-p]\n"
+            "          [-K keymap]\n",
+            prog);
+}
+
+/* Returns the index into keymaps[] of the model with the passed name (or index),
+ * or -1 if there isn't one */
+static int find_keymap(const char *name)
+{
+    char *end;
+    long ndx = strtol(name, &end, 0);
+    int i;
+
+    if (*end == '\0' && end != name)
+        return (ndx >= 0 && ndx < num_keymaps) ? ndx : -1;
+
+    for (i = 0; i < num_keymaps; i++)
+    {
+        if (!strcmp(keymaps[i]->name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+/* Runs every table entry through interpretKeystroke() to find the middle of each
+ * character's bucket. Unshifted tables are searched first, so a character in both
+ * is typed without SHIFT */
+static void build_locations(void)
+{
+    static const uint8_t table_flags[NUM_TABLES] =
+    {
+        CAPTURE_FLAG_A_FIRST | CAPTURE_FLAG_A_POS,
+        CAPTURE_FLAG_A_FIRST | CAPTURE_FLAG_B_POS,
+        CAPTURE_FLAG_A_POS,
+        CAPTURE_FLAG_B_POS,
+        CAPTURE_FLAG_SHIFT | CAPTURE_FLAG_A_FIRST | CAPTURE_FLAG_A_POS,
+        CAPTURE_FLAG_SHIFT | CAPTURE_FLAG_A_FIRST | CAPTURE_FLAG_B_POS,
+        CAPTURE_FLAG_SHIFT | CAPTURE_FLAG_A_POS,
+        CAPTURE_FLAG_SHIFT | CAPTURE_FLAG_B_POS,
+    };
+    int t, ndx;
+
+    for (t = 0; t < NUM_TABLES; t++)
+    {
+        for (ndx = 0; ndx < KEYSTROKE_LUT_SIZE; )
+        {
+            uint8_t key = interpretKeystroke(table_flags[t], ndx * 3);
+            int end = ndx;
+
+            while (end < KEYSTROKE_LUT_SIZE && interpretKeystroke(table_flags[t], end * 3) == key)
+                end++;
+
+            if (key && !locations[key].found)
+            {
+                locations[key].found = 1;
+                locations[key].flags = table_flags[t];
+                /* Tables are indexed by dTOA / 3, so aim for the middle tick */
+                locations[key].dTOA = (ndx + end) * 3 / 2 + 1;
+
+                /* A single tab starts both channels positive */
+                if (expectedTabType(table_flags[t], locations[key].dTOA) == TAB_TYPE_C)
+                    locations[key].flags |= CAPTURE_FLAG_A_POS | CAPTURE_FLAG_B_POS;
+            }
+
+            ndx = end;
+        }
+    }
+}
+
+/* Box-Muller */
+static double gaussian(double sigma)
+{
+    double u1, u2;
+
+    if (sigma <= 0)
+        return 0;
+
+    do
+    {
+        u1 = uniform();
+    } while (u1 <= 0);
+    u2 = uniform();
+
+    return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static double uniform(void)
+{
+    return rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void emit_frame(FILE *out, const struct strike *s, uint16_t dTOA)
+{
+    uint8_t frame[CAPTURE_FRAME_SIZE];
+
+    frame[0] = CAPTURE_FRAME_SYNC;
+    frame[1] = s->flags;
+    frame[2] = dTOA >> 8;
+    frame[3] = dTOA & 0xFF;
+    frame[4] = frame[1] ^ frame[2] ^ frame[3];
+
+    fwrite(frame, 1, sizeof(frame), out);
+    fflush(out);
+}
+
+/* The first channel's wavefront at the start and the other's at coincidence.
+ * A channel not initially positive is taken as negative, like the decode does */
+static void add_stim(struct stim_event *ev, size_t *n, const struct strike *s)
+{
+    char a_pol = (s->flags & CAPTURE_FLAG_A_POS) ? '+' : '-';
+    char b_pol = (s->flags & CAPTURE_FLAG_B_POS) ? '+' : '-';
+    const char *prefix = (s->flags & CAPTURE_FLAG_KEYBOARD2) ? "2:" : "";
+    char first = (s->flags & CAPTURE_FLAG_A_FIRST) ? 'A' : 'B';
+
+    ev[*n].t_us = s->start_us;
+    sprintf(ev[(*n)++].text, "%s%c%c", prefix, first, (first == 'A') ? a_pol : b_pol);
+
+    ev[*n].t_us = s->end_us;
+    sprintf(ev[(*n)++].text, "%s%c%c", prefix, (first == 'A') ? 'B' : 'A', (first == 'A') ? b_pol : a_pol);
+
+    /* Missed shifts are still pressed, just too late */
+    if (s->shifted)
+    {
+        ev[*n].t_us = s->shift_us;
+        sprintf(ev[(*n)++].text, "%sSHIFT 1", prefix);
+
+        ev[*n].t_us = s->end_us + SHIFT_HOLD_MS * 1000.0;
+        sprintf(ev[(*n)++].text, "%sSHIFT 0", prefix);
+    }
+}
+
+static int by_end(const void *a, const void *b)
+{
+    const struct strike *sa = a, *sb = b;
+
+    return (sa->end_us > sb->end_us) - (sa->end_us < sb->end_us);
+}
+
+/* Sleeps until t_us after t0 */
+static void pace_until(double t_us, const struct timespec *t0)
+{
+    struct timespec now;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - t0->tv_sec) * 1000000.0 + (now.tv_nsec - t0->tv_nsec) / 1000.0;
+
+    if (t_us > elapsed)
+        usleep((useconds_t)(t_us - elapsed));
+}
+
+static int by_time(const void *a, const void *b)
+{
+    const struct stim_event *ea = a, *eb = b;
+
+    return (ea->t_us > eb->t_us) - (ea->t_us < eb->t_us);
+}
@@ -0,0 +1,574 @@
+/* ctl.c
+ * Final Project - Host side of the binary control and telemetry protocol (see
+ *                 control.h and the control frames in frames.h). Sends one
+ *                 command, waits for its answer and prints it, picking the frame
+ *                 out from whatever text the firmware sends around it.
+ *
+ *                 Build: gcc -O2 -Wall -I../Code -o ctl ctl.c
+ *
+ *                 Usage: ctl -d <tty|pty> [-b baud] [-v] <command>
+ *
+ *                 Commands:
+ *                   ping                   check the firmware is answering
+ *                   counters               print every counter
+ *                   get <key>              print a setting
+ *                   set <key> <value>      change a setting (as "set" does; kept
+ *                                          over a reset on ED2/ID2 parts only)
+ *                   mode <mode>            switch modes (normal, diagnostic,
+ *                                          typist, raw, event, editor or 0-5)
+ *                   stream [count]         print captures as they're typed, until
+ *                                          count have come (0, the default, for
+ *                                          ever)
+ *
+ *                 Keys are the shell's setting names or their numbers. -v prints
+ *                 the text between frames to stderr.
+ *                 Exits 0 if the command was carried out. Don't use it while
+ *                 xmrecv is taking an export; the port is XMODEM's until then.
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "frames.h"
+#include "config.h"
+
+/* How long to wait on an answer */
+#define REPLY_TIMEOUT_MS    (2000)
+
+/* Frame as received */
+struct frame
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t payload[CONTROL_MAX_PAYLOAD];
+};
+
+/* Setting names, as in the shell's "set" */
+static const struct
+{
+    const char *name;
+    uint8_t key;
+} keys[] =
+{
+    { "baud",        CONFIG_BAUD },
+    { "timeout",     CONFIG_TIMEOUT },
+    { "bootmode",    CONFIG_BOOT_MODE },
+    { "entercr",     CONFIG_ENTER_CR },
+    { "bigram",      CONFIG_BIGRAM },
+    { "keymap",      CONFIG_KEYMAP },
+    { "macros",      CONFIG_MACROS },
+    { "pulsewidths", CONFIG_PULSE_WIDTHS },
+    { "drift",       CONFIG_DRIFT },
+};
+
+#define NUM_KEYS    (sizeof(keys) / sizeof(keys[0]))
+
+/* Mode names, in BOOT_MODE_* order */
+static const char *modes[] = { "normal", "diagnostic", "typist", "raw", "event", "editor" };
+
+/* Counter names, in CONTROL_CTR_* order */
+static const char *counters[CONTROL_NUM_COUNTERS] =
+{
+    "captures", "errors", "stuck", "capture overruns",
+    "rx overruns", "macro overruns", "bad frames",
+};
+
+static int verbose;
+
+/* Internal function declarations */
+static void usage(const char *prog);
+static speed_t baud_to_speed(long baud);
+static int open_port(const char *path, long baud);
+static int read_byte(int fd, int timeout_ms);
+static uint8_t crc8(uint8_t crc, uint8_t c);
+static void send_frame(int fd, uint8_t type, const uint8_t *payload, uint8_t length);
+static int binary_frame(const uint8_t *buf, int len);
+static int read_frame(int fd, struct frame *f, int timeout_ms);
+static int await_reply(int fd, uint8_t sent, uint8_t want, struct frame *f);
+static int parse_key(const char *s);
+static int parse_mode(const char *s);
+static const char *key_name(uint8_t key);
+static void print_capture(const struct frame *f);
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL, *cmd;
+    long baud = 19200;
+    int opt, fd, key;
+    uint8_t payload[CONTROL_MAX_PAYLOAD];
+    struct frame f;
+
+    while ((opt = getopt(argc, argv, "d:b:vh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device = optarg; break;
+        case 'b': baud = strtol(optarg, NULL, 0); break;
+        case 'v': verbose = 1; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!device || optind >= argc)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    cmd = argv[optind++];
+
+    if ((fd = open_port(device, baud)) < 0)
+        return 1;
+
+    if (!strcmp(cmd, "ping"))
+    {
+        send_frame(fd, CONTROL_PING, NULL, 0);
+        if (await_reply(fd, CONTROL_PING, CONTROL_ACK, &f) < 0)
+            return 1;
+        printf("ok\n");
+    }
+    else if (!strcmp(cmd, "counters"))
+    {
+        int i;
+
+        send_frame(fd, CONTROL_GET_COUNTERS, NULL, 0);
+        if (await_reply(fd, CONTROL_GET_COUNTERS, CONTROL_COUNTERS, &f) < 0)
+            return 1;
+
+        for (i = 0; i < CONTROL_NUM_COUNTERS && i * 2 + 1 < f.length; i++)
+            printf("%-17s %u\n", counters[i], (f.payload[i * 2] << 8) | f.payload[i * 2 + 1]);
+    }
+    else if (!strcmp(cmd, "get") && optind + 1 == argc)
+    {
+        if ((key = parse_key(argv[optind])) < 0)
+            return 2;
+
+        payload[0] = key;
+        send_frame(fd, CONTROL_GET_CONFIG, payload, 1);
+        if (await_reply(fd, CONTROL_GET_CONFIG, CONTROL_CONFIG, &f) < 0)
+            return 1;
+
+        printf("%s = %u\n", key_name(f.payload[0]), (f.payload[1] << 8) | f.payload[2]);
+    }
+    else if (!strcmp(cmd, "set") && optind + 2 == argc)
+    {
+        unsigned long value = strtoul(argv[optind + 1], NULL, 0);
+
+        if ((key = parse_key(argv[optind])) < 0)
+            return 2;
+
+        if (value > 0xFFFF)
+        {
+            fprintf(stderr, "ctl: value out of range\n");
+            return 2;
+        }
+
+        payload[0] = key;
+        payload[1] = value >> 8;
+        payload[2] = value & 0xFF;
+        send_frame(fd, CONTROL_SET_CONFIG, payload, 3);
+        if (await_reply(fd, CONTROL_SET_CONFIG, CONTROL_CONFIG, &f) < 0)
+            return 1;
+
+        printf("%s = %u\n", key_name(f.payload[0]), (f.payload[1] << 8) | f.payload[2]);
+    }
+    else if (!strcmp(cmd, "mode") && optind + 1 == argc)
+    {
+        int mode = parse_mode(argv[optind]);
+
+        if (mode < 0)
+            return 2;
+
+        payload[0] = mode;
+        send_frame(fd, CONTROL_SET_MODE, payload, 1);
+        if (await_reply(fd, CONTROL_SET_MODE, CONTROL_ACK, &f) < 0)
+            return 1;
+
+        printf("ok\n");
+    }
+    else if (!strcmp(cmd, "stream") && optind + 1 >= argc)
+    {
+        unsigned long count = optind < argc ? strtoul(argv[optind], NULL, 0) : 0, n = 0;
+
+        payload[0] = 1;
+        send_frame(fd, CONTROL_STREAM, payload, 1);
+        if (await_reply(fd, CONTROL_STREAM, CONTROL_ACK, &f) < 0)
+            return 1;
+
+        /* Captures only come as fast as someone types, so wait as long as it takes */
+        while (!count || n < count)
+        {
+            if (read_frame(fd, &f, -1) < 0)
+                break;
+
+            if (f.type == CONTROL_CAPTURE && f.length == 6)
+            {
+                print_capture(&f);
+                n++;
+            }
+        }
+
+        payload[0] = 0;
+        send_frame(fd, CONTROL_STREAM, payload, 1);
+        await_reply(fd, CONTROL_STREAM, CONTROL_ACK, &f);
+    }
+    else
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s -d <tty|pty> [-b baud] [-v] <ping | counters | get key |\n"
+            "       set key value | mode mode | stream [count]>\n",
+            prog);
+}
+
+static speed_t baud_to_speed(long baud)
+{
+    switch (baud)
+    {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    default:     return 0;
+    }
+}
+
+/* Opens the port read/write. Terminals are put into raw mode at the given baud */
+static int open_port(const char *path, long baud)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if (isatty(fd))
+    {
+        struct termios tio;
+        speed_t speed = baud_to_speed(baud);
+
+        if (!speed)
+        {
+            fprintf(stderr, "unsupported baud rate %ld\n", baud);
+            close(fd);
+            return -1;
+        }
+
+        if (tcgetattr(fd, &tio) < 0)
+        {
+            perror("tcgetattr");
+            close(fd);
+            return -1;
+        }
+
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+
+        if (tcsetattr(fd, TCSANOW, &tio) < 0)
+        {
+            perror("tcsetattr");
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+/* Returns the next byte, or -1 if none comes within the timeout (-1 to wait for ever) */
+static int read_byte(int fd, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    uint8_t c;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return -1;
+
+    if (read(fd, &c, 1) != 1)
+        return -1;
+
+    return c;
+}
+
+/* Folds the next byte into a CRC-8, the same as the firmware's controlCrc() */
+static uint8_t crc8(uint8_t crc, uint8_t c)
+{
+    int i;
+
+    crc ^= c;
+    for (i = 0; i < 8; i++)
+        crc = (crc & 0x80) ? (crc << 1) ^ CONTROL_CRC_POLY : crc << 1;
+
+    return crc;
+}
+
+static void send_frame(int fd, uint8_t type, const uint8_t *payload, uint8_t length)
+{
+    uint8_t buf[CONTROL_MAX_PAYLOAD + CONTROL_OVERHEAD];
+    uint8_t crc = crc8(crc8(0, type), length);
+    int i;
+
+    buf[0] = CONTROL_ESCAPE;
+    buf[1] = type;
+    buf[2] = length;
+    for (i = 0; i < length; i++)
+    {
+        buf[3 + i] = payload[i];
+        crc = crc8(crc, payload[i]);
+    }
+    buf[3 + length] = crc;
+
+    if (write(fd, buf, length + CONTROL_OVERHEAD) != length + CONTROL_OVERHEAD)
+        perror("write");
+}
+
+/* Checks for a raw capture, key event or pulse width frame at the start of buf.
+ * Returns its size if one is all there and checks out, 0 if there isn't one, or
+ * -1 if there might be but more bytes are needed to tell */
+static int binary_frame(const uint8_t *buf, int len)
+{
+    int size;
+
+    switch (buf[0])
+    {
+    case CAPTURE_FRAME_SYNC: size = CAPTURE_FRAME_SIZE; break;
+    case EVENT_FRAME_SYNC:   size = EVENT_FRAME_SIZE; break;
+    case WIDTH_FRAME_SYNC:   size = WIDTH_FRAME_SIZE; break;
+    default:                 return 0;
+    }
+
+    if (len < size)
+        return -1;
+
+    if (buf[0] == CAPTURE_FRAME_SYNC && (buf[1] & CAPTURE_FLAG_RESERVED))
+        return 0;
+
+    /* Every one of them ends in the XOR of the bytes between sync and check */
+    {
+        uint8_t check = 0;
+        int i;
+
+        for (i = 1; i < size - 1; i++)
+            check ^= buf[i];
+
+        return (check == buf[size - 1]) ? size : 0;
+    }
+}
+
+/* Reads up to the next good frame. Bytes that aren't part of one are text, and
+ * printed with -v. Raw capture, key event and pulse width frames are binary and
+ * can carry the escape byte (CAPTURE_FLAG_KEYBOARD2 is the same value), so any
+ * that check out are passed over whole. A frame that fails its crc may still have
+ * started on an escape byte that was really part of something else, so
+ * everything after its escape byte is scanned again. Returns -1 if nothing more
+ * comes within the timeout */
+static int read_frame(int fd, struct frame *f, int timeout_ms)
+{
+    uint8_t buf[CONTROL_MAX_PAYLOAD + CONTROL_OVERHEAD];
+    int len = 0, need, i, c, size;
+
+    for (;;)
+    {
+        /* Hunt for an escape byte, in what was held over first */
+        while (len && buf[0] != CONTROL_ESCAPE)
+        {
+            if ((size = binary_frame(buf, len)) < 0)
+                break;
+
+            if (!size)
+                size = 1;
+
+            if (verbose && size == 1)
+                fputc(buf[0], stderr);
+
+            len -= size;
+            memmove(buf, buf + size, len);
+        }
+
+        /* Part of a binary frame, still coming */
+        if (len && buf[0] != CONTROL_ESCAPE)
+        {
+            if ((c = read_byte(fd, timeout_ms)) < 0)
+                return -1;
+            buf[len++] = c;
+            continue;
+        }
+
+        /* Escape, type and length, then the rest */
+        need = len >= 3 && buf[2] <= CONTROL_MAX_PAYLOAD ? buf[2] + CONTROL_OVERHEAD : 3;
+
+        if (len >= 3 && buf[2] > CONTROL_MAX_PAYLOAD)
+        {
+            memmove(buf, buf + 1, --len);
+            continue;
+        }
+
+        if (len < need)
+        {
+            if ((c = read_byte(fd, timeout_ms)) < 0)
+                return -1;
+            buf[len++] = c;
+            continue;
+        }
+
+        {
+            uint8_t crc = 0;
+
+            for (i = 1; i < need - 1; i++)
+                crc = crc8(crc, buf[i]);
+
+            if (crc == buf[need - 1])
+            {
+                f->type = buf[1];
+                f->length = buf[2];
+                memcpy(f->payload, buf + 3, f->length);
+                return 0;
+            }
+        }
+
+        /* Bad crc, so rescan from the byte after the escape */
+        if (verbose)
+            fputc(buf[0], stderr);
+        memmove(buf, buf + 1, --len);
+    }
+}
+
+/* Waits for the answer to a frame just sent. Anything else that comes in
+ * meanwhile (captures still streaming) is passed over. Returns -1 on a timeout
+ * or a CONTROL_NAK */
+static int await_reply(int fd, uint8_t sent, uint8_t want, struct frame *f)
+{
+    for (;;)
+    {
+        if (read_frame(fd, f, REPLY_TIMEOUT_MS) < 0)
+        {
+            fprintf(stderr, "ctl: no answer\n");
+            return -1;
+        }
+
+        if (f->type == CONTROL_NAK && f->length == 2 && f->payload[0] == sent)
+        {
+            fprintf(stderr, "ctl: refused (%s)\n",
+                    f->payload[1] == CONTROL_ERR_UNKNOWN ? "unknown command" :
+                    f->payload[1] == CONTROL_ERR_LENGTH ? "bad length" :
+                    f->payload[1] == CONTROL_ERR_VALUE ? "bad value" : "unknown reason");
+            return -1;
+        }
+
+        if (f->type != want)
+            continue;
+
+        if (want == CONTROL_ACK && (f->length != 1 || f->payload[0] != sent))
+            continue;
+
+        if (want == CONTROL_CONFIG && f->length != 3)
+            continue;
+
+        return 0;
+    }
+}
+
+/* Returns the key for a setting name or number, or -1 */
+static int parse_key(const char *s)
+{
+    unsigned i;
+    char *end;
+    long key;
+
+    for (i = 0; i < NUM_KEYS; i++)
+    {
+        if (!strcmp(s, keys[i].name))
+            return keys[i].key;
+    }
+
+    key = strtol(s, &end, 0);
+    if (*end || key <= 0 || key >= CONFIG_NUM_KEYS)
+    {
+        fprintf(stderr, "ctl: no setting %s\n", s);
+        return -1;
+    }
+
+    return key;
+}
+
+/* Returns the BOOT_MODE_* for a mode name or number, or -1 */
+static int parse_mode(const char *s)
+{
+    unsigned i;
+    char *end;
+    long mode;
+
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        if (!strcmp(s, modes[i]))
+            return i;
+    }
+
+    mode = strtol(s, &end, 0);
+    if (*end || mode < 0 || mode > BOOT_MODE_MAX)
+    {
+        fprintf(stderr, "ctl: no mode %s\n", s);
+        return -1;
+    }
+
+    return mode;
+}
+
+static const char *key_name(uint8_t key)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_KEYS; i++)
+    {
+        if (keys[i].key == key)
+            return keys[i].name;
+    }
+
+    return "?";
+}
+
+/* One line per capture: sequence number, time, deltaTOA and the flags */
+static void print_capture(const struct frame *f)
+{
+    uint8_t flags = f->payload[0];
+    int16_t dtoa = (int16_t)((f->payload[1] << 8) | f->payload[2]);
+    uint16_t time = (f->payload[3] << 8) | f->payload[4];
+
+    printf("%3u %5u %6d %c %c%c%s%s\n", f->payload[5], time, dtoa,
+           (flags & CAPTURE_FLAG_A_FIRST) ? 'A' : 'B',
+           (flags & CAPTURE_FLAG_A_POS) ? '+' : '-',
+           (flags & CAPTURE_FLAG_B_POS) ? '+' : '-',
+           (flags & CAPTURE_FLAG_SHIFT) ? " shift" : "",
+           (flags & CAPTURE_FLAG_KEYBOARD2) ? " kb2" : "");
+    fflush(stdout);
+}
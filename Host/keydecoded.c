@@ -0,0 +1,612 @@
+/* keydecoded.c
+ * Final Project - Host-side decoding daemon. Reads the raw capture frames the
+ *                 firmware sends in raw capture mode ('/' from the menu) off of a
+ *                 tty, pty or recorded trace file, decodes them with the same
+ *                 lookup tables as the firmware (keymaps.c), and publishes the
+ *                 decoded text in timestamped batches on a FIFO and/or a Unix
+ *                 domain socket.
+ *
+ *                 Each batch is one line on the output:
+ *                     <seconds>.<microseconds> <TAB> <keyboard> <TAB> <text>\n
+ *                 where the timestamp is the host time the first keystroke of the
+ *                 batch was received, keyboard is 1 or 2 (for boards serving two
+ *                 keyboards, see DUAL_KEYBOARD in pca.h), and any byte outside
+ *                 printable ASCII (or a backslash) is escaped as \xNN. Each
+ *                 keyboard is batched separately.
+ *
+ *                 Build: gcc -O2 -Wall -I../Code -o keydecoded keydecoded.c \
+ *                            ../Code/keystrokes.c ../Code/keymaps.c ../Code/bigram.c
+ *
+ *                 Usage: keydecoded -d <tty|pty|trace> [-b baud] [-f fifo] [-u socket]
+ *                                   [-n batch chars] [-t batch ms] [-w trace out] [-c] [-v]
+ *                                   [-K keymap]
+ *
+ *                 Decoding goes through the same bigram context stage as the
+ *                 firmware (decodeKeystroke()), unless -c is given, and bucket
+ *                 edges follow timing drift the same way too (counted on exit
+ *                 as keystrokes moved by drift). The number of
+ *                 keystrokes the context stage changed is reported on exit, as
+ *                 are the keystrokes whose polarities didn't match the tab type
+ *                 of their bucket (moved to a nearby bucket that did, or
+ *                 flagged as mismatches, and marked with -v). -K
+ *                 picks the typewriter model to decode with, by name or index
+ *                 (the firmware's "keymap" setting), instead of the first one.
+ *
+ *                 A regular file given to -d is replayed as a recorded trace and the
+ *                 daemon exits at its end. Pointing -d at one side of a pty pair and
+ *                 writing a trace (e.g. one captured with -w) into the other side
+ *                 exercises the full serial path without the board.
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "keystrokes.h"
+#include "frames.h"
+
+/* Defaults for batching decoded text */
+#define DEFAULT_BATCH_CHARS     (32)
+#define DEFAULT_BATCH_MS        (50)
+
+/* Largest batch that can be requested, and the room needed to escape it */
+#define MAX_BATCH_CHARS         (256)
+#define MAX_LINE_SIZE           (32 + (MAX_BATCH_CHARS * 4))
+
+/* Most socket subscribers served at once */
+#define MAX_CLIENTS             (8)
+
+/* Parser for the incoming byte stream */
+struct frame_parser
+{
+    uint8_t buf[CAPTURE_FRAME_SIZE];
+    int len;
+};
+
+/* Decoded text waiting to be published */
+struct batch
+{
+    int keyboard;
+    uint8_t chars[MAX_BATCH_CHARS];
+    int len;
+    struct timeval first;   /* Arrival of the first keystroke in the batch */
+};
+
+/* Counters reported on exit */
+struct stats
+{
+    unsigned long frames;
+    unsigned long bad_frames;
+    unsigned long skipped_bytes;
+    unsigned long no_key;
+    unsigned long dropped_batches;
+    unsigned long context_changes;
+    unsigned long tab_corrections;
+    unsigned long drift_moves;
+    unsigned long tab_mismatches;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static int fifo_fd = -1;
+static int listen_fd = -1;
+static int client_fds[MAX_CLIENTS];
+static const char *socket_path;
+static int verbose;
+static struct stats stats;
+
+/* Internal function declarations */
+static void usage(const char *prog);
+static int find_keymap(const char *name);
+static speed_t baud_to_speed(long baud);
+static int open_input(const char *path, long baud, int *is_file);
+static int open_fifo(const char *path);
+static int open_socket(const char *path);
+static void accept_client(void);
+static void publish(const char *line, size_t len);
+static void flush_batch(struct batch *b);
+static void parse_byte(struct frame_parser *p, struct batch *b, uint8_t c, int batch_chars);
+static void handle_frame(const uint8_t *frame, struct batch *b, int batch_chars);
+static long ms_since(const struct timeval *t);
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL;
+    const char *fifo_path = NULL;
+    const char *trace_path = NULL;
+    long baud = 19200;
+    int batch_chars = DEFAULT_BATCH_CHARS;
+    int batch_ms = DEFAULT_BATCH_MS;
+    int in_fd, trace_fd = -1, is_file = 0;
+    int opt, i;
+    struct frame_parser parser = { .len = 0 };
+    struct batch batches[NUM_KEYBOARDS];
+
+    while ((opt = getopt(argc, argv, "d:b:f:u:n:t:w:K:cvh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device = optarg; break;
+        case 'b': baud = strtol(optarg, NULL, 0); break;
+        case 'f': fifo_path = optarg; break;
+        case 'u': socket_path = optarg; break;
+        case 'n': batch_chars = atoi(optarg); break;
+        case 't': batch_ms = atoi(optarg); break;
+        case 'w': trace_path = optarg; break;
+        case 'c': bigram_enabled = 0; break;
+        case 'v': verbose = 1; break;
+        case 'K':
+            if ((i = find_keymap(optarg)) < 0)
+            {
+                fprintf(stderr, "unknown keymap '%s'\n", optarg);
+                return 2;
+            }
+            active_keymap = i;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!device || batch_chars < 1 || batch_chars > MAX_BATCH_CHARS || batch_ms < 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* Drift is tracked against the buckets of the model picked */
+    driftReset();
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+        client_fds[i] = -1;
+
+    for (i = 0; i < NUM_KEYBOARDS; i++)
+    {
+        batches[i].keyboard = i;
+        batches[i].len = 0;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    if ((in_fd = open_input(device, baud, &is_file)) < 0)
+        return 1;
+
+    if (fifo_path && (fifo_fd = open_fifo(fifo_path)) < 0)
+        return 1;
+
+    if (socket_path && (listen_fd = open_socket(socket_path)) < 0)
+        return 1;
+
+    if (trace_path && (trace_fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        perror(trace_path);
+        return 1;
+    }
+
+    /* Nothing subscribed means the decoded text goes to stdout */
+    if (fifo_fd < 0 && listen_fd < 0)
+        fifo_fd = STDOUT_FILENO;
+
+    while (running)
+    {
+        struct pollfd fds[2];
+        int nfds = 0, timeout = -1, ret;
+
+        fds[nfds].fd = in_fd;
+        fds[nfds++].events = POLLIN;
+        if (listen_fd >= 0)
+        {
+            fds[nfds].fd = listen_fd;
+            fds[nfds++].events = POLLIN;
+        }
+
+        /* Only need to wake up on a timer if there's a batch to flush */
+        for (i = 0; i < NUM_KEYBOARDS; i++)
+        {
+            int left;
+
+            if (!batches[i].len)
+                continue;
+
+            left = batch_ms - ms_since(&batches[i].first);
+            if (left < 0)
+                left = 0;
+            if (timeout < 0 || left < timeout)
+                timeout = left;
+        }
+
+        ret = is_file ? 1 : poll(fds, nfds, timeout);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        for (i = 0; i < NUM_KEYBOARDS; i++)
+        {
+            if (batches[i].len && ms_since(&batches[i].first) >= batch_ms)
+                flush_batch(&batches[i]);
+        }
+
+        if (nfds > 1 && (fds[1].revents & POLLIN))
+            accept_client();
+
+        if (is_file || (fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            uint8_t buf[256];
+            ssize_t n = read(in_fd, buf, sizeof(buf));
+
+            if (n < 0 && (errno == EINTR || errno == EAGAIN))
+                continue;
+
+            /* End of a trace, or the other side of the pty closed (EIO) */
+            if (n <= 0)
+                break;
+
+            if (trace_fd >= 0 && write(trace_fd, buf, n) != n)
+                perror("trace write");
+
+            for (i = 0; i < n; i++)
+                parse_byte(&parser, batches, buf[i], batch_chars);
+        }
+    }
+
+    for (i = 0; i < NUM_KEYBOARDS; i++)
+        flush_batch(&batches[i]);
+
+    fprintf(stderr, "keydecoded: %lu frames, %lu bad frames, %lu bytes skipped, "
+                    "%lu undecodable, %lu changed by context, %lu moved by tab type, "
+                    "%lu tab type mismatches, %lu moved by drift, %lu batches dropped\n",
+            stats.frames, stats.bad_frames, stats.skipped_bytes,
+            stats.no_key, stats.context_changes, stats.tab_corrections,
+            stats.tab_mismatches, stats.drift_moves, stats.dropped_batches);
+
+    if (socket_path && listen_fd >= 0)
+        unlink(socket_path);
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s -d <tty|pty|trace> [-b baud] [-f fifo] [-u socket]\n"
+            "          [-n batch chars (1-%d)] [-t batch ms] [-w trace out] [-c] [-v]\n"
+            "          [-K keymap]\n",
+            prog, MAX_BATCH_CHARS);
+}
+
+/* Returns the index into keymaps[] of the model with the passed name (or index),
+ * or -1 if there isn't one */
+static int find_keymap(const char *name)
+{
+    char *end;
+    long ndx = strtol(name, &end, 0);
+    int i;
+
+    if (*end == '\0' && end != name)
+        return (ndx >= 0 && ndx < num_keymaps) ? ndx : -1;
+
+    for (i = 0; i < num_keymaps; i++)
+    {
+        if (!strcmp(keymaps[i]->name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+static speed_t baud_to_speed(long baud)
+{
+    switch (baud)
+    {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    default:     return 0;
+    }
+}
+
+/* Opens the capture source. Terminals are put into raw mode at the given baud,
+ * regular files are flagged so they get read through as a recorded trace */
+static int open_input(const char *path, long baud, int *is_file)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        *is_file = 1;
+        return fd;
+    }
+
+    if (isatty(fd))
+    {
+        struct termios tio;
+        speed_t speed = baud_to_speed(baud);
+
+        if (!speed)
+        {
+            fprintf(stderr, "unsupported baud rate %ld\n", baud);
+            close(fd);
+            return -1;
+        }
+
+        if (tcgetattr(fd, &tio) < 0)
+        {
+            perror("tcgetattr");
+            close(fd);
+            return -1;
+        }
+
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+
+        if (tcsetattr(fd, TCSANOW, &tio) < 0)
+        {
+            perror("tcsetattr");
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+/* Creates the FIFO if needed. Opened read/write so that the open doesn't block
+ * waiting on a reader, and non-blocking so a stalled reader can't stall decoding */
+static int open_fifo(const char *path)
+{
+    int fd;
+
+    if (mkfifo(path, 0644) < 0 && errno != EEXIST)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if ((fd = open(path, O_RDWR | O_NONBLOCK)) < 0)
+        perror(path);
+
+    return fd;
+}
+
+static int open_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, MAX_CLIENTS) < 0)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void accept_client(void)
+{
+    int i, fd = accept(listen_fd, NULL, NULL);
+
+    if (fd < 0)
+        return;
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (client_fds[i] < 0)
+        {
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            client_fds[i] = fd;
+            return;
+        }
+    }
+
+    close(fd);  /* Full up */
+}
+
+/* Sends a batch line to every subscriber. Anyone who can't keep up loses the
+ * batch rather than holding up decoding */
+static void publish(const char *line, size_t len)
+{
+    int i;
+
+    if (fifo_fd >= 0 && write(fifo_fd, line, len) != (ssize_t)len)
+        stats.dropped_batches++;
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (client_fds[i] < 0)
+            continue;
+
+        if (write(client_fds[i], line, len) != (ssize_t)len)
+        {
+            if (errno == EAGAIN)
+            {
+                stats.dropped_batches++;
+            }
+            else
+            {
+                close(client_fds[i]);   /* Subscriber went away */
+                client_fds[i] = -1;
+            }
+        }
+    }
+}
+
+static void flush_batch(struct batch *b)
+{
+    char line[MAX_LINE_SIZE];
+    int i, pos;
+
+    if (!b->len)
+        return;
+
+    pos = snprintf(line, sizeof(line), "%ld.%06ld\t%d\t",
+                   (long)b->first.tv_sec, (long)b->first.tv_usec, b->keyboard + 1);
+
+    for (i = 0; i < b->len; i++)
+    {
+        uint8_t c = b->chars[i];
+
+        if (c >= 0x20 && c < 0x7F && c != '\\')
+            line[pos++] = c;
+        else
+            pos += sprintf(&line[pos], "\\x%02X", c);
+    }
+
+    line[pos++] = '\n';
+
+    publish(line, pos);
+    b->len = 0;
+}
+
+/* Feeds one received byte through the frame parser. Anything that isn't part
+ * of a valid frame is skipped, resyncing on the next sync byte. b is the array
+ * of per-keyboard batches */
+static void parse_byte(struct frame_parser *p, struct batch *b, uint8_t c, int batch_chars)
+{
+    if (p->len == 0 && c != CAPTURE_FRAME_SYNC)
+    {
+        stats.skipped_bytes++;
+        return;
+    }
+
+    p->buf[p->len++] = c;
+
+    if (p->len < CAPTURE_FRAME_SIZE)
+        return;
+
+    if ((p->buf[1] & CAPTURE_FLAG_RESERVED) == 0 &&
+        (p->buf[1] ^ p->buf[2] ^ p->buf[3]) == p->buf[4])
+    {
+        handle_frame(p->buf, b, batch_chars);
+        p->len = 0;
+        return;
+    }
+
+    /* Bad frame. The sync byte may have been data, so rescan the rest */
+    stats.bad_frames++;
+    {
+        uint8_t rest[CAPTURE_FRAME_SIZE - 1];
+        int i;
+
+        memcpy(rest, &p->buf[1], sizeof(rest));
+        p->len = 0;
+        stats.skipped_bytes++;
+
+        for (i = 0; i < (int)sizeof(rest); i++)
+            parse_byte(p, b, rest[i], batch_chars);
+    }
+}
+
+static void handle_frame(const uint8_t *frame, struct batch *batches, int batch_chars)
+{
+    uint8_t flags = frame[1];
+    uint16_t dTOA = (frame[2] << 8) | frame[3];
+    struct batch *b = &batches[CAPTURE_KEYBOARD(flags)];
+    uint16_t corrections = tab_type_corrections;
+    uint16_t moves = drift_moves;
+    uint16_t changes = context_changes;
+    uint8_t key;
+
+    stats.frames++;
+
+    key = decodeKeystroke(flags, dTOA);
+
+    if (drift_moves != moves)
+        stats.drift_moves++;
+    else if (tab_type_corrections != corrections)
+        stats.tab_corrections++;
+
+    if (context_changes != changes)
+        stats.context_changes++;
+
+    if (tab_type_mismatch)
+        stats.tab_mismatches++;
+
+    if (verbose)
+        fprintf(stderr, "frame: keyboard %d, %c first, A(%c) B(%c)%s, dTOA %u -> 0x%02X%s\n",
+                CAPTURE_KEYBOARD(flags) + 1,
+                (flags & CAPTURE_FLAG_A_FIRST) ? 'A' : 'B',
+                (flags & CAPTURE_FLAG_A_POS) ? '+' : '-',
+                (flags & CAPTURE_FLAG_B_POS) ? '+' : '-',
+                (flags & CAPTURE_FLAG_SHIFT) ? " shift" : "",
+                dTOA, key, tab_type_mismatch ? " (tab type mismatch)" : "");
+
+    if (!key)
+    {
+        stats.no_key++;
+        return;
+    }
+
+    if (!b->len)
+        gettimeofday(&b->first, NULL);
+
+    b->chars[b->len++] = key;
+
+    /* A carriage return ends a line, so there's no point holding it back */
+    if (b->len >= batch_chars || key == '\r')
+        flush_batch(b);
+}
+
+static long ms_since(const struct timeval *t)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - t->tv_sec) * 1000L + (now.tv_usec - t->tv_usec) / 1000L;
+}
@@ -0,0 +1,359 @@
+/* keymapgen.c
+ * Final Project - Keymap generator. Reads one or more keymap files (see
+ *                 Code/Keymaps/default.km for the format) and writes the C source
+ *                 with every model's decode tables, plus the list of them the
+ *                 firmware picks the active keymap from (see keystrokes.h).
+ *
+ *                 Build: gcc -O2 -Wall -I../Code -o keymapgen keymapgen.c
+ *
+ *                 Usage: keymapgen -o <keymaps.c> <keymap.km> [keymap.km ...]
+ *                 e.g.   keymapgen -o ../Code/keymaps.c ../Code/Keymaps/default.km
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "keystrokes.h"
+
+#define MAX_KEYMAPS             (16)
+#define MAX_LINE                (256)
+#define MAX_EXPR                (24)
+
+/* One decoded table entry, and how it's written out in C */
+struct entry
+{
+    uint8_t value;
+    char expr[MAX_EXPR];
+};
+
+struct keymap
+{
+    const char *path;
+    char name[KEYMAP_NAME_SIZE];
+    struct entry tables[KEYMAP_NUM_TABLES][KEYSTROKE_LUT_SIZE];
+    uint8_t single_tab[2][KEYMAP_SIDE_BYTES];
+    int filled[2];      /* Lookup steps filled so far on each side */
+};
+
+/* Special key names, as written in keymap files */
+struct key_name
+{
+    const char *name;
+    uint8_t value;
+    const char *expr;
+};
+
+static const struct key_name key_names[] =
+{
+    { "none",           0,                      "0" },
+    { "space",          ' ',                    "' '" },
+    { "return",         '\r',                   "'\\r'" },
+    { "SHIFT",          SHIFT_CODE,             "SHIFT_CODE" },
+    { "TAB",            TAB_CODE,               "TAB_CODE" },
+    { "TAB_SET",        TAB_SET_CODE,           "TAB_SET_CODE" },
+    { "TAB_CLEAR",      TAB_CLEAR_CODE,         "TAB_CLEAR_CODE" },
+    { "MARGIN_RELEASE", MARGIN_RELEASE_CODE,    "MARGIN_RELEASE_CODE" },
+    { "HALF_SPACE",     HALF_SPACE_CODE,        "HALF_SPACE_CODE" },
+    { "INDEX",          INDEX_CODE,             "INDEX_CODE" },
+    { "LEFT_MARGIN",    LEFT_MARGIN_CODE,       "LEFT_MARGIN_CODE" },
+    { "RIGHT_MARGIN",   RIGHT_MARGIN_CODE,      "RIGHT_MARGIN_CODE" },
+    { "CORRECT",        CORRECT_CODE,           "CORRECT_CODE" },
+    { "BACKSPACE",      BACKSPACE_CODE,         "BACKSPACE_CODE" },
+    { "HALF",           HALF_CODE,              "HALF_CODE" },
+    { "QUARTER",        QUARTER_CODE,           "QUARTER_CODE" },
+};
+
+/* Comments for each table, in KEYMAP_TABLE() order */
+static const char *table_names[KEYMAP_NUM_TABLES] =
+{
+    "A side, type A/C (A positive), no shift",
+    "A side, type B (B positive), no shift",
+    "B side, type A/C (A positive), no shift",
+    "B side, type B (B positive), no shift",
+    "A side, type A/C (A positive), shift",
+    "A side, type B (B positive), shift",
+    "B side, type A/C (A positive), shift",
+    "B side, type B (B positive), shift",
+};
+
+static struct keymap models[MAX_KEYMAPS];
+
+/* Internal function declarations */
+static int read_keymap(struct keymap *km, const char *path);
+static int parse_key(const char *tok, struct entry *e);
+static void write_keymaps(FILE *out, int n);
+
+int main(int argc, char **argv)
+{
+    const char *out_path = NULL;
+    FILE *out;
+    int opt, n = 0, i, j;
+
+    while ((opt = getopt(argc, argv, "o:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o': out_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s -o <keymaps.c> <keymap.km> [keymap.km ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (!out_path || optind >= argc || argc - optind > MAX_KEYMAPS)
+    {
+        fprintf(stderr, "usage: %s -o <keymaps.c> <keymap.km> [keymap.km ...] (up to %d)\n",
+                argv[0], MAX_KEYMAPS);
+        return 2;
+    }
+
+    for (i = optind; i < argc; i++, n++)
+    {
+        if (read_keymap(&models[n], argv[i]) < 0)
+            return 1;
+
+        for (j = 0; j < n; j++)
+        {
+            if (!strcmp(models[j].name, models[n].name))
+            {
+                fprintf(stderr, "%s: keymap '%s' already defined in %s\n",
+                        argv[i], models[n].name, models[j].path);
+                return 1;
+            }
+        }
+    }
+
+    if (!(out = fopen(out_path, "w")))
+    {
+        perror(out_path);
+        return 1;
+    }
+
+    write_keymaps(out, n);
+    fclose(out);
+
+    return 0;
+}
+
+static int read_keymap(struct keymap *km, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[MAX_LINE];
+    int line_no = 0, side = -1;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    km->path = path;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char *tok[6];
+        int ntok = 0;
+        char *p;
+
+        line_no++;
+
+        /* Only a # at the start of a line is a comment, since it's also a key */
+        for (p = line; isspace((unsigned char)*p); p++)
+            ;
+        if (*p == '#' || *p == '\0')
+            continue;
+
+        for (p = strtok(p, " \t\r\n"); p && ntok < 6; p = strtok(NULL, " \t\r\n"))
+            tok[ntok++] = p;
+
+        if (!strcmp(tok[0], "keymap") && ntok == 2)
+        {
+            if (strlen(tok[1]) >= KEYMAP_NAME_SIZE)
+            {
+                fprintf(stderr, "%s:%d: name longer than %d characters\n",
+                        path, line_no, KEYMAP_NAME_SIZE - 1);
+                goto fail;
+            }
+            strcpy(km->name, tok[1]);
+        }
+        else if (!strcmp(tok[0], "side") && ntok == 2 && (!strcmp(tok[1], "A") || !strcmp(tok[1], "B")))
+        {
+            side = tok[1][0] - 'A';
+        }
+        else if (!strcmp(tok[0], "slot") && ntok == 6)
+        {
+            struct entry keys[4];
+            int width = atoi(tok[1]);
+            int k, step, single;
+
+            if (side < 0)
+            {
+                fprintf(stderr, "%s:%d: slot before any side\n", path, line_no);
+                goto fail;
+            }
+
+            if (width < 1 || km->filled[side] + width > KEYSTROKE_LUT_SIZE)
+            {
+                fprintf(stderr, "%s:%d: side %c runs past %d lookup steps\n",
+                        path, line_no, 'A' + side, KEYSTROKE_LUT_SIZE);
+                goto fail;
+            }
+
+            for (k = 0; k < 4; k++)
+            {
+                if (parse_key(tok[2 + k], &keys[k]) < 0)
+                {
+                    fprintf(stderr, "%s:%d: unknown key '%s'\n", path, line_no, tok[2 + k]);
+                    goto fail;
+                }
+            }
+
+            /* A slot with the same keys in both columns is a single type C tab,
+             * and one with different keys a pair of type A and B tabs */
+            single = keys[0].value == keys[2].value && keys[1].value == keys[3].value;
+
+            /* Columns are type A/C, shifted, type B, shifted. Tables are laid
+             * out as in KEYMAP_TABLE() */
+            for (step = km->filled[side]; step < km->filled[side] + width; step++)
+            {
+                km->tables[side * 2][step] = keys[0];
+                km->tables[4 + side * 2][step] = keys[1];
+                km->tables[side * 2 + 1][step] = keys[2];
+                km->tables[4 + side * 2 + 1][step] = keys[3];
+
+                if (single)
+                    km->single_tab[side][step / 8] |= 1 << (step % 8);
+            }
+
+            km->filled[side] += width;
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: can't make sense of this line\n", path, line_no);
+            goto fail;
+        }
+    }
+
+    fclose(f);
+
+    if (!km->name[0])
+    {
+        fprintf(stderr, "%s: no keymap name\n", path);
+        return -1;
+    }
+
+    if (km->filled[0] != KEYSTROKE_LUT_SIZE || km->filled[1] != KEYSTROKE_LUT_SIZE)
+    {
+        fprintf(stderr, "%s: each side's slots must cover %d lookup steps (A has %d, B has %d)\n",
+                path, KEYSTROKE_LUT_SIZE, km->filled[0], km->filled[1]);
+        return -1;
+    }
+
+    return 0;
+
+fail:
+    fclose(f);
+    return -1;
+}
+
+static int parse_key(const char *tok, struct entry *e)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++)
+    {
+        if (!strcmp(tok, key_names[i].name))
+        {
+            e->value = key_names[i].value;
+            strcpy(e->expr, key_names[i].expr);
+            return 0;
+        }
+    }
+
+    if (strlen(tok) != 1 || !isprint((unsigned char)tok[0]))
+        return -1;
+
+    e->value = tok[0];
+    if (tok[0] == '\'' || tok[0] == '\\')
+        sprintf(e->expr, "'\\%c'", tok[0]);
+    else
+        sprintf(e->expr, "'%c'", tok[0]);
+
+    return 0;
+}
+
+static void write_keymaps(FILE *out, int n)
+{
+    int i, t, step, run, k, side;
+
+    fprintf(out,
+            "/* keymaps.c\n"
+            " * Final Project - Decode tables for each typewriter model. GENERATED by\n"
+            " *                 Host/keymapgen from the keymap files in Keymaps/, so edit\n"
+            " *                 those and regenerate rather than editing this by hand.\n"
+            " * Tristan Lennertz\n"
+            " *\n"
+            " * SDCC Toolchain for AT89C51RC2\n"
+            " */\n"
+            "\n"
+            "#include \"keystrokes.h\"\n");
+
+    for (i = 0; i < n; i++)
+    {
+        const char *file = strrchr(models[i].path, '/');
+
+        fprintf(out, "\n/* %s, from Keymaps/%s */\n", models[i].name, file ? file + 1 : models[i].path);
+        fprintf(out, "const keymap_t keymap_%d =\n{\n    \"%s\",\n    {\n", i, models[i].name);
+
+        for (t = 0; t < KEYMAP_NUM_TABLES; t++)
+        {
+            fprintf(out, "        /* %s */\n        {\n", table_names[t]);
+
+            /* One line per run of the same key, like a slot in the keymap */
+            for (step = 0; step < KEYSTROKE_LUT_SIZE; step += run)
+            {
+                const struct entry *e = &models[i].tables[t][step];
+
+                for (run = 1; step + run < KEYSTROKE_LUT_SIZE &&
+                              models[i].tables[t][step + run].value == e->value &&
+                              !strcmp(models[i].tables[t][step + run].expr, e->expr); run++)
+                    ;
+
+                fprintf(out, "            ");
+                for (k = 0; k < run; k++)
+                    fprintf(out, "%s%s", e->expr,
+                            (step + k == KEYSTROKE_LUT_SIZE - 1) ? "" : (k == run - 1 ? "," : ", "));
+                fprintf(out, "\n");
+            }
+
+            fprintf(out, "        }%s\n", (t == KEYMAP_NUM_TABLES - 1) ? "" : ",");
+        }
+
+        fprintf(out, "    },\n    {\n");
+
+        /* Bit per lookup step, set where it's a single type C tab */
+        for (side = 0; side < 2; side++)
+        {
+            fprintf(out, "        /* %c side, single type C tabs */\n        {\n            ", 'A' + side);
+            for (k = 0; k < KEYMAP_SIDE_BYTES; k++)
+                fprintf(out, "0x%02X%s", models[i].single_tab[side][k],
+                        (k == KEYMAP_SIDE_BYTES - 1) ? "\n" : ", ");
+            fprintf(out, "        }%s\n", side ? "" : ",");
+        }
+
+        fprintf(out, "    }\n};\n");
+    }
+
+    fprintf(out, "\n/* See keystrokes.h */\nconst keymap_t * const keymaps[] =\n{\n");
+    for (i = 0; i < n; i++)
+        fprintf(out, "    &keymap_%d%s\n", i, (i == n - 1) ? "" : ",");
+    fprintf(out, "};\n\nconst uint8_t num_keymaps = %d;\n", n);
+}
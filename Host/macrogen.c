@@ -0,0 +1,381 @@
+/* macrogen.c
+ * Final Project - Macro generator. Reads one or more macro files (see
+ *                 Code/Macros/default.mac for the format) and writes the C source
+ *                 with the trie of abbreviations and their expansions that the
+ *                 firmware matches typed words against (see macro.h).
+ *
+ *                 Build: gcc -O2 -Wall -I../Code -o macrogen macrogen.c
+ *
+ *                 Usage: macrogen -o <macros.c> <macros.mac> [macros.mac ...]
+ *                 e.g.   macrogen -o ../Code/macros.c ../Code/Macros/default.mac
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "macro.h"
+#include "keystrokes.h"
+
+#define MAX_MACROS      (255)
+#define MAX_LINE        (512)
+
+struct macro
+{
+    char abbrev[MACRO_MAX_ABBREV + 1];
+    char *expansion;
+    const char *path;
+    int line_no;
+    unsigned text;      /* Offset of the expansion in macro_text[] */
+};
+
+/* Trie as it's built, before it's flattened out */
+struct node
+{
+    struct node *child[128];
+    int children;
+    int macro;          /* Index into defs[] ending here, or -1 */
+    unsigned offset;    /* Where it lands in macro_trie[] */
+    char prefix[MACRO_MAX_ABBREV + 1];
+};
+
+static struct macro defs[MAX_MACROS];
+static int num_defs;
+
+/* Internal function declarations */
+static int read_macros(const char *path);
+static int unescape(char *s);
+static struct node *new_node(const char *prefix, int len);
+static void insert(struct node *root, int m);
+static unsigned layout(struct node *n, unsigned offset);
+static void write_trie(FILE *out, struct node *n);
+static void write_string(FILE *out, const char *s);
+static void write_macros(FILE *out, struct node *root, unsigned trie_size);
+
+int main(int argc, char **argv)
+{
+    const char *out_path = NULL;
+    struct node *root;
+    unsigned text = 0, trie_size;
+    FILE *out;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "o:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o': out_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s -o <macros.c> <macros.mac> [macros.mac ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (!out_path || optind >= argc)
+    {
+        fprintf(stderr, "usage: %s -o <macros.c> <macros.mac> [macros.mac ...]\n", argv[0]);
+        return 2;
+    }
+
+    for (i = optind; i < argc; i++)
+    {
+        if (read_macros(argv[i]) < 0)
+            return 1;
+    }
+
+    root = new_node("", 0);
+    for (i = 0; i < num_defs; i++)
+    {
+        defs[i].text = text;
+        text += strlen(defs[i].expansion) + 1;
+        insert(root, i);
+    }
+
+    trie_size = layout(root, 0);
+
+    if (trie_size > MACRO_NONE || text > MACRO_NONE)
+    {
+        fprintf(stderr, "macros don't fit in 16 bit offsets (trie %u, text %u bytes)\n",
+                trie_size, text);
+        return 1;
+    }
+
+    if (!(out = fopen(out_path, "w")))
+    {
+        perror(out_path);
+        return 1;
+    }
+
+    write_macros(out, root, trie_size);
+    fclose(out);
+
+    fprintf(stderr, "%d macros, %u byte trie, %u bytes of text\n", num_defs, trie_size, text);
+    return 0;
+}
+
+static int read_macros(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[MAX_LINE];
+    int line_no = 0, i;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        struct macro *m;
+        char *p, *abbrev, *end;
+        size_t len;
+
+        line_no++;
+
+        for (p = line; isspace((unsigned char)*p); p++)
+            ;
+        if (*p == '#' || *p == '\0')
+            continue;
+
+        /* Abbreviation is the first word, the expansion everything after it */
+        abbrev = p;
+        while (*p && !isspace((unsigned char)*p))
+            p++;
+        end = p;
+        while (isspace((unsigned char)*p))
+            p++;
+        *end = '\0';
+
+        len = strlen(p);
+        while (len && isspace((unsigned char)p[len - 1]))
+            p[--len] = '\0';
+
+        if (num_defs >= MAX_MACROS)
+        {
+            fprintf(stderr, "%s:%d: more than %d macros\n", path, line_no, MAX_MACROS);
+            goto fail;
+        }
+
+        if (strlen(abbrev) > MACRO_MAX_ABBREV)
+        {
+            fprintf(stderr, "%s:%d: abbreviation longer than %d characters\n",
+                    path, line_no, MACRO_MAX_ABBREV);
+            goto fail;
+        }
+
+        for (i = 0; abbrev[i]; i++)
+        {
+            if (abbrev[i] <= ' ' || abbrev[i] >= 0x7F)
+            {
+                fprintf(stderr, "%s:%d: abbreviation can only have printable characters\n",
+                        path, line_no);
+                goto fail;
+            }
+        }
+
+        if (!len)
+        {
+            fprintf(stderr, "%s:%d: no expansion for '%s'\n", path, line_no, abbrev);
+            goto fail;
+        }
+
+        if (unescape(p) < 0)
+        {
+            fprintf(stderr, "%s:%d: bad escape or character in expansion\n", path, line_no);
+            goto fail;
+        }
+
+        for (i = 0; i < num_defs; i++)
+        {
+            if (!strcmp(defs[i].abbrev, abbrev))
+            {
+                fprintf(stderr, "%s:%d: '%s' already defined at %s:%d\n",
+                        path, line_no, abbrev, defs[i].path, defs[i].line_no);
+                goto fail;
+            }
+        }
+
+        m = &defs[num_defs++];
+        strcpy(m->abbrev, abbrev);
+        m->expansion = strdup(p);
+        m->path = path;
+        m->line_no = line_no;
+    }
+
+    fclose(f);
+    return 0;
+
+fail:
+    fclose(f);
+    return -1;
+}
+
+/* Turns the escapes in an expansion into the keys they stand for, in place.
+ * Returns -1 on an unknown escape or a character that isn't a key */
+static int unescape(char *s)
+{
+    char *out = s;
+
+    for (; *s; s++)
+    {
+        if (*s == '\\')
+        {
+            switch (*++s)
+            {
+            case 'n':  *out++ = LEFT_MARGIN_CODE; break;   /* Return */
+            case 't':  *out++ = TAB_CODE; break;
+            case 's':  *out++ = ' '; break;
+            case '\\': *out++ = '\\'; break;
+            default:   return -1;
+            }
+        }
+        else if (*s >= ' ' && *s < 0x7F)
+        {
+            *out++ = *s;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    *out = '\0';
+    return 0;
+}
+
+static struct node *new_node(const char *prefix, int len)
+{
+    struct node *n = calloc(1, sizeof(*n));
+
+    memcpy(n->prefix, prefix, len);
+    n->macro = -1;
+    return n;
+}
+
+static void insert(struct node *root, int m)
+{
+    const char *a = defs[m].abbrev;
+    struct node *n = root;
+    int i;
+
+    for (i = 0; a[i]; i++)
+    {
+        if (!n->child[(int)a[i]])
+        {
+            n->child[(int)a[i]] = new_node(a, i + 1);
+            n->children++;
+        }
+        n = n->child[(int)a[i]];
+    }
+
+    n->macro = m;
+}
+
+/* Gives every node its offset, parents before children. Returns the offset just
+ * past the last node */
+static unsigned layout(struct node *n, unsigned offset)
+{
+    int c;
+
+    n->offset = offset;
+    offset += MACRO_NODE_SIZE + n->children * MACRO_EDGE_SIZE;
+
+    for (c = 0; c < 128; c++)
+    {
+        if (n->child[c])
+            offset = layout(n->child[c], offset);
+    }
+
+    return offset;
+}
+
+static void write_trie(FILE *out, struct node *n)
+{
+    unsigned text = (n->macro < 0) ? MACRO_NONE : defs[n->macro].text;
+    int c;
+
+    fprintf(out, "    /* %u: \"", n->offset);
+    write_string(out, n->prefix);
+    fprintf(out, "\"%s */\n", (n->macro < 0) ? "" : " (abbreviation)");
+    fprintf(out, "    %d, 0x%02X, 0x%02X,", n->children, text >> 8, text & 0xFF);
+
+    /* Children go in key order, which is what lets the firmware stop early */
+    for (c = 0; c < 128; c++)
+    {
+        if (!n->child[c])
+            continue;
+
+        if (c == '\'' || c == '\\')
+            fprintf(out, " '\\%c',", c);
+        else
+            fprintf(out, " '%c',", c);
+        fprintf(out, " 0x%02X, 0x%02X,", n->child[c]->offset >> 8, n->child[c]->offset & 0xFF);
+    }
+    fprintf(out, "\n");
+
+    for (c = 0; c < 128; c++)
+    {
+        if (n->child[c])
+            write_trie(out, n->child[c]);
+    }
+}
+
+/* Writes out the characters of a string as they'd go in a C string literal */
+static void write_string(FILE *out, const char *s)
+{
+    for (; *s; s++)
+    {
+        if (*s == '\r')
+            fprintf(out, "\\r");
+        else if (*s == '\t')
+            fprintf(out, "\\t");
+        else if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if (*s == '*' && s[1] == '/')
+            fprintf(out, "*\\/");   /* Would end the comment it's in */
+        else
+            fputc(*s, out);
+    }
+}
+
+static void write_macros(FILE *out, struct node *root, unsigned trie_size)
+{
+    int i;
+
+    fprintf(out,
+            "/* macros.c\n"
+            " * Final Project - Abbreviations and their expansions. GENERATED by\n"
+            " *                 Host/macrogen from the macro files in Macros/, so edit\n"
+            " *                 those and regenerate rather than editing this by hand.\n"
+            " * Tristan Lennertz\n"
+            " *\n"
+            " * SDCC Toolchain for AT89C51RC2\n"
+            " */\n"
+            "\n"
+            "#include \"macro.h\"\n"
+            "\n"
+            "/* Expansions, each null terminated, in the order of the macro files */\n"
+            "const char macro_text[] =\n");
+
+    for (i = 0; i < num_defs; i++)
+    {
+        fprintf(out, "    \"");
+        write_string(out, defs[i].expansion);
+        fprintf(out, "\\0\"%s   /* %s */\n", (i == num_defs - 1) ? ";" : "", defs[i].abbrev);
+    }
+    if (!num_defs)
+        fprintf(out, "    \"\";\n");
+
+    fprintf(out, "\n/* Trie of the abbreviations, %u bytes (see macro.h for the layout) */\n", trie_size);
+    fprintf(out, "const uint8_t macro_trie[] =\n{\n");
+    write_trie(out, root);
+    fprintf(out, "};\n\nconst uint8_t num_macros = %d;\n", num_defs);
+}
@@ -0,0 +1,160 @@
+/* pld.c
+ * Final Project - Software model of the glue logic in FINAL.PLD (or CHANNELS.PLD)
+ *                 and the keystroke latches it's fed from (see pld.h).
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pld.h"
+
+void pld_eval(enum pld_variant variant, const struct pld_inputs *in, struct pld_outputs *out)
+{
+    if (variant == PLD_CHANNELS)
+    {
+        /* CHANNELS.PLD: Either polarity latch of a channel trips that channel's
+         * wavefront signal */
+        out->cex1 = in->a_pos_latch | in->a_neg_latch;
+        out->cex2 = in->b_pos_latch | in->b_neg_latch;
+    }
+    else
+    {
+        /* FINAL.PLD: Any of the wavefront latches will trip the wavefront detect
+         * signal, and one latch from each channel must be set to trigger the
+         * coincidence signal */
+        out->cex1 = in->a_pos_latch | in->a_neg_latch | in->b_pos_latch | in->b_neg_latch;
+        out->cex2 = (in->a_pos_latch | in->a_neg_latch) & (in->b_pos_latch | in->b_neg_latch);
+    }
+
+    /* The memory decode is the same in both */
+    out->n_wr_xram = in->a15 | in->n_wr;
+    out->n_rd_xram = in->a15 | in->n_rd;
+    out->lcd_e = in->a15 & !in->a14 & !(in->n_wr & in->n_rd);
+    out->lcd_rnw = in->a8;
+    out->lcd_rs = in->a9;
+}
+
+enum pld_target pld_bus_cycle(enum pld_variant variant, uint16_t addr, int write,
+                              int *lcd_rs, int *lcd_rnw)
+{
+    struct pld_inputs in = { 0 };
+    struct pld_outputs out;
+
+    in.a15 = (addr >> 15) & 1;
+    in.a14 = (addr >> 14) & 1;
+    in.a9 = (addr >> 9) & 1;
+    in.a8 = (addr >> 8) & 1;
+    in.n_rd = write;
+    in.n_wr = !write;
+
+    pld_eval(variant, &in, &out);
+
+    if (!out.n_wr_xram || !out.n_rd_xram)
+        return PLD_TARGET_XRAM;
+
+    if (out.lcd_e)
+    {
+        if (lcd_rs)
+            *lcd_rs = out.lcd_rs;
+        if (lcd_rnw)
+            *lcd_rnw = out.lcd_rnw;
+        return PLD_TARGET_LCD;
+    }
+
+    return PLD_TARGET_NONE;
+}
+
+int pld_memory_map(enum pld_variant variant, int write, struct pld_region *regions)
+{
+    int n = 0;
+    unsigned page;
+
+    /* Only A15-A8 go to the GAL, so everything within a page decodes the same */
+    for (page = 0; page < 0x100; page++)
+    {
+        struct pld_region r;
+
+        r.begin = page << 8;
+        r.end = r.begin | 0xFF;
+        r.lcd_rs = r.lcd_rnw = 0;
+        r.target = pld_bus_cycle(variant, r.begin, write, &r.lcd_rs, &r.lcd_rnw);
+
+        if (n && regions[n - 1].target == r.target &&
+            regions[n - 1].lcd_rs == r.lcd_rs && regions[n - 1].lcd_rnw == r.lcd_rnw)
+        {
+            regions[n - 1].end = r.end;
+        }
+        else
+        {
+            regions[n++] = r;
+        }
+    }
+
+    return n;
+}
+
+const char *pld_target_name(enum pld_target target)
+{
+    switch (target)
+    {
+    case PLD_TARGET_XRAM: return "xram";
+    case PLD_TARGET_LCD:  return "lcd";
+    default:              return "none";
+    }
+}
+
+void pld_board_reset(struct pld_board *board)
+{
+    board->latches = 0;
+    board->b_first = 0;
+}
+
+int pld_board_wavefront(struct pld_board *board, uint8_t bit)
+{
+    /* Only the first wavefront on each channel latches */
+    if ((bit & P1_A_LATCHES) && (board->latches & P1_A_LATCHES))
+        return 0;
+    if ((bit & P1_B_LATCHES) && (board->latches & P1_B_LATCHES))
+        return 0;
+
+    if (!board->latches)
+        board->b_first = (bit & P1_B_LATCHES) != 0;
+
+    board->latches |= bit;
+    return 1;
+}
+
+int pld_board_coincident(const struct pld_board *board)
+{
+    return (board->latches & P1_A_LATCHES) && (board->latches & P1_B_LATCHES);
+}
+
+uint8_t pld_board_port1(enum pld_variant variant, const struct pld_board *board)
+{
+    struct pld_inputs in = { 0 };
+    struct pld_outputs out;
+    uint8_t p1 = board->latches | P1_LATCH_RST;
+
+    /* No bus cycle going on */
+    in.n_rd = in.n_wr = 1;
+    in.a_pos_latch = (board->latches & P1_A_POS) != 0;
+    in.a_neg_latch = (board->latches & P1_A_NEG) != 0;
+    in.b_pos_latch = (board->latches & P1_B_POS) != 0;
+    in.b_neg_latch = (board->latches & P1_B_NEG) != 0;
+
+    pld_eval(variant, &in, &out);
+
+    if (out.cex1)
+        p1 |= P1_CEX1;
+    if (out.cex2)
+        p1 |= P1_CEX2;
+
+    /* The B first latch isn't fitted with CHANNELS.PLD */
+    if (variant == PLD_FINAL && board->b_first)
+        p1 |= P1_B_FIRST;
+
+    return p1;
+}
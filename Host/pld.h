@@ -0,0 +1,123 @@
+/* pld.h
+ * Final Project - Software model of the glue logic in FINAL.PLD (or CHANNELS.PLD)
+ *                 and the keystroke latches it's fed from, for driving the
+ *                 firmware in a simulator without the board. The equations are
+ *                 written out as they are in the PLD files, so the two can be
+ *                 checked against each other line for line.
+ *
+ *                 Build: compiled into the tool using it, e.g.
+ *                        gcc -O2 -Wall -I../Code -o <tool> <tool>.c pld.c
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#ifndef PLD_H
+#define PLD_H
+
+#include <stdint.h>
+
+/* Port 1 wiring (see pca.h and FINAL.PLD) */
+#define P1_A_POS                (0x01)
+#define P1_A_NEG                (0x02)
+#define P1_B_POS                (0x04)
+#define P1_B_NEG                (0x08)
+#define P1_CEX1                 (0x10)
+#define P1_CEX2                 (0x20)
+#define P1_LATCH_RST            (0x40)  /* Driven by the firmware */
+#define P1_B_FIRST              (0x80)
+
+#define P1_A_LATCHES            (P1_A_POS | P1_A_NEG)
+#define P1_B_LATCHES            (P1_B_POS | P1_B_NEG)
+
+/* Glue logic the board is fitted with */
+enum pld_variant
+{
+    PLD_FINAL,          /* FINAL.PLD: WavefrontDetect on CEX1, ChannelCoincidence on CEX2 */
+    PLD_CHANNELS,       /* CHANNELS.PLD: each channel's wavefront on CEX1 and CEX2 */
+};
+
+/* GAL inputs, after the pin names in the PLD files. Each is a logic level, 0 or 1 */
+struct pld_inputs
+{
+    int a15, a14, a9, a8;
+    int n_rd, n_wr;
+    int a_pos_latch, a_neg_latch, b_pos_latch, b_neg_latch;
+};
+
+/* GAL outputs */
+struct pld_outputs
+{
+    int cex1;           /* WavefrontDetect, or ChannelAWavefront */
+    int cex2;           /* ChannelCoincidence, or ChannelBWavefront */
+    int n_wr_xram;
+    int n_rd_xram;
+    int lcd_e;
+    int lcd_rnw;
+    int lcd_rs;
+};
+
+/* What an external data bus cycle reaches */
+enum pld_target
+{
+    PLD_TARGET_NONE,    /* Nothing decoded, so reads float */
+    PLD_TARGET_XRAM,
+    PLD_TARGET_LCD,
+};
+
+/* Run of addresses that a bus cycle reaches the same thing over */
+struct pld_region
+{
+    uint16_t begin;
+    uint16_t end;       /* Inclusive */
+    enum pld_target target;
+    int lcd_rs;         /* For PLD_TARGET_LCD, the register (1 = data) */
+    int lcd_rnw;        /* and the direction the LCD sees (1 = read) */
+};
+
+/* Most regions a memory map can have: one per page of A15-A8 */
+#define PLD_MAX_REGIONS         (256)
+
+/* The board's keystroke latches */
+struct pld_board
+{
+    uint8_t latches;    /* P1_A_* and P1_B_* bits */
+    int b_first;
+    int shift;
+};
+
+/* Evaluates every equation of the variant's PLD for one set of inputs */
+void pld_eval(enum pld_variant variant, const struct pld_inputs *in, struct pld_outputs *out);
+
+/* Runs a MOVX read or write of addr through the equations and returns what it
+ * reaches. For the LCD, lcd_rs and lcd_rnw (if not NULL) are set to the register
+ * and direction it sees */
+enum pld_target pld_bus_cycle(enum pld_variant variant, uint16_t addr, int write,
+                              int *lcd_rs, int *lcd_rnw);
+
+/* Works out the external data memory map for reads or writes by running a bus
+ * cycle at every page through the equations, and fills regions with it in
+ * address order. Returns the number of regions */
+int pld_memory_map(enum pld_variant variant, int write, struct pld_region *regions);
+
+/* Name of a bus target, for printing */
+const char *pld_target_name(enum pld_target target);
+
+/* Clears the board's latches, as the firmware's latch reset does */
+void pld_board_reset(struct pld_board *board);
+
+/* A wavefront arriving on a channel (one of the P1_A_* or P1_B_* latch bits). Only
+ * the first wavefront on each channel latches, and whichever channel latches first
+ * sets the B first latch. Returns 1 if it latched. Latches held in reset ignore
+ * every wavefront, which is up to the caller to check */
+int pld_board_wavefront(struct pld_board *board, uint8_t bit);
+
+/* Returns 1 once both channels have latched */
+int pld_board_coincident(const struct pld_board *board);
+
+/* Port 1 pin levels the board's latches and the GAL put on the MCU. The latch
+ * reset pin is left high, so the firmware's output on it reads back as written */
+uint8_t pld_board_port1(enum pld_variant variant, const struct pld_board *board);
+
+#endif // PLD_H
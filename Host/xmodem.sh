@@ -0,0 +1,119 @@
+#!/bin/bash
+# xmodem.sh
+# Final Project - XMODEM export runs. Builds xmrecv, and xmsend with the
+#                 firmware's xmodem.c in it, then sends a file from one to the
+#                 other over a pty at each baud rate and block loss level, and
+#                 checks it came through byte for byte. This is where the
+#                 throughput figures for "export" come from, so they can be
+#                 rerun after any change to xmodem.c or xmrecv.
+#
+#                 One line is printed per run:
+#                     baud loss bytes match naks seconds percent
+#                 where loss is xmrecv's -e (the share of good blocks thrown
+#                 away to make the sender resend them), naks counts those and
+#                 any real ones, and percent is the data rate against the line
+#                 rate (baud / 10 bytes a second).
+#
+#                 Only the protocol is measured here. xmsend paces its output
+#                 to the baud rate through a model of the firmware's transmit
+#                 buffer, but the pty adds no delay and nothing else competes
+#                 for the main loop, so the board will do somewhat worse.
+#
+#                 Usage: ./xmodem.sh [-i file] [-s size] [-b "baud rates"]
+#                                    [-e "loss levels"] [-S seed]
+#
+#                 The defaults send 20k of random bytes at 115200 and 19200
+#                 baud, with no loss and with 20% of blocks thrown away, using
+#                 seed 7. -i sends a file instead (up to 64k, as the document
+#                 on the board).
+#
+# Tristan Lennertz
+#
+# Bash, GCC Toolchain for Linux
+
+set -e
+
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+CODE_DIR="$HOST_DIR/../Code"
+
+INPUT=
+SIZE=20480
+BAUDS="115200 19200"
+LOSSES="0 0.2"
+SEED=7
+
+while getopts "i:s:b:e:S:h" opt; do
+    case $opt in
+        i) INPUT=$OPTARG ;;
+        s) SIZE=$OPTARG ;;
+        b) BAUDS=$OPTARG ;;
+        e) LOSSES=$OPTARG ;;
+        S) SEED=$OPTARG ;;
+        *) sed -n 's/^#                 Usage: //p' "$0" >&2; exit 1 ;;
+    esac
+done
+
+WORK=$(mktemp -d)
+trap 'kill $SENDER 2> /dev/null || true; rm -rf "$WORK"' EXIT
+
+# Stand-ins for the SDCC headers xmodem.c includes. Its putchar and getchar are
+# the firmware's own (serial.h), so the C library's are moved out of the way,
+# and printf_small is SDCC's. xmsend supplies all three
+mkdir "$WORK/sdcc"
+touch "$WORK/sdcc/at89c51ed2.h" "$WORK/sdcc/mcs51reg.h"
+cat > "$WORK/sdcc/stdio.h" << 'END'
+#define putchar libc_putchar
+#define getchar libc_getchar
+#include_next <stdio.h>
+#undef putchar
+#undef getchar
+#define putchar xm_putchar
+#define getchar xm_getchar
+#define printf_small xm_printf
+int xm_printf(const char *fmt, ...);
+END
+
+gcc -O2 -Wall -I"$CODE_DIR" -o "$WORK/xmrecv" "$HOST_DIR/xmrecv.c"
+gcc -O2 -Wall -I"$CODE_DIR" -c -o "$WORK/xmsend.o" "$HOST_DIR/xmsend.c"
+gcc -O2 -Wall -I"$WORK/sdcc" -I"$CODE_DIR" -D__near= -D'__interrupt(n)=' -D'__using(n)=' \
+    -c -o "$WORK/xmodem.o" "$CODE_DIR/xmodem.c"
+gcc -o "$WORK/xmsend" "$WORK/xmsend.o" "$WORK/xmodem.o"
+
+# Random bytes, escape and pad bytes included, but not ending in the pad byte
+# so xmrecv -t can trim the last block back to it
+if [ -z "$INPUT" ]; then
+    INPUT="$WORK/sent.bin"
+    LC_ALL=C awk -v n="$SIZE" -v s="$SEED" 'BEGIN {
+        srand(s)
+        for (i = 0; i < n - 1; i++)
+            printf "%c", int(rand() * 256)
+        printf "\n"
+    }' > "$INPUT"
+fi
+
+printf '%-7s %-5s %-6s %-6s %-5s %-8s %s\n' baud loss bytes match naks seconds percent
+
+for b in $BAUDS; do
+    for e in $LOSSES; do
+        "$WORK/xmsend" -i "$INPUT" -b "$b" > "$WORK/pty" 2> "$WORK/sender.txt" &
+        SENDER=$!
+
+        while [ ! -s "$WORK/pty" ]; do
+            sleep 0.1
+        done
+
+        "$WORK/xmrecv" -d "$(head -n 1 "$WORK/pty")" -w "$WORK/received.bin" -b "$b" \
+                       -e "$e" -S "$SEED" -t 2> "$WORK/stats.txt" || true
+        wait $SENDER || true
+
+        match=no
+        cmp -s "$INPUT" "$WORK/received.bin" 2> /dev/null && match=yes
+
+        # xmrecv's last line: "... N NAKs (..., S s, R bytes/s (P% of B baud)"
+        printf '%-7s %-5s %-6s %-6s %-5s %-8s %s\n' "$b" "$e" "$(wc -c < "$INPUT")" "$match" \
+               "$(sed -n 's/.* \([0-9]*\) NAKs.*/\1/p' "$WORK/stats.txt")" \
+               "$(sed -n 's/.*, \([0-9.]*\) s, .*/\1/p' "$WORK/stats.txt")" \
+               "$(sed -n 's/.*(\([0-9]*%\) of.*/\1/p' "$WORK/stats.txt")"
+        rm -f "$WORK/pty" "$WORK/received.bin"
+    done
+done
@@ -0,0 +1,406 @@
+/* xmrecv.c
+ * Final Project - XMODEM-CRC receiver for the firmware's exports ("export doc"
+ *                 and "export journal" in the host shell, see xmodem.h). Takes
+ *                 both 128 byte and 1k blocks, checks every one, and reports how
+ *                 many had to be resent and how close the transfer came to the
+ *                 line rate.
+ *
+ *                 -e makes it throw away good blocks at random (as if they'd
+ *                 arrived corrupted), to check the sender's retransmits, and the
+ *                 output should still match byte for byte. xmodem.sh runs it
+ *                 against the firmware's own sender (xmsend.c) over a pty, without
+ *                 the board.
+ *
+ *                 Build: gcc -O2 -Wall -I../Code -o xmrecv xmrecv.c
+ *
+ *                 Usage: xmrecv -d <tty|pty> -w <out> [-b baud] [-e prob] [-S seed]
+ *                               [-t] [-v]
+ *
+ *                 -t trims the padding XMODEM fills out the last block with. Only
+ *                 for documents, since a journal frame can end in the pad byte.
+ *                 A journal comes out as raw capture frames, ready for keydecoded
+ *                 (whose frame resync skips the padding).
+ *                 Exits 0 if the whole transfer made it.
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "xmodem.h"
+
+/* How often to ask the sender to start, and how many times before giving up */
+#define START_INTERVAL_MS   (3000)
+#define START_TRIES         (20)
+
+/* Longest gap allowed inside a block, and between blocks */
+#define BYTE_TIMEOUT_MS     (1000)
+#define BLOCK_TIMEOUT_MS    (10000)
+
+/* Bad or missing blocks in a row before giving up */
+#define MAX_ERRORS          (10)
+
+/* Counters reported at the end */
+struct stats
+{
+    unsigned long blocks;
+    unsigned long bytes;
+    unsigned long naks;
+    unsigned long injected;
+    unsigned long duplicates;
+};
+
+static int verbose;
+static struct stats stats;
+
+/* Internal function declarations */
+static void usage(const char *prog);
+static speed_t baud_to_speed(long baud);
+static int open_port(const char *path, long baud);
+static int read_byte(int fd, int timeout_ms);
+static int read_block(int fd, uint8_t *data, int size, uint8_t *num);
+static void send_byte(int fd, uint8_t c);
+static void purge(int fd);
+static uint16_t crc16(const uint8_t *buf, int len);
+static double seconds_since(const struct timeval *t);
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL, *out_path = NULL;
+    long baud = 19200;
+    double error_prob = 0;
+    unsigned seed = 1;
+    int trim = 0, opt, fd, c, tries, errors = 0, started = 0, done = 0;
+    uint8_t expected = 1, num;
+    uint8_t data[XMODEM_BLOCK_1K];
+    uint8_t *file = NULL;
+    size_t file_len = 0, file_cap = 0;
+    struct timeval t0;
+    FILE *out;
+
+    while ((opt = getopt(argc, argv, "d:w:b:e:S:tvh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device = optarg; break;
+        case 'w': out_path = optarg; break;
+        case 'b': baud = strtol(optarg, NULL, 0); break;
+        case 'e': error_prob = atof(optarg); break;
+        case 'S': seed = strtoul(optarg, NULL, 0); break;
+        case 't': trim = 1; break;
+        case 'v': verbose = 1; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!device || !out_path || error_prob < 0 || error_prob >= 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if ((fd = open_port(device, baud)) < 0)
+        return 1;
+
+    srand(seed);
+
+    /* Ask for CRC blocks until the first one shows up */
+    for (tries = 0; !started && tries < START_TRIES; tries++)
+    {
+        send_byte(fd, XMODEM_CRC_START);
+        c = read_byte(fd, START_INTERVAL_MS);
+        if (c == XMODEM_SOH || c == XMODEM_STX || c == XMODEM_EOT)
+            started = c;
+    }
+
+    if (!started)
+    {
+        fprintf(stderr, "xmrecv: sender never started\n");
+        return 1;
+    }
+
+    gettimeofday(&t0, NULL);
+    c = started;
+
+    while (!done)
+    {
+        int size;
+
+        if (c == XMODEM_EOT)
+        {
+            send_byte(fd, XMODEM_ACK);
+            done = 1;
+            break;
+        }
+
+        if (c == XMODEM_CAN)
+        {
+            fprintf(stderr, "xmrecv: sender cancelled\n");
+            return 1;
+        }
+
+        if (c == XMODEM_SOH || c == XMODEM_STX)
+        {
+            size = (c == XMODEM_STX) ? XMODEM_BLOCK_1K : XMODEM_BLOCK_SIZE;
+
+            if (read_block(fd, data, size, &num) < 0)
+            {
+                if (verbose)
+                    fprintf(stderr, "block %u: bad\n", expected);
+                purge(fd);
+                send_byte(fd, XMODEM_NAK);
+                stats.naks++;
+                errors++;
+            }
+            else if (num == (uint8_t)(expected - 1))
+            {
+                /* Sender missed our ACK and sent it again */
+                send_byte(fd, XMODEM_ACK);
+                stats.duplicates++;
+            }
+            else if (num != expected)
+            {
+                fprintf(stderr, "xmrecv: block %u out of sequence (expected %u)\n", num, expected);
+                send_byte(fd, XMODEM_CAN);
+                send_byte(fd, XMODEM_CAN);
+                return 1;
+            }
+            else if (error_prob > 0 && rand() < error_prob * ((double)RAND_MAX + 1))
+            {
+                if (verbose)
+                    fprintf(stderr, "block %u: thrown away\n", expected);
+                send_byte(fd, XMODEM_NAK);
+                stats.naks++;
+                stats.injected++;
+            }
+            else
+            {
+                if (file_len + size > file_cap)
+                {
+                    file_cap = (file_cap + size) * 2;
+                    file = realloc(file, file_cap);
+                }
+                memcpy(file + file_len, data, size);
+                file_len += size;
+
+                send_byte(fd, XMODEM_ACK);
+                stats.blocks++;
+                stats.bytes += size;
+                expected++;
+                errors = 0;
+
+                if (verbose)
+                    fprintf(stderr, "block %u: %d bytes\n", num, size);
+            }
+        }
+        else if (c < 0)
+        {
+            /* Nothing came, so nudge the sender */
+            send_byte(fd, XMODEM_NAK);
+            stats.naks++;
+            errors++;
+        }
+
+        if (errors >= MAX_ERRORS)
+        {
+            fprintf(stderr, "xmrecv: too many errors\n");
+            send_byte(fd, XMODEM_CAN);
+            send_byte(fd, XMODEM_CAN);
+            return 1;
+        }
+
+        c = read_byte(fd, BLOCK_TIMEOUT_MS);
+    }
+
+    if (trim)
+    {
+        while (file_len && file[file_len - 1] == XMODEM_PAD)
+            file_len--;
+    }
+
+    if (!(out = fopen(out_path, "wb")))
+    {
+        perror(out_path);
+        return 1;
+    }
+    if (file_len)
+        fwrite(file, 1, file_len, out);
+    fclose(out);
+
+    {
+        double secs = seconds_since(&t0);
+        double rate = secs > 0 ? stats.bytes / secs : 0;
+
+        fprintf(stderr, "xmrecv: %zu bytes in %lu blocks, %lu NAKs (%lu injected), "
+                "%lu duplicates, %.2f s, %.0f bytes/s (%.0f%% of %ld baud)\n",
+                file_len, stats.blocks, stats.naks, stats.injected, stats.duplicates,
+                secs, rate, 100.0 * rate / (baud / 10.0), baud);
+    }
+
+    free(file);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s -d <tty|pty> -w <out> [-b baud] [-e prob] [-S seed] [-t] [-v]\n",
+            prog);
+}
+
+static speed_t baud_to_speed(long baud)
+{
+    switch (baud)
+    {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    default:     return 0;
+    }
+}
+
+/* Opens the port read/write. Terminals are put into raw mode at the given baud */
+static int open_port(const char *path, long baud)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if (isatty(fd))
+    {
+        struct termios tio;
+        speed_t speed = baud_to_speed(baud);
+
+        if (!speed)
+        {
+            fprintf(stderr, "unsupported baud rate %ld\n", baud);
+            close(fd);
+            return -1;
+        }
+
+        if (tcgetattr(fd, &tio) < 0)
+        {
+            perror("tcgetattr");
+            close(fd);
+            return -1;
+        }
+
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+
+        if (tcsetattr(fd, TCSANOW, &tio) < 0)
+        {
+            perror("tcsetattr");
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+/* Returns the next byte, or -1 if none comes within the timeout */
+static int read_byte(int fd, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    uint8_t c;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return -1;
+
+    if (read(fd, &c, 1) != 1)
+        return -1;
+
+    return c;
+}
+
+/* Reads the rest of a block after its start byte. Returns -1 if it's short or
+ * fails its checks */
+static int read_block(int fd, uint8_t *data, int size, uint8_t *num)
+{
+    int n, inv, i, c, hi, lo;
+
+    if ((n = read_byte(fd, BYTE_TIMEOUT_MS)) < 0 || (inv = read_byte(fd, BYTE_TIMEOUT_MS)) < 0)
+        return -1;
+
+    if ((n ^ inv) != 0xFF)
+        return -1;
+
+    for (i = 0; i < size; i++)
+    {
+        if ((c = read_byte(fd, BYTE_TIMEOUT_MS)) < 0)
+            return -1;
+        data[i] = c;
+    }
+
+    if ((hi = read_byte(fd, BYTE_TIMEOUT_MS)) < 0 || (lo = read_byte(fd, BYTE_TIMEOUT_MS)) < 0)
+        return -1;
+
+    if (crc16(data, size) != ((hi << 8) | lo))
+        return -1;
+
+    *num = n;
+    return 0;
+}
+
+static void send_byte(int fd, uint8_t c)
+{
+    if (write(fd, &c, 1) != 1)
+        perror("write");
+}
+
+/* Drops whatever's left of a bad block, so the resend starts clean */
+static void purge(int fd)
+{
+    while (read_byte(fd, BYTE_TIMEOUT_MS) >= 0)
+        ;
+}
+
+/* CRC-16 as XMODEM uses it (polynomial 0x1021, starting from 0) */
+static uint16_t crc16(const uint8_t *buf, int len)
+{
+    uint16_t crc = 0;
+    int i, b;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+static double seconds_since(const struct timeval *t)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - t->tv_sec) + (now.tv_usec - t->tv_usec) / 1e6;
+}
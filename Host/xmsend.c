@@ -0,0 +1,277 @@
+/* xmsend.c
+ * Final Project - Runs the firmware's XMODEM sender (xmodem.c, unchanged) on the
+ *                 host, exporting a file as if it were the editor's document, so
+ *                 xmrecv can be tested without the board. Opens a pty, prints
+ *                 the name of its far side for the receiver, and serves the
+ *                 transfer over it from a loop like the firmware's main loop.
+ *
+ *                 The transmit buffer is modelled on the firmware's: putchar()
+ *                 writes straight to the pty, but txFree() only reports the room
+ *                 a TX_BUFFER_SIZE buffer emptying at the baud rate would have,
+ *                 so the transfer runs no faster than the serial port would let
+ *                 it. Replies come back as fast as the pty passes them.
+ *
+ *                 Build: see xmodem.sh, which supplies stand-ins for the SDCC
+ *                        headers xmodem.c includes and builds it in with this
+ *
+ *                 Usage: xmsend -i <file> [-b baud]
+ *
+ *                 The firmware's report at the end goes to stderr.
+ *                 Exits 0 if the transfer was acknowledged to the end.
+ *
+ * Tristan Lennertz
+ *
+ * GCC Toolchain for Linux
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xmodem.h"
+
+/* Same as serial.h. One slot is always left empty to tell full from empty */
+#define TX_BUFFER_SIZE  (64)
+
+/* What xmodem.c calls. putchar and printf_small are renamed when it's built
+ * (see xmodem.sh), since the C library has its own of both */
+void xm_putchar(char c);
+int xm_printf(const char *fmt, ...);
+int putstr(char *str);
+uint8_t txFree();
+uint16_t getTicks();
+uint16_t editorLength();
+uint8_t editorRead(uint16_t pos);
+uint16_t journalLength();
+uint8_t journalRead(uint16_t pos);
+
+uint8_t journal_hold;
+
+static int port_fd;
+static long baud = 115200;
+
+static uint8_t *doc;
+static size_t doc_len;
+
+/* Bytes still in the modelled transmit buffer, as of tx_counted */
+static double tx_queued;
+static double tx_counted;
+
+/* Set by the report xmodemFinish() prints on success */
+static int finished_ok;
+
+/* Internal function declarations */
+static void usage(const char *prog);
+static double now();
+static void drain();
+static int open_pty(char *name, size_t size);
+static int load(const char *path);
+
+int main(int argc, char **argv)
+{
+    const char *in_path = NULL;
+    char name[64];
+    int opt, far_fd;
+
+    while ((opt = getopt(argc, argv, "i:b:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i': in_path = optarg; break;
+        case 'b': baud = strtol(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!in_path || baud <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (load(in_path) < 0 || (port_fd = open_pty(name, sizeof(name))) < 0)
+        return 1;
+
+    /* Held open so the pty doesn't hang up before the receiver opens it, or
+     * between its opening and setting it up */
+    if ((far_fd = open(name, O_RDWR | O_NOCTTY)) < 0)
+    {
+        perror(name);
+        return 1;
+    }
+
+    printf("%s\n", name);
+    fflush(stdout);
+
+    tx_counted = now();
+    xmodemStart(XMODEM_SRC_DOC);
+
+    /* As the firmware's main loop: take what's come in, then move it along */
+    while (xmodem_active)
+    {
+        struct pollfd pfd = { .fd = port_fd, .events = POLLIN };
+        uint8_t c;
+
+        if (poll(&pfd, 1, 1) > 0 && read(port_fd, &c, 1) == 1)
+            xmodemInput(c);
+
+        if (xmodem_active)
+            xmodemService();
+    }
+
+    close(far_fd);
+    free(doc);
+    return finished_ok ? 0 : 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -i <file> [-b baud]\n", prog);
+}
+
+static double now()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Empties the modelled transmit buffer by what the line would have sent since
+ * it was last counted, at 10 bits a byte */
+static void drain()
+{
+    double t = now();
+
+    tx_queued -= (t - tx_counted) * baud / 10.0;
+    if (tx_queued < 0)
+        tx_queued = 0;
+    tx_counted = t;
+}
+
+/* Opens a new pty in raw mode, putting the name of its far side in name */
+static int open_pty(char *name, size_t size)
+{
+    struct termios tio;
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0)
+    {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    snprintf(name, size, "%s", ptsname(fd));
+
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    return fd;
+}
+
+/* Reads the file to export */
+static int load(const char *path)
+{
+    FILE *in = fopen(path, "rb");
+    size_t cap = 0, got;
+
+    if (!in)
+    {
+        perror(path);
+        return -1;
+    }
+
+    do
+    {
+        cap = cap ? cap * 2 : 4096;
+        doc = realloc(doc, cap);
+        got = fread(doc + doc_len, 1, cap - doc_len, in);
+        doc_len += got;
+    } while (doc_len == cap);
+
+    fclose(in);
+
+    /* editorLength() is 16 bits, as the document is on the board */
+    if (doc_len > 0xFFFF)
+    {
+        fprintf(stderr, "%s: too big to export (%zu bytes)\n", path, doc_len);
+        return -1;
+    }
+
+    return 0;
+}
+
+void xm_putchar(char c)
+{
+    drain();
+
+    if (write(port_fd, &c, 1) == 1)
+        tx_queued++;
+}
+
+int xm_printf(const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    finished_ok = 1;
+    return n;
+}
+
+int putstr(char *str)
+{
+    return fputs(str, stderr);
+}
+
+uint8_t txFree()
+{
+    int used;
+
+    drain();
+    used = (int)(tx_queued + 0.999);
+    return (used < TX_BUFFER_SIZE - 1) ? (TX_BUFFER_SIZE - 1) - used : 0;
+}
+
+uint16_t getTicks()
+{
+    return (uint16_t)(now() * 1000);
+}
+
+uint16_t editorLength()
+{
+    return doc_len;
+}
+
+uint8_t editorRead(uint16_t pos)
+{
+    return doc[pos];
+}
+
+/* Only the document is exported from here */
+uint16_t journalLength()
+{
+    return 0;
+}
+
+uint8_t journalRead(uint16_t pos)
+{
+    return 0;
+}